@@ -0,0 +1,85 @@
+#include "admission_filter.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+using namespace connect_four;
+
+AdmissionFilter::AdmissionFilter(size_t bits)
+    : m_words(bits == 0 ? 0 : std::bit_ceil(std::max<size_t>(bits, 64)) / 64)
+{
+}
+
+auto AdmissionFilter::visit(uint64_t key) -> bool
+{
+    if (!enabled())
+        return true;
+
+    m_visits += 1;
+
+    bool seen = true;
+    for (size_t i = 0; i < hash_count; ++i) {
+        auto bit = index(key, i);
+        if ((m_words[bit / 64] >> bit % 64 & 1) == 0) {
+            seen = false;
+            break;
+        }
+    }
+
+    if (seen) {
+        m_hits += 1;
+        return true;
+    }
+
+    for (size_t i = 0; i < hash_count; ++i) {
+        auto bit = index(key, i);
+        auto& word = m_words[bit / 64];
+        auto mask = uint64_t { 1 } << bit % 64;
+        if ((word & mask) == 0)
+            m_occupied += 1;
+        word |= mask;
+    }
+
+    if (static_cast<double>(m_occupied)
+        > max_load * static_cast<double>(size()))
+        reset();
+
+    return false;
+}
+
+auto AdmissionFilter::hit_rate() const -> double
+{
+    if (m_visits == 0)
+        return 0;
+    return static_cast<double>(m_hits) / static_cast<double>(m_visits);
+}
+
+auto AdmissionFilter::estimated_false_positive_rate() const -> double
+{
+    if (!enabled())
+        return 0;
+    auto load
+        = static_cast<double>(m_occupied) / static_cast<double>(size());
+    return std::pow(load, static_cast<double>(hash_count));
+}
+
+auto AdmissionFilter::index(uint64_t key, size_t i) const -> size_t
+{
+    // splitmix64 finalizer, then double hashing for the remaining indices
+    uint64_t h = key + 0x9e3779b97f4a7c15;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+    h ^= h >> 31;
+
+    auto h1 = h;
+    auto h2 = (h >> 32 | h << 32) | 1;
+    return (h1 + i * h2) & (size() - 1);
+}
+
+void AdmissionFilter::reset()
+{
+    std::fill(m_words.begin(), m_words.end(), 0);
+    m_occupied = 0;
+    m_resets += 1;
+}
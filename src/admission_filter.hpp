@@ -0,0 +1,75 @@
+#ifndef ADMISSION_FILTER_HPP
+#define ADMISSION_FILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace connect_four {
+
+/// Bloom filter deciding whether a position has been seen before.
+///
+/// Used to keep one-off positions out of model tables: a position is only
+/// admitted on its second visit. Its bits stay set until the filter is
+/// cleared.
+class AdmissionFilter {
+public:
+    static constexpr const size_t default_bits = 1 << 24;
+    static constexpr const size_t hash_count = 3;
+
+    /// `bits` is rounded up to a power of two of at least 64, 0 disables
+    /// the filter.
+    explicit AdmissionFilter(size_t bits = default_bits);
+
+    /// Records a visit of `key`. Returns true if `key` has (probably) been
+    /// visited before.
+    auto visit(uint64_t key) -> bool;
+
+    auto enabled() const -> bool
+    {
+        return !m_words.empty();
+    }
+
+    auto visits() const -> size_t
+    {
+        return m_visits;
+    }
+
+    auto hits() const -> size_t
+    {
+        return m_hits;
+    }
+
+    auto resets() const -> size_t
+    {
+        return m_resets;
+    }
+
+    auto hit_rate() const -> double;
+    auto estimated_false_positive_rate() const -> double;
+
+    /// number of bits
+    auto size() const -> size_t
+    {
+        return m_words.size() * 64;
+    }
+
+private:
+    auto index(uint64_t key, size_t i) const -> size_t;
+    void reset();
+
+    /// fraction of set bits at which the filter is cleared, which caps the
+    /// false positive rate at `max_load ^ hash_count`.
+    static constexpr const double max_load = 0.5;
+
+    std::vector<uint64_t> m_words;
+    size_t m_occupied = 0;
+
+    size_t m_visits = 0;
+    size_t m_hits = 0;
+    size_t m_resets = 0;
+};
+
+}
+
+#endif
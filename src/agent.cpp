@@ -0,0 +1,282 @@
+#include "agent.hpp"
+#include "board.hpp"
+#include "deci_tree_ai.hpp"
+#include "eval_cache.hpp"
+#include "nn_conv.hpp"
+#include "nn_file.hpp"
+#include "nn_model.hpp"
+#include "nn_quantized.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+auto AgentSpec::parse(std::string_view text) -> std::optional<AgentSpec>
+{
+    auto separator = text.find(':');
+    auto kind = text.substr(0, separator);
+    auto arg = separator == std::string_view::npos
+        ? std::string_view()
+        : text.substr(separator + 1);
+
+    auto parse_number = [&](auto& value) {
+        auto [end, error] = std::from_chars(arg.begin(), arg.end(), value);
+        return error == std::errc() && end == arg.end();
+    };
+
+    auto spec = AgentSpec {};
+    if (kind == "deci-tree" && !arg.empty()) {
+        spec.type = AgentType::DeciTree;
+        spec.model = arg;
+    } else if (kind == "minimax" && parse_number(spec.depth)) {
+        spec.type = AgentType::Minimax;
+    } else if (kind == "nn" && (arg.empty() || parse_number(spec.seed))) {
+        spec.type = AgentType::NeuralNet;
+    } else if (kind == "nn-conv" && (arg.empty() || parse_number(spec.seed))) {
+        spec.type = AgentType::ConvNeuralNet;
+    } else if (kind == "nn-file" && !arg.empty()) {
+        spec.type = AgentType::MappedNeuralNet;
+        spec.model = arg;
+    } else if (kind == "nn-int8" && (arg.empty() || parse_number(spec.seed))) {
+        spec.type = AgentType::QuantizedNeuralNet;
+    } else if (kind == "random" && arg.empty()) {
+        spec.type = AgentType::Random;
+    } else {
+        return {};
+    }
+    return spec;
+}
+
+auto AgentSpec::name() const -> std::string
+{
+    switch (type) {
+        case AgentType::DeciTree:
+            return std::format("deci-tree:{}", model.string());
+        case AgentType::Minimax:
+            return std::format("minimax:{}", depth);
+        case AgentType::NeuralNet:
+            return std::format("nn:{}", seed);
+        case AgentType::ConvNeuralNet:
+            return std::format("nn-conv:{}", seed);
+        case AgentType::MappedNeuralNet:
+            return std::format("nn-file:{}", model.string());
+        case AgentType::QuantizedNeuralNet:
+            return std::format("nn-int8:{}", seed);
+        case AgentType::Random:
+            return "random";
+    }
+    std::unreachable();
+}
+
+Opening::Opening(uint64_t seed, size_t game, size_t opening, size_t plies)
+    : m_rng(seed ^ (opening * 0x9e3779b97f4a7c15))
+    , m_plies(plies)
+{
+    seed_thread_rng(seed + game, 0);
+}
+
+auto Opening::random_move(const Board& board) -> Col
+{
+    auto possible_moves = board.possible_moves();
+    Col col;
+    do {
+        col = m_rng.below(Board::width);
+    } while (!possible_moves.at(col));
+    return col;
+}
+
+auto connect_four::make_agent(const AgentSpec& spec, Color color)
+    -> std::unique_ptr<Agent>
+{
+    switch (spec.type) {
+        case AgentType::DeciTree: {
+            auto path = spec.model;
+            path += color == Color::Red ? ".red" : ".blue";
+            // plays a finished table, so positions needn't earn an entry
+            auto ai = DeciTreeAi(color_to_tile(color), 0);
+            if (!ai.load(path))
+                return nullptr;
+            return std::make_unique<DeciTreeAgent>(std::move(ai));
+        }
+        case AgentType::Minimax:
+            return std::make_unique<MinimaxAgent>(color, spec.depth);
+        case AgentType::NeuralNet: {
+            // the same seed must give the same net on every thread
+            auto rng = Rng(spec.seed);
+            return std::make_unique<ModelAgent>(Model({ 42, 42, 18, 7 }, rng));
+        }
+        case AgentType::ConvNeuralNet: {
+            auto rng = Rng(spec.seed);
+            return std::make_unique<ConvModelAgent>(
+                ConvModel(8, { 18, 7 }, rng), color);
+        }
+        case AgentType::MappedNeuralNet: {
+            // every thread maps the same pages
+            auto agent = std::make_unique<MappedModelAgent>(spec.model);
+            const auto& model = agent->model();
+            if (!model.ok())
+                return nullptr;
+            if (model.layers().front() != Board::width * Board::height) {
+                std::cerr << std::format("'{}' takes {} inputs, not a board\n",
+                    spec.model.string(), model.layers().front());
+                return nullptr;
+            }
+            return agent;
+        }
+        case AgentType::QuantizedNeuralNet: {
+            auto rng = Rng(spec.seed);
+            auto model = Model({ 42, 42, 18, 7 }, rng);
+            return std::make_unique<QuantizedModelAgent>(
+                quantize_model(model, rng));
+        }
+        case AgentType::Random:
+            return std::make_unique<RandomAgent>();
+    }
+    std::unreachable();
+}
+
+namespace {
+
+template <typename T>
+auto best_col(const Board& board, std::span<const T> outputs) -> Col
+{
+    auto possible_moves = board.possible_moves();
+
+    size_t selected_col = 0;
+    T max = 0;
+    for (size_t col = 0; col < std::min(outputs.size(), Board::width); ++col) {
+        if (outputs[col] > max && possible_moves.at(col)) {
+            max = outputs[col];
+            selected_col = col;
+        }
+    }
+    return selected_col;
+}
+
+}
+
+auto connect_four::best_possible_col(
+    const Board& board, std::span<const double> outputs) -> Col
+{
+    return best_col(board, outputs);
+}
+
+auto connect_four::best_possible_col(
+    const Board& board, std::span<const float> outputs) -> Col
+{
+    return best_col(board, outputs);
+}
+
+auto connect_four::model_select_col(
+    const Board& board, const Model& model, Model::Scratch& scratch) -> Col
+{
+    auto inputs = FixedMx1<Board::width * Board::height>();
+    board.write_inputs(inputs.span());
+    return best_possible_col(board, model.feed(inputs.span(), scratch));
+}
+
+auto connect_four::model_select_col(const Board& board, const Model& model)
+    -> Col
+{
+    thread_local auto scratch = Model::Scratch();
+    return model_select_col(board, model, scratch);
+}
+
+auto connect_four::model_select_col(const Board& board, const Model& model,
+    EvalCache& cache, Model::Scratch& scratch) -> Col
+{
+    auto outputs = std::array<double, EvalCache::outputs>();
+    if (!cache.find(board, model.version(), outputs)) {
+        auto inputs = FixedMx1<Board::width * Board::height>();
+        board.write_inputs(inputs.span());
+        auto fed = model.feed(inputs.span(), scratch);
+        ASSERT_EQ(fed.size(), outputs.size());
+        std::copy(fed.begin(), fed.end(), outputs.begin());
+        cache.store(board, model.version(), outputs);
+    }
+    return best_possible_col(board, outputs);
+}
+
+auto connect_four::model_select_col(const Board& board,
+    const ConvModel& model, Color own, ConvModel::Scratch& scratch) -> Col
+{
+    auto inputs = std::array<double, ConvLayer::inputs>();
+    board.encode(std::span<double>(inputs), Encoding::Planes, own);
+    return best_possible_col(board, model.feed(inputs, scratch));
+}
+
+auto connect_four::model_select_col(const Board& board,
+    const MappedModel& model, MappedModel::Scratch& scratch) -> Col
+{
+    auto inputs = FixedMx1<Board::width * Board::height>();
+    board.write_inputs(inputs.span());
+    return best_possible_col(board, model.feed(inputs.span(), scratch));
+}
+
+auto connect_four::model_select_col(const Board& board,
+    const QuantizedModel& model, QuantizedModel::Scratch& scratch) -> Col
+{
+    auto inputs = FixedMx1<Board::width * Board::height>();
+    board.write_inputs(inputs.span());
+    return best_possible_col(board, model.feed(inputs.span(), scratch));
+}
+
+auto connect_four::quantize_model(const Model& model, Rng& rng, size_t count)
+    -> QuantizedModel
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    auto calibration = std::vector<double>(count * inputs_size);
+    for (size_t i = 0; i < count; ++i)
+        random_board(rng).write_inputs(
+            std::span(calibration).subspan(i * inputs_size, inputs_size));
+    return QuantizedModel(model, calibration, count);
+}
+
+auto connect_four::compare_quantized(const Model& model,
+    const QuantizedModel& quantized, std::span<const Board> positions)
+    -> QuantizationReport
+{
+    auto scratch = Model::Scratch();
+    auto quantized_scratch = QuantizedModel::Scratch();
+    auto inputs = FixedMx1<Board::width * Board::height>();
+
+    auto report = QuantizationReport { positions.size(), 0, 0.0 };
+    for (const auto& board : positions) {
+        board.write_inputs(inputs.span());
+        auto outputs = model.feed(inputs.span(), scratch);
+        auto quantized_outputs
+            = quantized.feed(inputs.span(), quantized_scratch);
+        for (size_t i = 0; i < outputs.size(); ++i)
+            report.max_error = std::max(report.max_error,
+                std::abs(outputs[i] - quantized_outputs[i]));
+        if (best_possible_col(board, outputs)
+            == best_possible_col(board, quantized_outputs))
+            report.agreeing += 1;
+    }
+    return report;
+}
+
+auto RandomAgent::next_move(const Board& board) -> Col
+{
+    auto possible_moves = board.possible_moves();
+    auto cols = std::array<Col, Board::width>();
+    size_t count = 0;
+    for (size_t col = 0; col < Board::width; ++col) {
+        if (possible_moves.at(col))
+            cols[count++] = col;
+    }
+    return cols[thread_rng().below(count)];
+}
@@ -0,0 +1,253 @@
+#ifndef AGENT_HPP
+#define AGENT_HPP
+
+#include "board.hpp"
+#include "deci_tree_ai.hpp"
+#include "eval_cache.hpp"
+#include "minimax.hpp"
+#include "nn_conv.hpp"
+#include "nn_file.hpp"
+#include "nn_model.hpp"
+#include "nn_quantized.hpp"
+#include "rng.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace connect_four {
+
+enum class AgentType {
+    DeciTree,
+    Minimax,
+    NeuralNet,
+    ConvNeuralNet,
+    MappedNeuralNet,
+    QuantizedNeuralNet,
+    Random,
+};
+
+/// Describes an agent, so every thread can make its own instance of it.
+struct AgentSpec {
+    AgentType type = AgentType::Random;
+    /// deci-tree models are read from `<model>.red` and `<model>.blue`, a
+    /// mapped net from `<model>` itself
+    std::filesystem::path model {};
+    size_t depth = 0;
+    /// seed of the initial weights of a neural net
+    uint64_t seed = 0;
+
+    /// `deci-tree:<model>`, `minimax:<depth>`, `nn[:<seed>]`,
+    /// `nn-conv[:<seed>]`, `nn-file:<model>`, `nn-int8[:<seed>]` or `random`
+    static auto parse(std::string_view text) -> std::optional<AgentSpec>;
+    auto name() const -> std::string;
+};
+
+/// Something that picks moves for one color.
+class Agent {
+public:
+    virtual ~Agent() = default;
+
+    virtual void new_game()
+    {
+    }
+
+    virtual auto next_move(const Board& board) -> Col = 0;
+};
+
+/// Plays the opening of a game: random legal columns for its first plies,
+/// then the agent's moves.
+class Opening {
+public:
+    /// Game `game` of a run seeded with `seed`, whose opening is drawn from
+    /// `opening`. Games sharing `opening` get the same opening. Also seeds
+    /// the thread's rng, so the game plays the same on any thread.
+    Opening(uint64_t seed, size_t game, size_t opening, size_t plies);
+
+    /// the move at `ply`, calling `agent_move()` once past the opening
+    auto next_move(const Board& board, size_t ply, auto agent_move) -> Col
+    {
+        if (ply < m_plies)
+            return random_move(board);
+        return agent_move();
+    }
+
+private:
+    auto random_move(const Board& board) -> Col;
+
+    Rng m_rng;
+    size_t m_plies;
+};
+
+/// Returns nullptr if the agent couldn't be made, e.g. a missing model.
+auto make_agent(const AgentSpec& spec, Color color) -> std::unique_ptr<Agent>;
+
+/// Column with the highest of `outputs` among the possible moves.
+auto best_possible_col(const Board& board, std::span<const double> outputs)
+    -> Col;
+auto best_possible_col(const Board& board, std::span<const float> outputs)
+    -> Col;
+
+/// Column with the highest output of `model` among the possible moves.
+auto model_select_col(
+    const Board& board, const Model& model, Model::Scratch& scratch) -> Col;
+/// Same, with a scratch buffer per thread.
+auto model_select_col(const Board& board, const Model& model) -> Col;
+/// Same, answering from `cache` when it can. A position mirrored from one
+/// in the cache gets the cached outputs mirrored, even if the model
+/// wouldn't have treated them alike.
+auto model_select_col(const Board& board, const Model& model,
+    EvalCache& cache, Model::Scratch& scratch) -> Col;
+/// Same for a quantized model.
+auto model_select_col(const Board& board, const QuantizedModel& model,
+    QuantizedModel::Scratch& scratch) -> Col;
+/// Same for a mapped model.
+auto model_select_col(const Board& board, const MappedModel& model,
+    MappedModel::Scratch& scratch) -> Col;
+/// Same for a convolutional model, which sees the board from `own`'s side.
+auto model_select_col(const Board& board, const ConvModel& model, Color own,
+    ConvModel::Scratch& scratch) -> Col;
+
+/// Quantizes `model`, calibrated on `count` random positions from `rng`.
+auto quantize_model(const Model& model, Rng& rng, size_t count = 1024)
+    -> QuantizedModel;
+
+struct QuantizationReport {
+    size_t positions;
+    /// positions where both models pick the same move
+    size_t agreeing;
+    /// largest difference of any output
+    double max_error;
+};
+
+/// Compares the moves `quantized` picks to those of `model` on `positions`.
+auto compare_quantized(const Model& model, const QuantizedModel& quantized,
+    std::span<const Board> positions) -> QuantizationReport;
+
+class DeciTreeAgent : public Agent {
+public:
+    explicit DeciTreeAgent(DeciTreeAi ai)
+        : m_ai(std::move(ai))
+    {
+        m_ai.set_exploration(0);
+    }
+
+    void new_game() override
+    {
+        m_ai.new_game();
+    }
+
+    auto next_move(const Board& board) -> Col override
+    {
+        return m_ai.next_move(board);
+    }
+
+private:
+    DeciTreeAi m_ai;
+};
+
+class MinimaxAgent : public Agent {
+public:
+    MinimaxAgent(Color color, size_t depth)
+        : m_minimax(color)
+        , m_depth(depth)
+    {
+    }
+
+    auto next_move(const Board& board) -> Col override
+    {
+        return m_minimax.choose(board, m_depth);
+    }
+
+private:
+    Minimax m_minimax;
+    size_t m_depth;
+};
+
+class ModelAgent : public Agent {
+public:
+    explicit ModelAgent(Model model)
+        : m_model(std::move(model))
+    {
+    }
+
+    auto next_move(const Board& board) -> Col override
+    {
+        return model_select_col(board, m_model, m_scratch);
+    }
+
+private:
+    Model m_model;
+    Model::Scratch m_scratch;
+};
+
+class ConvModelAgent : public Agent {
+public:
+    ConvModelAgent(ConvModel model, Color color)
+        : m_model(std::move(model))
+        , m_color(color)
+    {
+    }
+
+    auto next_move(const Board& board) -> Col override
+    {
+        return model_select_col(board, m_model, m_color, m_scratch);
+    }
+
+private:
+    ConvModel m_model;
+    Color m_color;
+    ConvModel::Scratch m_scratch;
+};
+
+class MappedModelAgent : public Agent {
+public:
+    explicit MappedModelAgent(const std::filesystem::path& path)
+        : m_model(path)
+    {
+    }
+
+    auto model() const -> const MappedModel&
+    {
+        return m_model;
+    }
+
+    auto next_move(const Board& board) -> Col override
+    {
+        return model_select_col(board, m_model, m_scratch);
+    }
+
+private:
+    MappedModel m_model;
+    MappedModel::Scratch m_scratch;
+};
+
+class QuantizedModelAgent : public Agent {
+public:
+    explicit QuantizedModelAgent(QuantizedModel model)
+        : m_model(std::move(model))
+    {
+    }
+
+    auto next_move(const Board& board) -> Col override
+    {
+        return model_select_col(board, m_model, m_scratch);
+    }
+
+private:
+    QuantizedModel m_model;
+    QuantizedModel::Scratch m_scratch;
+};
+
+class RandomAgent : public Agent {
+public:
+    auto next_move(const Board& board) -> Col override;
+};
+
+}
+
+#endif
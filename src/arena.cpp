@@ -0,0 +1,225 @@
+#include "arena.hpp"
+#include "agent.hpp"
+#include "board.hpp"
+#include "game_record.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <print>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Outcome : uint8_t {
+    Win,
+    Draw,
+    Loss,
+};
+
+struct Worker {
+    /// indexed by player, then by color
+    std::array<std::array<std::unique_ptr<Agent>, 2>, 2> agents;
+    std::array<std::vector<uint64_t>, 2> move_nanos;
+    std::optional<GameRecordWriter> records;
+};
+
+auto color_index(Color color) -> size_t
+{
+    return std::to_underlying(color);
+}
+
+auto play_game(const ArenaOptions& opts, Worker& worker, size_t game)
+    -> Outcome
+{
+    auto first_color = game % 2 == 0 ? Color::Red : Color::Blue;
+    auto player_of = [&](Color color) -> size_t {
+        return color == first_color ? 0 : 1;
+    };
+
+    // both games of a pair get the same opening
+    auto opening = Opening(opts.seed, game, game / 2, opts.opening_plies);
+
+    for (auto& agents : worker.agents)
+        for (auto& agent : agents)
+            agent->new_game();
+
+    auto record = GameRecord {
+        .tag = static_cast<uint16_t>(player_of(Color::Red)),
+    };
+    auto board = Board();
+    auto turn = Color::Red;
+    for (size_t ply = 0;; ++ply) {
+        auto col = opening.next_move(board, ply, [&] {
+            auto player = player_of(turn);
+            auto& agent = *worker.agents[player][color_index(turn)];
+            auto start = Clock::now();
+            auto col = agent.next_move(board);
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - start);
+            worker.move_nanos[player].push_back(
+                static_cast<uint64_t>(nanos.count()));
+            return col;
+        });
+        board.insert(col, color_to_tile(turn));
+        record.push(col);
+
+        auto state = board.game_state();
+        if (state != GameState::Ongoing) {
+            if (worker.records) {
+                record.result = state;
+                worker.records->append(record);
+            }
+            if (state == GameState::Draw)
+                return Outcome::Draw;
+            return state == color_win_state(first_color) ? Outcome::Win
+                                                         : Outcome::Loss;
+        }
+        turn = color_opposite(turn);
+    }
+}
+
+auto percentiles(std::vector<uint64_t>& nanos) -> MoveLatencies
+{
+    if (nanos.empty())
+        return {};
+    std::sort(nanos.begin(), nanos.end());
+    auto at = [&](double p) {
+        auto idx = static_cast<size_t>(
+            p * static_cast<double>(nanos.size() - 1) + 0.5);
+        return static_cast<double>(nanos[idx]) / 1000;
+    };
+    return {
+        .p50_us = at(0.5),
+        .p90_us = at(0.9),
+        .p99_us = at(0.99),
+        .max_us = at(1.0),
+    };
+}
+
+auto elo_from_score(double score) -> double
+{
+    score = std::clamp(score, 1e-6, 1 - 1e-6);
+    return -400 * std::log10(1 / score - 1);
+}
+
+void estimate_elo(ArenaResult& result)
+{
+    auto n = static_cast<double>(result.wins + result.draws + result.losses);
+    if (n == 0)
+        return;
+    auto w = static_cast<double>(result.wins) / n;
+    auto d = static_cast<double>(result.draws) / n;
+    auto l = static_cast<double>(result.losses) / n;
+    auto score = w + d / 2;
+
+    auto variance = w * std::pow(1 - score, 2) + d * std::pow(0.5 - score, 2)
+        + l * std::pow(score, 2);
+    auto margin = 1.96 * std::sqrt(variance / n);
+
+    result.elo = elo_from_score(score);
+    result.elo_low = elo_from_score(score - margin);
+    result.elo_high = elo_from_score(score + margin);
+}
+
+}
+
+auto connect_four::run_arena(const ArenaOptions& opts)
+    -> std::optional<ArenaResult>
+{
+    auto threads
+        = std::clamp<size_t>(opts.threads, 1, std::max<size_t>(opts.games, 1));
+
+    auto records = std::optional<GameRecordFile>();
+    if (!opts.record.empty()) {
+        records.emplace(opts.record);
+        if (!records->ok())
+            return {};
+    }
+
+    auto workers = std::vector<Worker>(threads);
+    for (auto& worker : workers) {
+        if (records)
+            worker.records.emplace(*records);
+        for (size_t player = 0; player < 2; ++player) {
+            const auto& spec = player == 0 ? opts.first : opts.second;
+            for (auto color : { Color::Red, Color::Blue }) {
+                auto agent = make_agent(spec, color);
+                if (!agent) {
+                    std::cerr << std::format(
+                        "could not make agent '{}'\n", spec.name());
+                    return {};
+                }
+                worker.agents[player][color_index(color)] = std::move(agent);
+            }
+        }
+    }
+
+    auto outcomes = std::vector<Outcome>(opts.games);
+    auto start = Clock::now();
+    parallel_for(opts.games, threads, [&](size_t thread, size_t game) {
+        outcomes[game] = play_game(opts, workers[thread], game);
+    });
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+
+    for (auto& worker : workers)
+        worker.records.reset();
+    if (records && !records->ok())
+        return {};
+
+    auto result = ArenaResult {};
+    for (auto outcome : outcomes) {
+        switch (outcome) {
+            case Outcome::Win:
+                result.wins += 1;
+                break;
+            case Outcome::Draw:
+                result.draws += 1;
+                break;
+            case Outcome::Loss:
+                result.losses += 1;
+                break;
+        }
+    }
+    estimate_elo(result);
+    result.games_per_sec = static_cast<double>(opts.games) / elapsed.count();
+
+    for (size_t player = 0; player < 2; ++player) {
+        auto nanos = std::vector<uint64_t>();
+        for (auto& worker : workers)
+            nanos.insert(nanos.end(), worker.move_nanos[player].begin(),
+                worker.move_nanos[player].end());
+        result.latencies[player] = percentiles(nanos);
+    }
+
+    return result;
+}
+
+void connect_four::print_arena_result(
+    const ArenaOptions& opts, const ArenaResult& result)
+{
+    std::println("{} vs {}, {} games", opts.first.name(), opts.second.name(),
+        opts.games);
+    std::println("W/D/L {}/{}/{}", result.wins, result.draws, result.losses);
+    std::println("elo {:+.0f} [{:+.0f}, {:+.0f}] (95%)", result.elo,
+        result.elo_low, result.elo_high);
+    std::println("{:.1f} games/s", result.games_per_sec);
+
+    std::println("move latency (us)\t     p50\t     p90\t     p99\t     max");
+    for (size_t player = 0; player < 2; ++player) {
+        const auto& spec = player == 0 ? opts.first : opts.second;
+        const auto& l = result.latencies[player];
+        std::println("{:24}\t{:8.1f}\t{:8.1f}\t{:8.1f}\t{:8.1f}", spec.name(),
+            l.p50_us, l.p90_us, l.p99_us, l.max_us);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include "agent.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+namespace connect_four {
+
+struct ArenaOptions {
+    AgentSpec first;
+    AgentSpec second;
+    size_t games = 1000;
+    size_t threads = 1;
+    uint64_t seed = 0;
+    /// random plies played before the agents take over. Game pairs share
+    /// an opening, with the agents' colors swapped.
+    size_t opening_plies = 2;
+    /// if set, every game is appended to this game record file, tagged
+    /// with the index of the agent playing red
+    std::filesystem::path record {};
+};
+
+struct MoveLatencies {
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double max_us = 0;
+};
+
+/// Results as seen from the first agent.
+struct ArenaResult {
+    size_t wins = 0;
+    size_t draws = 0;
+    size_t losses = 0;
+
+    /// rating difference with a 95% confidence interval
+    double elo = 0;
+    double elo_low = 0;
+    double elo_high = 0;
+
+    double games_per_sec = 0;
+    std::array<MoveLatencies, 2> latencies {};
+};
+
+/// Plays `games` games between two agents, alternating colors. Results
+/// only depend on `seed`, not on the number of threads.
+auto run_arena(const ArenaOptions& opts) -> std::optional<ArenaResult>;
+void print_arena_result(const ArenaOptions& opts, const ArenaResult& result);
+
+}
+
+#endif
@@ -0,0 +1,957 @@
+#include "bench.hpp"
+#include "agent.hpp"
+#include "board.hpp"
+#include "eval_cache.hpp"
+#include "nn_accumulator.hpp"
+#include "nn_conv.hpp"
+#include "nn_file.hpp"
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include "nn_noise.hpp"
+#include "nn_quantized.hpp"
+#include "nn_static.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <print>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename T>
+void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/// Calls `func` repeatedly for about 200ms, returns seconds per call.
+auto time_per_call(auto func) -> double
+{
+    func();
+    size_t calls = 1;
+    while (true) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < calls; ++i)
+            func();
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+        if (elapsed.count() > 0.2)
+            return elapsed.count() / static_cast<double>(calls);
+        calls *= 2;
+    }
+}
+
+auto random_vector(size_t size) -> std::vector<double>
+{
+    auto v = std::vector<double>(size);
+    thread_rng().fill_uniform(v, -1, 1);
+    return v;
+}
+
+// The loops Mx2 used before the kernels, as the baseline.
+
+void reference_gemv(
+    const double* m, const double* v, double* out, size_t rows, size_t cols)
+{
+    for (size_t row = 0; row < rows; ++row) {
+        out[row] = 0;
+        for (size_t col = 0; col < cols; ++col)
+            out[row] += m[row * cols + col] * v[col];
+    }
+}
+
+void reference_add_rows(double* m, const double* v, size_t rows, size_t cols)
+{
+    for (size_t col = 0; col < cols; ++col)
+        for (size_t row = 0; row < rows; ++row)
+            m[row * cols + col] += v[col];
+}
+
+auto available_kernels() -> std::vector<const NnKernels<double>*>
+{
+    auto all = std::vector<const NnKernels<double>*>();
+    for (auto isa : { Isa::Scalar, Isa::Avx2, Isa::Avx512 }) {
+        if (const auto* kernels = nn_kernels_for<double>(isa))
+            all.push_back(kernels);
+    }
+    return all;
+}
+
+void bench_kernels()
+{
+    constexpr auto shapes = std::array<std::array<size_t, 2>, 4> { {
+        { 18, 42 },
+        { 42, 42 },
+        { 256, 256 },
+        { 1024, 1024 },
+    } };
+
+    std::println("gemv, GFLOP/s");
+    std::println("{:>11}\t{:>10}\t{:>10}\t{:>10}\t{:>10}", "shape",
+        "reference", "scalar", "avx2", "avx512");
+    for (auto [rows, cols] : shapes) {
+        auto m = random_vector(rows * cols);
+        auto v = random_vector(cols);
+        auto out = std::vector<double>(rows);
+        auto flops = 2.0 * static_cast<double>(rows * cols);
+
+        std::print("{:>5}x{:<5}", rows, cols);
+        auto secs = time_per_call([&] {
+            reference_gemv(m.data(), v.data(), out.data(), rows, cols);
+            keep(out);
+        });
+        std::print("\t{:10.2f}", flops / secs / 1e9);
+        for (const auto* kernels : available_kernels()) {
+            secs = time_per_call([&] {
+                kernels->gemv(m.data(), v.data(), out.data(), rows, cols);
+                keep(out);
+            });
+            std::print("\t{:10.2f}", flops / secs / 1e9);
+        }
+        std::println();
+    }
+
+    std::println("\nadd_rows (Mx2 += Mx1), GFLOP/s");
+    std::println("{:>11}\t{:>10}\t{:>10}\t{:>10}\t{:>10}", "shape",
+        "reference", "scalar", "avx2", "avx512");
+    for (auto [rows, cols] : shapes) {
+        auto m = random_vector(rows * cols);
+        auto v = random_vector(cols);
+        auto flops = static_cast<double>(rows * cols);
+
+        std::print("{:>5}x{:<5}", rows, cols);
+        auto secs = time_per_call([&] {
+            reference_add_rows(m.data(), v.data(), rows, cols);
+            keep(m);
+        });
+        std::print("\t{:10.2f}", flops / secs / 1e9);
+        for (const auto* kernels : available_kernels()) {
+            secs = time_per_call([&] {
+                kernels->add_rows(m.data(), v.data(), rows, cols);
+                keep(m);
+            });
+            std::print("\t{:10.2f}", flops / secs / 1e9);
+        }
+        std::println();
+    }
+
+    std::println("\naxpy, GFLOP/s");
+    for (size_t size : { 42, 1764, 1 << 20 }) {
+        auto a = random_vector(size);
+        auto b = random_vector(size);
+        auto flops = 2.0 * static_cast<double>(size);
+
+        std::print("{:>11}", size);
+        auto secs = time_per_call([&] {
+            for (size_t i = 0; i < size; ++i)
+                a[i] += 1e-9 * b[i];
+            keep(a);
+        });
+        std::print("\t{:10.2f}", flops / secs / 1e9);
+        for (const auto* kernels : available_kernels()) {
+            secs = time_per_call([&] {
+                kernels->axpy(a.data(), 1e-9, b.data(), size);
+                keep(a);
+            });
+            std::print("\t{:10.2f}", flops / secs / 1e9);
+        }
+        std::println();
+    }
+}
+
+template <typename T>
+void bench_sigmoid_of(std::string_view name)
+{
+    // weighted inputs of a layer, plus a tail that isn't a whole vector
+    constexpr size_t size = 1027;
+    auto z = std::vector<T>(size);
+    auto bias = std::vector<T>(size);
+    for (size_t i = 0; i < size; ++i)
+        z[i] = static_cast<T>(-30.0 + 60.0 * static_cast<double>(i) / size);
+    auto out = z;
+
+    std::print("{:>9}", name);
+    auto secs = time_per_call([&] {
+        for (size_t i = 0; i < size; ++i)
+            out[i] = sigmoid(z[i] + bias[i]);
+        keep(out);
+    });
+    std::print("\t{:10.2f}", secs / size * 1e9);
+    auto errors = std::vector<double>();
+    for (auto isa : { Isa::Scalar, Isa::Avx2, Isa::Avx512 }) {
+        const auto* kernels = nn_kernels_for<T>(isa);
+        if (!kernels)
+            continue;
+        secs = time_per_call([&] {
+            std::copy(z.begin(), z.end(), out.begin());
+            kernels->bias_sigmoid(out.data(), bias.data(), size);
+            keep(out);
+        });
+        std::print("\t{:10.2f}", secs / size * 1e9);
+        double max_error = 0;
+        for (size_t i = 0; i < size; ++i)
+            max_error = std::max(max_error,
+                std::abs(static_cast<double>(out[i])
+                    - 1 / (1 + std::exp(static_cast<double>(z[i])))));
+        errors.push_back(max_error);
+    }
+    std::print("\t");
+    for (auto error : errors)
+        std::print(" {:.1e}", error);
+    std::println();
+}
+
+void bench_sigmoid()
+{
+    std::println("bias + sigmoid, ns/element, and max error per kernel");
+    std::println("{:>9}\t{:>10}\t{:>10}\t{:>10}\t{:>10}\t{}", "type",
+        "std::exp", "scalar", "avx2", "avx512", "max error");
+    bench_sigmoid_of<double>("double");
+    bench_sigmoid_of<float>("float");
+}
+
+void bench_expr()
+{
+    auto rng = Rng(1);
+    auto draw = [&](double) { return rng.uniform(-1, 1); };
+
+    std::println("{:>22}\t{:>10}\t{:>10}\t{:>8}", "ns per call",
+        "passes", "fused", "speedup");
+    auto print_row = [](std::string_view name, double passes, double fused) {
+        std::println("{:>22}\t{:10.1f}\t{:10.1f}\t{:7.2f}x", name,
+            passes * 1e9, fused * 1e9, passes / fused);
+    };
+
+    for (auto [rows, cols] : { std::array<size_t, 2> { 42, 42 },
+             std::array<size_t, 2> { 1024, 1024 } }) {
+        auto w = Mx2(rows, cols);
+        w.apply(draw);
+        auto x = Mx1(cols);
+        x.apply(draw);
+        auto b = Mx1(rows);
+        b.apply(draw);
+        auto out = Mx1(rows);
+
+        auto passes = time_per_call([&] {
+            auto layer = w.dot(x);
+            layer += b;
+            layer.apply([](double v) { return sigmoid(v); });
+            out = layer;
+            keep(out);
+        });
+        auto fused = time_per_call([&] {
+            out = sigmoid(product(w, x) + b);
+            keep(out);
+        });
+        print_row(std::format("sigmoid(w.x+b) {}", rows), passes, fused);
+
+        auto gradient = Mx2(rows, cols);
+        gradient.apply(draw);
+        passes = time_per_call([&] {
+            auto scaled = gradient;
+            scaled *= 1e-9;
+            w -= scaled;
+            keep(w);
+        });
+        fused = time_per_call([&] {
+            w -= 1e-9 * gradient;
+            keep(w);
+        });
+        print_row(std::format("w -= r*g {}", rows), passes, fused);
+    }
+
+    // the net run_nn_models_against_each_other mutates
+    auto model = Model({ Board::width * Board::height, 42, 18, 7 }, rng);
+    auto secs = time_per_call([&] {
+        model.mutate();
+        keep(model);
+    });
+    std::println("Model::mutate: {:.1f} us", secs * 1e6);
+}
+
+void bench_batch()
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    auto rng = Rng(1);
+    auto model = Model({ inputs_size, 42, 18, 7 }, rng);
+    auto scratch = Model::Scratch();
+
+    std::println("{:>6}\t{:>14}\t{:>14}\t{:>8}", "batch", "feed ns/pos",
+        "batch ns/pos", "speedup");
+    for (size_t batch : { 1, 7, 16, 64, 256 }) {
+        auto inputs = std::vector<double>(batch * inputs_size);
+        for (size_t b = 0; b < batch; ++b)
+            random_board(rng).write_inputs(
+                std::span(inputs).subspan(b * inputs_size, inputs_size));
+
+        auto single_secs = time_per_call([&] {
+            for (size_t b = 0; b < batch; ++b) {
+                auto outputs = model.feed(
+                    std::span(inputs).subspan(b * inputs_size, inputs_size),
+                    scratch);
+                keep(outputs[0]);
+            }
+        });
+        auto batch_secs = time_per_call([&] {
+            auto outputs = model.feed_batch(inputs, batch, scratch);
+            keep(outputs[0]);
+        });
+
+        auto per_pos = [&](double secs) {
+            return secs / static_cast<double>(batch) * 1e9;
+        };
+        std::println("{:>6}\t{:14.1f}\t{:14.1f}\t{:7.2f}x", batch,
+            per_pos(single_secs), per_pos(batch_secs),
+            single_secs / batch_secs);
+    }
+}
+
+template <typename T>
+struct PrecisionResult {
+    double feed_secs;
+    double batch_secs;
+    double train_secs;
+    std::vector<T> outputs;
+    double mse;
+};
+
+template <typename T>
+auto bench_model(const BasicModel<T>& trained_from,
+    std::span<const double> positions, size_t count,
+    std::span<const typename BasicModel<T>::DataEntry> data)
+    -> PrecisionResult<T>
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    auto model = trained_from;
+    auto scratch = typename BasicModel<T>::Scratch();
+    auto inputs = std::vector<T>(positions.begin(), positions.end());
+
+    auto result = PrecisionResult<T> {};
+    result.feed_secs = time_per_call([&] {
+        for (size_t b = 0; b < count; ++b) {
+            auto outputs = model.feed(
+                std::span(inputs).subspan(b * inputs_size, inputs_size),
+                scratch);
+            keep(outputs[0]);
+        }
+    });
+    result.batch_secs = time_per_call([&] {
+        auto outputs = model.feed_batch(inputs, count, scratch);
+        keep(outputs[0]);
+    });
+    auto outputs = model.feed_batch(inputs, count, scratch);
+    result.outputs.assign(outputs.begin(), outputs.end());
+
+    auto start = Clock::now();
+    model.train_sgd(
+        data, {}, { .epochs = 1, .batch_size = 32, .learn_rate = 1.0 });
+    result.train_secs
+        = std::chrono::duration<double>(Clock::now() - start).count();
+    result.mse = model.mean_squared_error(data);
+    return result;
+}
+
+void bench_precision()
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    constexpr size_t positions_count = 256;
+    constexpr size_t samples = 4096;
+    auto rng = Rng(1);
+    auto model = Model({ inputs_size, 42, 18, 7 }, rng);
+    auto teacher = Model({ inputs_size, 42, 18, 7 }, rng);
+
+    auto positions = std::vector<double>(positions_count * inputs_size);
+    for (size_t b = 0; b < positions_count; ++b)
+        random_board(rng).write_inputs(
+            std::span(positions).subspan(b * inputs_size, inputs_size));
+
+    // learning another random net is enough to time and compare training
+    auto data = Model::Data();
+    auto data_f = Modelf::Data();
+    for (size_t i = 0; i < samples; ++i) {
+        auto input = Mx1(inputs_size);
+        random_board(rng).write_inputs(input.span());
+        auto correct = teacher.feed(input);
+        data_f.push_back({ Mx1f(input), Mx1f(correct) });
+        data.push_back({ std::move(input), std::move(correct) });
+    }
+
+    auto result = bench_model<double>(model, positions, positions_count, data);
+    auto result_f
+        = bench_model<float>(Modelf(model), positions, positions_count, data_f);
+
+    std::println("{:>9}\t{:>12}\t{:>13}\t{:>15}\t{:>9}", "precision",
+        "feed ns/pos", "batch ns/pos", "train us/sample", "train mse");
+    auto print_row = [&](std::string_view name, const auto& r) {
+        auto count = static_cast<double>(positions_count);
+        std::println("{:>9}\t{:12.1f}\t{:13.1f}\t{:15.2f}\t{:9.5f}", name,
+            r.feed_secs / count * 1e9, r.batch_secs / count * 1e9,
+            r.train_secs / static_cast<double>(samples) * 1e6, r.mse);
+    };
+    print_row("double", result);
+    print_row("float", result_f);
+
+    double max_error = 0;
+    for (size_t i = 0; i < result.outputs.size(); ++i)
+        max_error = std::max(max_error,
+            std::abs(result.outputs[i] - result_f.outputs[i]));
+    std::println("max |float - double| of the outputs: {:.2e}", max_error);
+}
+
+void bench_quantized()
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    constexpr size_t positions_count = 4096;
+
+    std::println("{:>5}\t{:>9}\t{:>13}\t{:>9}", "seed", "agreement",
+        "max out error", "int8 ns");
+    for (uint64_t seed = 0; seed < 4; ++seed) {
+        auto rng = Rng(seed);
+        auto model = Model({ inputs_size, 42, 18, 7 }, rng);
+        auto quantized = quantize_model(model, rng);
+
+        auto positions = std::vector<Board>();
+        for (size_t i = 0; i < positions_count; ++i)
+            positions.push_back(random_board(rng));
+        auto report = compare_quantized(model, quantized, positions);
+
+        auto inputs = FixedMx1<inputs_size>();
+        positions.front().write_inputs(inputs.span());
+        auto scratch = QuantizedModel::Scratch();
+        auto secs = time_per_call([&] {
+            auto outputs = quantized.feed(inputs.span(), scratch);
+            keep(outputs[0]);
+        });
+        std::println("{:>5}\t{:8.2f}%\t{:13.4f}\t{:9.1f}", seed,
+            static_cast<double>(report.agreeing)
+                / static_cast<double>(report.positions) * 100,
+            report.max_error, secs * 1e9);
+    }
+
+    auto rng = Rng(0);
+    auto model = Model({ inputs_size, 42, 18, 7 }, rng);
+    auto quantized = quantize_model(model, rng);
+    auto inputs = FixedMx1<inputs_size>();
+    random_board(rng).write_inputs(inputs.span());
+    auto scratch = Model::Scratch();
+    auto double_secs = time_per_call([&] {
+        auto outputs = model.feed(inputs.span(), scratch);
+        keep(outputs[0]);
+    });
+    std::println("double feed for comparison: {:.1f} ns", double_secs * 1e9);
+
+    std::println("\nint8 gemv 42x64, ns");
+    auto weights = std::vector<int8_t>(42 * 64, 1);
+    auto activations = std::vector<uint8_t>(64, 1);
+    auto sums = std::vector<int32_t>(42);
+    for (auto isa : { Isa::Scalar, Isa::Avx2, Isa::Avx512 }) {
+        const auto* kernels = quantized_kernels_for(isa);
+        if (!kernels)
+            continue;
+        auto secs = time_per_call([&] {
+            kernels->gemv(
+                weights.data(), activations.data(), sums.data(), 42, 64);
+            keep(sums[0]);
+        });
+        std::println("{:>8}\t{:.1f}", isa_name(isa), secs * 1e9);
+    }
+}
+
+/// The noise Model::mutate drew per parameter before NoiseGenerator.
+auto reference_mutation(Rng& rng) -> double
+{
+    double r = rng.uniform(0.0, 1.0);
+    if (r > 0.5) {
+        double v = std::pow(r * 2.0, 2.0) / 4.0;
+        return v > 0.5 ? v : 0.0;
+    } else {
+        double v = std::pow((1.0 - r) * 2.0, 2.0) / 4.0;
+        return v > 0.5 ? -v : 0.0;
+    }
+}
+
+void bench_mutation()
+{
+    constexpr size_t size = 4096;
+    auto rng = Rng(0);
+    auto values = std::vector<float>(size);
+
+    std::println("noise, ns/value");
+    auto secs = time_per_call([&] {
+        for (auto& value : values)
+            value = static_cast<float>(reference_mutation(rng));
+        keep(values);
+    });
+    std::println("{:>16}\t{:.2f}", "old rule", secs / size * 1e9);
+    auto normal = std::normal_distribution<float>();
+    secs = time_per_call([&] {
+        for (auto& value : values)
+            value = normal(rng);
+        keep(values);
+    });
+    std::println("{:>16}\t{:.2f}", "std::normal", secs / size * 1e9);
+
+    for (auto noise : { Noise::Gaussian, Noise::Laplace }) {
+        auto name = noise == Noise::Gaussian ? "gaussian" : "laplace";
+        auto expected = std::vector<float>();
+        for (auto isa : { Isa::Scalar, Isa::Avx2, Isa::Avx512 }) {
+            const auto* kernels = noise_kernels_for(isa);
+            if (!kernels)
+                continue;
+            auto state = NoiseState {};
+            for (auto& word : state.words)
+                word.fill(1);
+            kernels->fill(state, noise, values.data(), size);
+            if (expected.empty())
+                expected = values;
+            auto same = values == expected;
+            secs = time_per_call([&] {
+                kernels->fill(state, noise, values.data(), size);
+                keep(values);
+            });
+            std::println("{:>16}\t{:.2f}\t{}",
+                std::format("{} {}", name, isa_name(isa)), secs / size * 1e9,
+                same ? "" : "differs from scalar");
+        }
+    }
+
+    std::println("\nModel::mutate, us");
+    auto model = Model({ Board::width * Board::height, 42, 18, 7 }, rng);
+    auto parameters = std::vector<double>(model.parameter_count());
+    secs = time_per_call([&] {
+        for (auto& parameter : parameters)
+            parameter += 0.5 * reference_mutation(rng);
+        keep(parameters);
+    });
+    std::println("{:>16}\t{:.1f}", "old rule", secs * 1e6);
+    secs = time_per_call([&] {
+        model.mutate();
+        keep(model);
+    });
+    std::println("{:>16}\t{:.1f}", "default", secs * 1e6);
+    for (auto rate : { 1.0, 0.05 }) {
+        auto noise = NoiseGenerator(rng);
+        secs = time_per_call([&] {
+            model.mutate({ .rate = rate }, noise);
+            keep(model);
+        });
+        std::println("{:>16}\t{:.1f}", std::format("rate {}", rate),
+            secs * 1e6);
+    }
+}
+
+void bench_encode()
+{
+    constexpr size_t count = 64;
+    auto rng = Rng(0);
+    auto boards = std::vector<Board>();
+    for (size_t i = 0; i < count; ++i)
+        boards.push_back(random_board(rng));
+    auto doubles = std::vector<double>(encoded_size(Encoding::Legacy));
+    auto floats = std::vector<float>(count * encoded_size(Encoding::Planes));
+
+    std::println("ns/board");
+    auto print_row = [&](std::string_view name, auto func) {
+        auto secs = time_per_call([&] {
+            for (const auto& board : boards)
+                func(board);
+        });
+        std::println("{:>24}\t{:.1f}", name, secs / count * 1e9);
+    };
+    print_row("as_mx1", [&](const Board& board) {
+        auto inputs = board.as_mx1();
+        keep(inputs);
+    });
+    print_row("write_inputs", [&](const Board& board) {
+        board.write_inputs(doubles);
+        keep(doubles);
+    });
+    for (auto encoding : { Encoding::Legacy, Encoding::Planes }) {
+        auto name = encoding == Encoding::Legacy ? "legacy" : "planes";
+        for (bool mirrored : { false, true }) {
+            print_row(std::format("float {}{}", name,
+                          mirrored ? " mirrored" : ""),
+                [&](const Board& board) {
+                    board.encode(std::span(floats), encoding, Color::Red,
+                        mirrored);
+                    keep(floats);
+                });
+        }
+    }
+    auto secs = time_per_call([&] {
+        encode_batch<float>(
+            boards, floats, Encoding::Planes, Color::Red);
+        keep(floats);
+    });
+    std::println("{:>24}\t{:.1f}", "batch of 64 planes",
+        secs / count * 1e9);
+}
+
+/// Evaluates every move of `positions` like the leaves of a search, once
+/// feeding the whole net and once updating an accumulator.
+template <typename T>
+void bench_accumulator_of(std::string_view name)
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    auto rng = Rng(0);
+    auto model = BasicModel<T>({ inputs_size, 42, 18, 7 }, rng);
+    auto positions = std::vector<Board>();
+    while (positions.size() < 64) {
+        auto board = random_board(rng);
+        if (board.game_state() == GameState::Ongoing)
+            positions.push_back(board);
+    }
+
+    size_t leaves = 0;
+    auto scratch = typename BasicModel<T>::Scratch();
+    auto inputs = std::vector<T>(inputs_size);
+    auto full_secs = time_per_call([&] {
+        leaves = 0;
+        for (const auto& board : positions) {
+            auto moves = board.possible_moves();
+            for (Col col = 0; col < Board::width; ++col) {
+                if (!moves.at(col))
+                    continue;
+                auto child = board;
+                child.insert(col, Tile::Red);
+                child.encode(std::span(inputs), Encoding::Legacy, Color::Red);
+                keep(model.feed(inputs, scratch)[0]);
+                leaves += 1;
+            }
+        }
+    });
+
+    double max_error = 0;
+    auto accumulator = BasicAccumulator<T>(model);
+    auto incremental_secs = time_per_call([&] {
+        for (const auto& board : positions) {
+            // a search would have reached `board` by moves too
+            accumulator.reset(board);
+            auto moves = board.possible_moves();
+            for (Col col = 0; col < Board::width; ++col) {
+                if (!moves.at(col))
+                    continue;
+                auto child = board;
+                auto pos = child.insert(col, Tile::Red);
+                accumulator.insert(pos, Color::Red);
+                keep(accumulator.feed(scratch)[0]);
+                accumulator.undo(pos, Color::Red);
+            }
+        }
+    });
+
+    for (const auto& board : positions) {
+        accumulator.reset(board);
+        auto child = board;
+        Col col = 0;
+        while (!board.possible_moves().at(col))
+            ++col;
+        accumulator.insert(child.insert(col, Tile::Blue), Color::Blue);
+        auto incremental = accumulator.feed(scratch);
+        auto outputs = std::vector<T>(incremental.begin(), incremental.end());
+        child.encode(std::span(inputs), Encoding::Legacy, Color::Red);
+        auto expected = model.feed(inputs, scratch);
+        for (size_t i = 0; i < outputs.size(); ++i)
+            max_error = std::max(max_error,
+                static_cast<double>(std::abs(outputs[i] - expected[i])));
+    }
+
+    auto per_leaf = [&](double secs) {
+        return secs / static_cast<double>(leaves) * 1e9;
+    };
+    std::println("{:>6}\t{:10.1f}\t{:11.1f}\t{:.1e}", name,
+        per_leaf(full_secs), per_leaf(incremental_secs), max_error);
+}
+
+void bench_accumulator()
+{
+    std::println("ns/leaf, 42-42-18-7, each move of 64 positions");
+    std::println("{:>6}\t{:>10}\t{:>11}\t{}", "type", "full feed",
+        "accumulator", "max error");
+    bench_accumulator_of<double>("double");
+    bench_accumulator_of<float>("float");
+}
+
+/// Plays `games` of the hill climber of run_nn_models_against_each_other,
+/// with `select` picking the moves, and returns the seconds per game.
+auto hill_climb(size_t games, auto select) -> double
+{
+    auto rng = Rng(0);
+    auto model = Model({ Board::width * Board::height, 42, 18, 7 }, rng);
+    auto clone = model;
+    clone.mutate();
+
+    auto start = Clock::now();
+    for (size_t game = 0; game < games; ++game) {
+        auto board = Board();
+        auto turn = Color::Red;
+        while (board.game_state() == GameState::Ongoing) {
+            const auto& player = turn == Color::Red ? model : clone;
+            board.insert(select(board, player), color_to_tile(turn));
+            turn = color_opposite(turn);
+        }
+        switch (board.game_state()) {
+            case GameState::RedWon:
+                clone = model;
+                break;
+            case GameState::BlueWon:
+                model = clone;
+                break;
+            case GameState::Draw:
+            case GameState::Ongoing:
+                break;
+        }
+        clone.mutate();
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    return elapsed.count() / static_cast<double>(games);
+}
+
+void bench_cache()
+{
+    constexpr size_t games = 20000;
+    auto scratch = Model::Scratch();
+
+    std::println("hill climbing, us/game");
+    auto secs = hill_climb(games, [&](const Board& board, const Model& model) {
+        return model_select_col(board, model, scratch);
+    });
+    std::println("{:>8}\t{:.1f}", "uncached", secs * 1e6);
+
+    auto cache = EvalCache();
+    secs = hill_climb(games, [&](const Board& board, const Model& model) {
+        return model_select_col(board, model, cache, scratch);
+    });
+    std::println("{:>8}\t{:.1f}\t{:.1f}% hits", "cached", secs * 1e6,
+        cache.stats().hit_rate() * 100);
+
+    auto rng = Rng(1);
+    auto model = Model({ Board::width * Board::height, 42, 18, 7 }, rng);
+    auto board = random_board(rng);
+    std::println("\nmove selection, ns");
+    secs = time_per_call([&] {
+        keep(model_select_col(board, model, scratch));
+    });
+    std::println("{:>8}\t{:.1f}", "feed", secs * 1e9);
+    secs = time_per_call([&] {
+        keep(model_select_col(board, model, cache, scratch));
+    });
+    std::println("{:>8}\t{:.1f}", "hit", secs * 1e9);
+}
+
+template <typename T>
+void bench_static_of(std::string_view name)
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    auto rng = Rng(0);
+    auto model = BasicModel<T>({ inputs_size, 42, 18, 7 }, rng);
+    auto fixed = BasicStaticModel<T, inputs_size, 42, 18, 7>(model);
+    auto inputs = std::array<T, inputs_size>();
+    random_board(rng).encode(
+        std::span<T>(inputs), Encoding::Legacy, Color::Red);
+
+    auto scratch = typename BasicModel<T>::Scratch();
+    auto dynamic_secs = time_per_call([&] {
+        keep(model.feed(inputs, scratch)[0]);
+    });
+    auto static_secs = time_per_call([&] {
+        keep(fixed.feed(inputs)[0]);
+    });
+
+    double max_error = 0;
+    auto expected = model.feed(inputs, scratch);
+    auto outputs = fixed.feed(inputs);
+    for (size_t i = 0; i < outputs.size(); ++i)
+        max_error = std::max(max_error,
+            static_cast<double>(std::abs(outputs[i] - expected[i])));
+
+    auto parameters = std::vector<T>(model.parameter_count());
+    auto round_trip = parameters;
+    model.write_parameters(parameters);
+    fixed.to_model().write_parameters(round_trip);
+
+    std::println("{:>6}\t{:>7.1f}\t{:>6.1f}\t{:.1e}\t{}", name,
+        dynamic_secs * 1e9, static_secs * 1e9, max_error,
+        parameters == round_trip ? "exact" : "differs");
+}
+
+void bench_static()
+{
+    std::println("feed 42-42-18-7, ns, Model against StaticModel");
+    std::println("{:>6}\t{:>7}\t{:>6}\t{}\t{}", "type", "Model",
+        "static", "max error", "round trip");
+    bench_static_of<double>("double");
+    bench_static_of<float>("float");
+}
+
+template <typename T>
+void bench_file_of(std::string_view name)
+{
+    constexpr size_t inputs_size = Board::width * Board::height;
+    auto rng = Rng(0);
+    auto model = BasicModel<T>({ inputs_size, 42, 18, 7 }, rng);
+    auto path = std::filesystem::temp_directory_path()
+        / std::format("connect-four-bench-{}.c4nn", name);
+
+    auto save_secs = time_per_call([&] { keep(save_model(model, path)); });
+    auto load_secs = time_per_call([&] { keep(load_model<T>(path)); });
+    auto map_secs = time_per_call([&] {
+        auto mapped = BasicMappedModel<T>(path);
+        keep(mapped.ok());
+    });
+
+    auto mapped = BasicMappedModel<T>(path);
+    auto inputs = std::array<T, inputs_size>();
+    random_board(rng).encode(
+        std::span<T>(inputs), Encoding::Legacy, Color::Red);
+    auto scratch = typename BasicModel<T>::Scratch();
+    auto mapped_scratch = typename BasicMappedModel<T>::Scratch();
+    auto model_secs = time_per_call([&] {
+        keep(model.feed(inputs, scratch)[0]);
+    });
+    auto mapped_secs = time_per_call([&] {
+        keep(mapped.feed(inputs, mapped_scratch)[0]);
+    });
+
+    auto expected = model.feed(inputs, scratch);
+    auto outputs = mapped.feed(inputs, mapped_scratch);
+    auto parameters = std::vector<T>(model.parameter_count());
+    auto round_trip = parameters;
+    model.write_parameters(parameters);
+    load_model<T>(path)->write_parameters(round_trip);
+    bool exact = parameters == round_trip
+        && std::equal(outputs.begin(), outputs.end(), expected.begin());
+
+    // a flipped bit in the last bias must be caught
+    auto size = std::filesystem::file_size(path);
+    {
+        auto file = std::fstream(path, std::ios::in | std::ios::out);
+        file.seekp(static_cast<std::streamoff>(size - 64));
+        file.put('\x01');
+    }
+    bool caught = !BasicMappedModel<T>(path).ok();
+    std::filesystem::remove(path);
+
+    std::println("{:>6}\t{:>5}\t{:>6.1f}\t{:>6.1f}\t{:>6.1f}\t{:>7.1f}"
+                 "\t{:>6.1f}\t{}\t{}",
+        name, size, save_secs * 1e6, load_secs * 1e6, map_secs * 1e6,
+        model_secs * 1e9, mapped_secs * 1e9, exact ? "exact" : "differs",
+        caught ? "caught" : "missed");
+}
+
+void bench_file()
+{
+    std::println("42-42-18-7 model file: save, load and map in us, feed in ns");
+    std::println("{:>6}\t{:>5}\t{:>6}\t{:>6}\t{:>6}\t{:>7}\t{:>6}\t{}\t{}",
+        "type", "bytes", "save", "load", "map", "Model", "mapped",
+        "round trip", "corruption");
+    bench_file_of<double>("double");
+    bench_file_of<float>("float");
+}
+
+/// multiply-adds of the dense layers of `model` for one input
+auto dense_macs(const Model& model) -> size_t
+{
+    size_t macs = 0;
+    const auto& layers = model.layers();
+    for (size_t i = 0; i + 1 < layers.size(); ++i)
+        macs += layers[i] * layers[i + 1];
+    return macs;
+}
+
+void bench_conv_row(std::string_view name, size_t parameters, size_t macs,
+    auto feed, auto backprop)
+{
+    std::println("{:>16}\t{:>6}\t{:>6}\t{:>6.1f}\t{:>7.1f}", name,
+        parameters, macs, time_per_call(feed) * 1e9,
+        time_per_call(backprop) * 1e9);
+}
+
+void bench_conv()
+{
+    auto rng = Rng(0);
+    auto board = random_board(rng);
+    auto values = std::array<double, encoded_size(Encoding::Planes)>();
+    auto planes = std::span<double>(values);
+    auto legacy = planes.first(encoded_size(Encoding::Legacy));
+    auto correct = std::array<double, 7>();
+    correct[3] = 1;
+
+    std::println("feed and backprop of one board, ns");
+    std::println("{:>16}\t{:>6}\t{:>6}\t{:>6}\t{:>7}", "net", "params",
+        "macs", "feed", "backprop");
+
+    board.encode(legacy, Encoding::Legacy, Color::Red);
+    auto model = Model({ 42, 42, 18, 7 }, rng);
+    auto scratch = Model::Scratch();
+    auto workspace = Model::Workspace();
+    workspace.fit(model);
+    bench_conv_row(
+        "dense 42-42-18-7", model.parameter_count(), dense_macs(model),
+        [&] { keep(model.feed(legacy, scratch)[0]); },
+        [&] { model.backprop(legacy, correct, workspace); });
+
+    board.encode(planes, Encoding::Planes, Color::Red);
+    for (size_t channels : { 8, 16 }) {
+        auto conv = ConvModel(channels, { 18, 7 }, rng);
+        auto conv_scratch = ConvModel::Scratch();
+        auto conv_workspace = ConvModel::Workspace();
+        conv_workspace.fit(conv);
+        auto macs = ConvLayer::positions * ConvLayer::taps * channels
+            + dense_macs(conv.dense());
+        bench_conv_row(std::format("conv {}-18-7", channels),
+            conv.parameter_count(), macs,
+            [&] { keep(conv.feed(planes, conv_scratch)[0]); },
+            [&] { conv.backprop(planes, correct, conv_workspace); });
+    }
+}
+
+struct Bench {
+    std::string_view name;
+    void (*run)();
+};
+
+constexpr auto benches = std::array {
+    Bench { "kernels", bench_kernels },
+    Bench { "sigmoid", bench_sigmoid },
+    Bench { "expr", bench_expr },
+    Bench { "batch", bench_batch },
+    Bench { "precision", bench_precision },
+    Bench { "quantized", bench_quantized },
+    Bench { "mutation", bench_mutation },
+    Bench { "encode", bench_encode },
+    Bench { "accumulator", bench_accumulator },
+    Bench { "cache", bench_cache },
+    Bench { "static", bench_static },
+    Bench { "file", bench_file },
+    Bench { "conv", bench_conv },
+};
+
+}
+
+auto connect_four::run_bench(std::string_view name) -> bool
+{
+    bool found = false;
+    for (const auto& bench : benches) {
+        if (!name.empty() && name != bench.name)
+            continue;
+        std::println("== {} ==", bench.name);
+        bench.run();
+        std::println();
+        found = true;
+    }
+    return found;
+}
@@ -0,0 +1,15 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <string_view>
+
+namespace connect_four {
+
+/// Runs the named microbenchmark, or all of them if `name` is empty.
+/// Returns false for unknown names. Build with RELEASE=1 for numbers
+/// that mean anything.
+auto run_bench(std::string_view name) -> bool;
+
+}
+
+#endif
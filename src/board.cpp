@@ -1,5 +1,9 @@
 #include "board.hpp"
+#include "rng.hpp"
 #include "tile.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <utility>
 #include <vector>
 
@@ -38,64 +42,61 @@ auto Board::is_draw() const -> bool
     return true;
 }
 
-constexpr auto make_patterns()
-    -> std::array<std::tuple<Pos, std::array<Pos, 4>>, 4>
-{
-    return std::array {
-        std::tuple {
-            Pos { 1, 4 },
-            std::array {
-                Pos { 0, 0 }, Pos { 0, 1 }, Pos { 0, 2 }, Pos { 0, 3 } },
-        },
-        std::tuple {
-            Pos { 4, 1 },
-            std::array {
-                Pos { 0, 0 }, Pos { 1, 0 }, Pos { 2, 0 }, Pos { 3, 0 } },
-        },
-        std::tuple {
-            Pos { 4, 4 },
-            std::array {
-                Pos { 0, 0 }, Pos { 1, 1 }, Pos { 2, 2 }, Pos { 3, 3 } },
-        },
-        std::tuple {
-            Pos { 4, 4 },
-            std::array {
-                Pos { 0, 3 }, Pos { 1, 2 }, Pos { 2, 1 }, Pos { 3, 0 } },
-        },
-    };
-}
-
-auto Board::game_state() const -> GameState
-{
-    constexpr auto patterns = make_patterns();
+namespace {
 
-    for (auto& [size, tiles] : patterns) {
-        for (size_t x = 0; x < width - size.col + 1; ++x) {
-            for (size_t y = 0; y < height - size.row + 1; ++y) {
-                bool has_won = true;
-                auto first_tile = tile(Pos { x, y } + tiles[0]);
+/// A direction four in a row can lie in, as the difference of the offsets
+/// of neighbouring tiles, and the tiles one can start at.
+struct Direction {
+    size_t step;
+    uint64_t starts;
+};
 
-                if (first_tile == Tile::Empty) {
-                    continue;
-                }
-
-                for (auto [tx, ty] : tiles) {
-                    auto current_tile = tile(Pos { x + tx, y + ty });
+constexpr auto make_direction(int64_t col_step, int64_t row_step) -> Direction
+{
+    constexpr auto width = static_cast<int64_t>(Board::width);
+    constexpr auto height = static_cast<int64_t>(Board::height);
+    uint64_t starts = 0;
+    for (int64_t col = 0; col < width; ++col) {
+        for (int64_t row = 0; row < height; ++row) {
+            auto end_col = col + 3 * col_step;
+            auto end_row = row + 3 * row_step;
+            if (end_col < width && end_row >= 0 && end_row < height)
+                starts |= uint64_t { 1 } << (col * height + row);
+        }
+    }
+    return {
+        .step = static_cast<size_t>(col_step * height + row_step),
+        .starts = starts,
+    };
+}
 
-                    if (first_tile != current_tile) {
-                        has_won = false;
-                        break;
-                    }
-                }
+constexpr auto directions = std::array {
+    make_direction(0, 1),
+    make_direction(1, 0),
+    make_direction(1, 1),
+    make_direction(1, -1),
+};
 
-                if (has_won) {
-                    return first_tile == Tile::Red ? GameState::RedWon
-                                                   : GameState::BlueWon;
-                }
-            }
-        }
+/// whether `tiles`, as `Board::tiles` gives them, has four in a row
+auto has_four(uint64_t tiles) -> bool
+{
+    for (auto [step, starts] : directions) {
+        auto fours = tiles & tiles >> step & tiles >> 2 * step
+            & tiles >> 3 * step;
+        if ((fours & starts) != 0)
+            return true;
     }
+    return false;
+}
 
+}
+
+auto Board::game_state() const -> GameState
+{
+    if (has_four(tiles(Color::Red)))
+        return GameState::RedWon;
+    if (has_four(tiles(Color::Blue)))
+        return GameState::BlueWon;
     return this->is_draw() ? GameState::Draw : GameState::Ongoing;
 }
 
@@ -111,15 +112,29 @@ void Board::print(Printer& printer) const
     printer.print_board(board, width, height);
 }
 
+namespace {
+
+/// the red tiles of `col` as 6 bits, then its height as 3
+auto col_hash(uint64_t red, uint64_t occupied, Col col) -> size_t
+{
+    constexpr uint64_t col_mask = (1 << Board::height) - 1;
+    auto shift = col * Board::height;
+    auto height = std::popcount(occupied >> shift & col_mask);
+    return (red >> shift & col_mask)
+        | static_cast<size_t>(height) << Board::height;
+}
+
+}
+
 auto Board::hash() const -> Hash
 {
     static_assert(sizeof(size_t) == sizeof(uint64_t));
 
+    auto red = tiles(Color::Red);
+    auto occupied = red | tiles(Color::Blue);
     size_t res = 0;
-    for (size_t col = 0; col < width; ++col) {
-        auto col_res = col_hash(col);
-        res |= col_res << 9 * col;
-    }
+    for (size_t col = 0; col < width; ++col)
+        res |= col_hash(red, occupied, col) << 9 * col;
     return res;
 }
 
@@ -127,33 +142,17 @@ auto Board::flipped_hash() const -> size_t
 {
     static_assert(sizeof(size_t) == sizeof(uint64_t));
 
+    auto red = tiles(Color::Red);
+    auto occupied = red | tiles(Color::Blue);
     size_t res = 0;
-    for (size_t col = 0; col < width; ++col) {
-        auto col_res = col_hash(col);
-        res |= col_res << 9 * (width - col - 1);
-    }
+    for (size_t col = 0; col < width; ++col)
+        res |= col_hash(red, occupied, col) << 9 * (width - col - 1);
     return res;
 }
 
-auto Board::col_hash(Col col) const -> size_t
+auto Board::canonical_hash() const -> Hash
 {
-    size_t col_height = 6;
-    size_t hash = 0;
-
-    for (size_t row = 0; row < height; ++row) {
-        switch (tile({ col, row })) {
-            case Tile::Empty:
-                col_height -= 1;
-                break;
-            case Tile::Red:
-                hash |= 1 << row;
-                break;
-            case Tile::Blue:
-                break;
-        }
-    }
-    hash |= col_height << 6;
-    return hash;
+    return std::min(hash(), flipped_hash());
 }
 
 auto Board::win_possibilities_at_pos(
@@ -201,15 +200,174 @@ auto Board::win_possibilities_at_pos(
 
 auto Board::as_mx1() const -> Mx1
 {
-    auto v = [](Tile tile) {
-        return tile == Tile::Empty ? 0.5 : tile == Tile::Blue ? 0.0 : 1.0;
+    auto m = Mx1(width * height);
+    write_inputs(m.span());
+    return m;
+}
+
+void Board::write_inputs(std::span<double> out) const
+{
+    encode(out, Encoding::Legacy, Color::Red);
+}
+
+namespace {
+
+/// every other bit of `bits`, starting with the lowest, packed together
+auto even_bits(uint64_t bits) -> uint64_t
+{
+    bits &= 0x5555555555555555;
+    bits = (bits | bits >> 1) & 0x3333333333333333;
+    bits = (bits | bits >> 2) & 0x0f0f0f0f0f0f0f0f;
+    bits = (bits | bits >> 4) & 0x00ff00ff00ff00ff;
+    bits = (bits | bits >> 8) & 0x0000ffff0000ffff;
+    bits = (bits | bits >> 16) & 0x00000000ffffffff;
+    return bits;
+}
+
+/// the reverse of `even_bits`, for the lower 32 bits of `bits`
+auto spread_bits(uint64_t bits) -> uint64_t
+{
+    bits &= 0x00000000ffffffff;
+    bits = (bits | bits << 16) & 0x0000ffff0000ffff;
+    bits = (bits | bits << 8) & 0x00ff00ff00ff00ff;
+    bits = (bits | bits << 4) & 0x0f0f0f0f0f0f0f0f;
+    bits = (bits | bits << 2) & 0x3333333333333333;
+    bits = (bits | bits << 1) & 0x5555555555555555;
+    return bits;
+}
+
+/// the lower bit of every tile set in `tiles`, as `Board` stores them
+auto spread_tiles(uint64_t tiles) -> uint128_t
+{
+    auto low = static_cast<uint128_t>(spread_bits(tiles));
+    auto high = static_cast<uint128_t>(spread_bits(tiles >> 32));
+    return low | high << 64;
+}
+
+template <typename T>
+constexpr auto make_byte_bits()
+{
+    auto table = std::array<std::array<T, 8>, 256> {};
+    for (size_t byte = 0; byte < 256; ++byte)
+        for (size_t bit = 0; bit < 8; ++bit)
+            table[byte][bit] = static_cast<T>(byte >> bit & 1);
+    return table;
+}
+
+/// the bits of every byte as 8 values, 0 or 1
+template <typename T>
+constexpr auto byte_bits = make_byte_bits<T>();
+
+/// writes the `width * height` lowest bits of `tiles` as values, 0 or 1,
+/// a byte at a time
+template <typename T>
+void write_bits(uint64_t tiles, T* out)
+{
+    constexpr size_t size = Board::width * Board::height;
+    constexpr size_t whole = size / 8 * 8;
+    for (size_t i = 0; i < whole; i += 8)
+        std::copy_n(byte_bits<T>[tiles >> i & 0xff].data(), 8, &out[i]);
+    std::copy_n(
+        byte_bits<T>[tiles >> whole & 0xff].data(), size - whole, &out[whole]);
+}
+
+template <typename T>
+constexpr auto make_legacy_pairs()
+{
+    auto value = [](size_t tile) {
+        return tile == std::to_underlying(Tile::Red) ? T(1)
+            : tile == std::to_underlying(Tile::Blue) ? T(0)
+                                                      : T(0.5);
     };
+    auto table = std::array<std::array<T, 2>, 16> {};
+    for (size_t bits = 0; bits < 16; ++bits)
+        table[bits] = { value(bits & tile_mask), value(bits >> tile_size) };
+    return table;
+}
 
-    auto m = Mx1(width * height);
-    for (size_t row = 0; row < width; ++row) {
-        for (size_t col = 0; col < height; ++col) {
-            m[row * height + col] = v(tile({ row, col }));
+/// `Encoding::Legacy` values of 2 tiles, by their bits
+template <typename T>
+constexpr auto legacy_pairs = make_legacy_pairs<T>();
+
+auto mirror_tiles(uint64_t tiles) -> uint64_t
+{
+    constexpr uint64_t col_mask = (1 << Board::height) - 1;
+    uint64_t mirrored = 0;
+    for (size_t col = 0; col < Board::width; ++col)
+        mirrored |= (tiles >> col * Board::height & col_mask)
+            << (Board::width - 1 - col) * Board::height;
+    return mirrored;
+}
+
+}
+
+auto Board::tiles(Color color) const -> uint64_t
+{
+    // red tiles are 0b01 and blue 0b10, so each color has every other bit
+    auto bits = color == Color::Red ? m_val : m_val >> 1;
+    auto low = static_cast<uint64_t>(bits);
+    auto high = static_cast<uint64_t>(bits >> 64);
+    return even_bits(low) | even_bits(high) << 32;
+}
+
+auto Board::from_tiles(uint64_t red, uint64_t blue) -> Board
+{
+    auto board = Board();
+    board.m_val = spread_tiles(red) | spread_tiles(blue) << 1;
+    return board;
+}
+
+template <typename T>
+void Board::encode(
+    std::span<T> out, Encoding encoding, Color own, bool mirrored) const
+{
+    switch (encoding) {
+        case Encoding::Legacy:
+            // straight from the tiles, 2 at a time
+            static_assert(height % 2 == 0);
+            for (size_t col = 0; col < width; ++col) {
+                auto bits = static_cast<uint64_t>(
+                    m_val >> col * height * tile_size);
+                auto dest = mirrored ? width - 1 - col : col;
+                for (size_t row = 0; row < height; row += 2)
+                    std::copy_n(
+                        legacy_pairs<T>[bits >> row * tile_size & 0xf].data(),
+                        2, &out[dest * height + row]);
+            }
+            return;
+        case Encoding::Planes: {
+            auto first = tiles(own);
+            auto second = tiles(color_opposite(own));
+            if (mirrored) {
+                first = mirror_tiles(first);
+                second = mirror_tiles(second);
+            }
+            write_bits(first, out.data());
+            write_bits(second, out.data() + width * height);
+            return;
         }
     }
-    return m;
+}
+
+template void Board::encode<float>(
+    std::span<float> out, Encoding encoding, Color own, bool mirrored) const;
+template void Board::encode<double>(
+    std::span<double> out, Encoding encoding, Color own, bool mirrored) const;
+
+auto connect_four::random_board(Rng& rng) -> Board
+{
+    auto board = Board();
+    auto plies = rng.below(20);
+    auto tile = Tile::Red;
+    for (size_t ply = 0; ply < plies; ++ply) {
+        auto possible_moves = board.possible_moves();
+        auto col = rng.below(Board::width);
+        if (!possible_moves.at(col))
+            continue;
+        board.insert(col, tile);
+        if (board.game_state() != GameState::Ongoing)
+            break;
+        tile = tile == Tile::Red ? Tile::Blue : Tile::Red;
+    }
+    return board;
 }
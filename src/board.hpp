@@ -3,8 +3,11 @@
 
 #include "nn_model.hpp"
 #include "printer.hpp"
+#include "rng.hpp"
 #include "tile.hpp"
 #include <cstddef>
+#include <cstdint>
+#include <span>
 #include <utility>
 
 namespace connect_four {
@@ -97,6 +100,14 @@ enum class Color : uint8_t {
     return color == Color::Red ? GameState::BlueWon : GameState::RedWon;
 }
 
+/// How a board is written as the inputs of a net.
+enum class Encoding {
+    /// one value per tile: 1 red, 0 blue and 0.5 empty
+    Legacy,
+    /// one-hot planes, the tiles of the own color, then the opponent's
+    Planes,
+};
+
 class Board {
 public:
     static constexpr const size_t width = 7;
@@ -111,15 +122,35 @@ public:
     using Hash = size_t;
     auto hash() const -> Hash;
     auto flipped_hash() const -> size_t;
+    /// same for a position and its mirror image
+    auto canonical_hash() const -> Hash;
 
     auto win_possibilities_at_pos(Color color, uint16_t col, uint16_t row) const
         -> size_t;
 
+    /// index of the tile at `pos` in the inputs and in `tiles`
+    static constexpr auto offset(Pos pos) -> size_t
+    {
+        return pos.col * height + pos.row;
+    }
+    /// bit `offset(pos)` is set where `color` has a tile
+    auto tiles(Color color) const -> uint64_t;
+    /// the board with the tiles of each color where `tiles` has them
+    static auto from_tiles(uint64_t red, uint64_t blue) -> Board;
+
     auto as_mx1() const -> Mx1;
+    /// writes the same values as `as_mx1` to `out`, which must hold
+    /// `width * height` values
+    void write_inputs(std::span<double> out) const;
+    /// Writes the board seen by `own` to `out`, which must hold
+    /// `encoded_size(encoding)` values, in the order of `write_inputs`.
+    /// `Legacy` doesn't depend on `own`. `mirrored` swaps the columns left
+    /// to right, which is the same position for the game.
+    template <typename T>
+    void encode(std::span<T> out, Encoding encoding, Color own,
+        bool mirrored = false) const;
 
 private:
-    auto col_hash(Col col) const -> size_t;
-
     inline auto tile(Pos pos) const -> Tile
     {
         return static_cast<Tile>(m_val >> offset(pos) * tile_size & tile_mask);
@@ -131,14 +162,29 @@ private:
             << offset(pos) * tile_size;
     }
 
-    inline auto offset(Pos pos) const -> size_t
-    {
-        return pos.col * height + pos.row;
-    }
-
     uint128_t m_val { 0 };
 };
 
+constexpr auto encoded_size(Encoding encoding) -> size_t
+{
+    return Board::width * Board::height
+        * (encoding == Encoding::Planes ? 2 : 1);
+}
+
+/// Encodes `boards` back to back into `out`, as `Model::feed_batch` takes
+/// its inputs.
+template <typename T>
+void encode_batch(std::span<const Board> boards, std::span<T> out,
+    Encoding encoding, Color own, bool mirrored = false)
+{
+    auto size = encoded_size(encoding);
+    for (size_t i = 0; i < boards.size(); ++i)
+        boards[i].encode(out.subspan(i * size, size), encoding, own, mirrored);
+}
+
+/// plays up to 19 random moves, for sampling positions
+auto random_board(Rng& rng) -> Board;
+
 }
 
 #endif
@@ -0,0 +1,484 @@
+#include "dataset.hpp"
+#include "agent.hpp"
+#include "board.hpp"
+#include "mapped_file.hpp"
+#include "minimax.hpp"
+#include "nn_model.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <span>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto magic = std::array<uint8_t, 4> { 'C', '4', 'D', 'S' };
+constexpr uint32_t format_version = 1;
+constexpr size_t header_size = 64;
+constexpr size_t array_alignment = 64;
+
+/// bytes of a file hashed at a time when verifying it
+constexpr size_t verify_chunk = 1024 * 1024;
+/// positions a thread scores before writing them
+constexpr size_t chunk_size = 256;
+/// games played per position asked for before giving up, for agents
+/// whose games run out of new positions
+constexpr size_t games_per_position = 16;
+
+constexpr auto align_array(size_t size) -> size_t
+{
+    return align(size, array_alignment);
+}
+
+/// where the arrays for `positions` positions start, followed by the size
+/// of the file
+struct Layout {
+    size_t own;
+    size_t opponent;
+    size_t scores;
+    size_t end;
+
+    explicit Layout(size_t positions)
+        : own(header_size)
+        , opponent(own + align_array(positions * sizeof(uint64_t)))
+        , scores(opponent + align_array(positions * sizeof(uint64_t)))
+        , end(scores + align_array(positions * Board::width * sizeof(int16_t)))
+    {
+    }
+};
+
+auto checksum(const uint8_t* data, const Layout& layout, size_t positions)
+    -> uint64_t
+{
+    auto hash = fnv1a(&data[layout.own], positions * sizeof(uint64_t));
+    hash = fnv1a(&data[layout.opponent], positions * sizeof(uint64_t), hash);
+    return fnv1a(&data[layout.scores],
+        positions * Board::width * sizeof(int16_t), hash);
+}
+
+/// Canonical hashes of the positions seen, in an open addressing table
+/// the threads insert into without locking.
+class PositionSet {
+public:
+    /// holds `capacity` positions at most half full
+    explicit PositionSet(size_t capacity)
+        : m_slots(std::bit_ceil(std::max<size_t>(capacity * 2, 2)))
+        , m_shift(64 - static_cast<size_t>(std::countr_zero(m_slots.size())))
+    {
+    }
+
+    /// false if the position was seen before
+    auto insert(Board::Hash hash) -> bool
+    {
+        // hashes take 63 bits, so adding 1 keeps 0 free for empty slots
+        auto key = static_cast<uint64_t>(hash) + 1;
+        auto mask = m_slots.size() - 1;
+        auto slot = (key * 0x9e3779b97f4a7c15) >> m_shift;
+        for (;; slot = (slot + 1) & mask) {
+            uint64_t found = 0;
+            if (m_slots[slot].compare_exchange_strong(
+                    found, key, std::memory_order_relaxed))
+                return true;
+            if (found == key)
+                return false;
+        }
+    }
+
+private:
+    std::vector<std::atomic<uint64_t>> m_slots;
+    size_t m_shift;
+};
+
+struct Worker {
+    /// indexed by color
+    std::array<std::unique_ptr<Agent>, 2> agents;
+    std::vector<uint64_t> own;
+    std::vector<uint64_t> opponent;
+    std::vector<int16_t> scores;
+};
+
+/// The file being generated. Threads reserve a range of positions, then
+/// write their arrays' parts of it.
+class DatasetWriter {
+public:
+    DatasetWriter(const std::filesystem::path& path, size_t capacity)
+        : m_path(path)
+        , m_capacity(capacity)
+        , m_layout(capacity)
+    {
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (m_fd < 0) {
+            std::cerr << std::format(
+                "could not open '{}' for writing\n", path.string());
+            return;
+        }
+        if (::ftruncate(m_fd, static_cast<off_t>(m_layout.end)) != 0) {
+            std::cerr << std::format("could not size '{}'\n", path.string());
+            m_failed = true;
+        }
+    }
+
+    ~DatasetWriter()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    DatasetWriter(const DatasetWriter&) = delete;
+    auto operator=(const DatasetWriter&) -> DatasetWriter& = delete;
+
+    auto ok() const -> bool
+    {
+        return m_fd >= 0 && !m_failed;
+    }
+    auto full() const -> bool
+    {
+        return m_reserved.load(std::memory_order_relaxed) >= m_capacity;
+    }
+    auto positions() const -> size_t
+    {
+        return std::min(m_reserved.load(), m_capacity);
+    }
+
+    /// writes as many of the positions in `worker` as still fit and
+    /// clears them
+    void append(Worker& worker)
+    {
+        auto count = worker.own.size();
+        auto first = m_reserved.load(std::memory_order_relaxed);
+        size_t taken;
+        do {
+            taken = std::min(count, m_capacity - std::min(first, m_capacity));
+        } while (!m_reserved.compare_exchange_weak(
+            first, first + taken, std::memory_order_relaxed));
+
+        if (taken != 0) {
+            write_array(m_layout.own + first * sizeof(uint64_t),
+                std::as_bytes(std::span(worker.own).first(taken)));
+            write_array(m_layout.opponent + first * sizeof(uint64_t),
+                std::as_bytes(std::span(worker.opponent).first(taken)));
+            write_array(
+                m_layout.scores + first * Board::width * sizeof(int16_t),
+                std::as_bytes(
+                    std::span(worker.scores).first(taken * Board::width)));
+        }
+        worker.own.clear();
+        worker.opponent.clear();
+        worker.scores.clear();
+    }
+
+    /// writes the header once every thread is done
+    auto finish(size_t depth) -> bool
+    {
+        if (!ok())
+            return false;
+        auto* mapping = ::mmap(nullptr, m_layout.end, PROT_READ | PROT_WRITE,
+            MAP_SHARED, m_fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << std::format("could not map '{}'\n", m_path.string());
+            return false;
+        }
+        auto* data = static_cast<uint8_t*>(mapping);
+        auto positions = this->positions();
+        std::memcpy(&data[0], magic.data(), magic.size());
+        write_value(&data[4], format_version);
+        write_value(&data[8], static_cast<uint32_t>(depth));
+        write_value(&data[12], static_cast<uint32_t>(Board::width));
+        write_value(&data[16], uint64_t { positions });
+        write_value(&data[24], uint64_t { m_layout.own });
+        write_value(&data[32], uint64_t { m_layout.opponent });
+        write_value(&data[40], uint64_t { m_layout.scores });
+        write_value(&data[48], checksum(data, m_layout, positions));
+        write_value(&data[56], uint64_t { 0 });
+        auto synced = ::msync(mapping, m_layout.end, MS_SYNC) == 0;
+        ::munmap(mapping, m_layout.end);
+        if (!synced || ::close(std::exchange(m_fd, -1)) != 0) {
+            std::cerr << std::format("could not write '{}'\n", m_path.string());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void write_array(size_t offset, std::span<const std::byte> bytes)
+    {
+        while (!bytes.empty()) {
+            auto written = ::pwrite(m_fd, bytes.data(), bytes.size(),
+                static_cast<off_t>(offset));
+            if (written <= 0) {
+                if (!m_failed.exchange(true))
+                    std::cerr << std::format(
+                        "could not write '{}'\n", m_path.string());
+                return;
+            }
+            bytes = bytes.subspan(static_cast<size_t>(written));
+            offset += static_cast<size_t>(written);
+        }
+    }
+
+    std::filesystem::path m_path;
+    size_t m_capacity;
+    Layout m_layout;
+    int m_fd = -1;
+    std::atomic<size_t> m_reserved = 0;
+    std::atomic<bool> m_failed = false;
+};
+
+void score_position(
+    const DatasetOptions& opts, Worker& worker, Board board, Color turn)
+{
+    auto points = Minimax(turn).column_points(board, opts.depth);
+    for (auto point : points) {
+        if (point == Minimax::no_move) {
+            worker.scores.push_back(full_column);
+            continue;
+        }
+        worker.scores.push_back(static_cast<int16_t>(std::clamp<int32_t>(
+            point, full_column + 1, std::numeric_limits<int16_t>::max())));
+    }
+    worker.own.push_back(board.tiles(turn));
+    worker.opponent.push_back(board.tiles(color_opposite(turn)));
+}
+
+/// scores the new positions of a game, returning how many were seen before
+auto play_game(const DatasetOptions& opts, Worker& worker,
+    PositionSet& seen, size_t game) -> size_t
+{
+    auto opening = Opening(opts.seed, game, game, opts.opening_plies);
+    for (auto& agent : worker.agents)
+        agent->new_game();
+
+    size_t duplicates = 0;
+    auto board = Board();
+    auto turn = Color::Red;
+    for (size_t ply = 0;; ++ply) {
+        if (seen.insert(board.canonical_hash()))
+            score_position(opts, worker, board, turn);
+        else
+            duplicates += 1;
+
+        auto col = opening.next_move(board, ply, [&] {
+            return worker.agents[std::to_underlying(turn)]->next_move(board);
+        });
+        board.insert(col, color_to_tile(turn));
+        if (board.game_state() != GameState::Ongoing)
+            return duplicates;
+        turn = color_opposite(turn);
+    }
+}
+
+}
+
+auto connect_four::dataset_side_to_move(uint64_t own, uint64_t opponent)
+    -> Color
+{
+    // red moves first
+    auto tiles = std::popcount(own | opponent);
+    return tiles % 2 == 0 ? Color::Red : Color::Blue;
+}
+
+auto connect_four::dataset_board(uint64_t own, uint64_t opponent) -> Board
+{
+    return dataset_side_to_move(own, opponent) == Color::Red
+        ? Board::from_tiles(own, opponent)
+        : Board::from_tiles(opponent, own);
+}
+
+auto connect_four::generate_dataset(const DatasetOptions& opts) -> bool
+{
+    auto threads = std::max<size_t>(opts.threads, 1);
+    auto workers = std::vector<Worker>(threads);
+    for (auto& worker : workers) {
+        for (auto color : { Color::Red, Color::Blue }) {
+            auto& agent = worker.agents[std::to_underlying(color)];
+            agent = make_agent(opts.agent, color);
+            if (!agent)
+                return false;
+        }
+        worker.own.reserve(chunk_size);
+        worker.opponent.reserve(chunk_size);
+        worker.scores.reserve(chunk_size * Board::width);
+    }
+
+    auto temp = opts.output;
+    temp += ".tmp";
+    auto writer = DatasetWriter(temp, opts.positions);
+    if (!writer.ok())
+        return false;
+    // every thread may score a chunk too many before the writer is full
+    auto seen = PositionSet(opts.positions + threads * chunk_size);
+
+    std::println("scoring {} positions from {} games at depth {} on {} "
+                 "threads",
+        opts.positions, opts.agent.name(), opts.depth, threads);
+
+    auto games = std::atomic<size_t>(0);
+    auto duplicates = std::atomic<size_t>(0);
+    auto start = Clock::now();
+    auto last_report = start;
+    auto max_games = std::max<size_t>(opts.positions, 1) * games_per_position;
+    parallel_for(max_games, threads, [&](size_t thread, size_t game) {
+        if (writer.full() || !writer.ok())
+            return;
+        auto& worker = workers[thread];
+        duplicates.fetch_add(play_game(opts, worker, seen, game),
+            std::memory_order_relaxed);
+        games.fetch_add(1, std::memory_order_relaxed);
+        if (worker.own.size() >= chunk_size)
+            writer.append(worker);
+
+        if (thread != 0)
+            return;
+        auto now = Clock::now();
+        if (now - last_report < opts.report_interval)
+            return;
+        auto elapsed = std::chrono::duration<double>(now - start);
+        auto written = writer.positions();
+        std::println("{:10} positions  {:8.0f} positions/s  {:5.1f}% seen "
+                     "before",
+            written, static_cast<double>(written) / elapsed.count(),
+            100.0 * static_cast<double>(duplicates.load())
+                / static_cast<double>(written + duplicates.load()));
+        last_report = now;
+    });
+    for (auto& worker : workers)
+        writer.append(worker);
+
+    auto positions = writer.positions();
+    if (!writer.finish(opts.depth))
+        return false;
+    auto error = std::error_code();
+    std::filesystem::rename(temp, opts.output, error);
+    if (error) {
+        std::cerr << std::format("could not rename '{}' to '{}': {}\n",
+            temp.string(), opts.output.string(), error.message());
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    auto rate = static_cast<double>(positions) / elapsed.count();
+    std::println("{} positions from {} games in {:.1f} s, {:.0f} positions/s, "
+                 "{:.2f} M/hour",
+        positions, games.load(), elapsed.count(), rate, rate * 3600 / 1e6);
+    if (positions < opts.positions)
+        std::println("the games ran out of new positions");
+    return true;
+}
+
+DatasetFile::DatasetFile(const std::filesystem::path& path, bool verify)
+{
+    m_ok = map(path, verify);
+}
+
+auto DatasetFile::map(const std::filesystem::path& path, bool verify) -> bool
+{
+    m_file = MappedFile(path, header_size, "dataset");
+    if (!m_file.ok())
+        return false;
+    const auto* data = m_file.data();
+    auto file_size = m_file.size();
+
+    auto fail = [&](std::string_view problem) {
+        std::cerr << std::format("'{}' {}\n", path.string(), problem);
+        return false;
+    };
+    if (std::memcmp(data, magic.data(), magic.size()) != 0)
+        return fail("is no dataset file");
+    if (read_value<uint32_t>(&data[4]) != format_version)
+        return fail(std::format("has format version {}, expected {}",
+            read_value<uint32_t>(&data[4]), format_version));
+    if (read_value<uint32_t>(&data[12]) != Board::width)
+        return fail("is for another board");
+
+    m_depth = read_value<uint32_t>(&data[8]);
+    m_size = read_value<uint64_t>(&data[16]);
+    auto own = read_value<uint64_t>(&data[24]);
+    auto opponent = read_value<uint64_t>(&data[32]);
+    auto scores = read_value<uint64_t>(&data[40]);
+    auto fits = [&](size_t offset, size_t bytes) {
+        return offset % array_alignment == 0 && offset <= file_size
+            && bytes <= file_size - offset;
+    };
+    if (m_size > file_size || !fits(own, m_size * sizeof(uint64_t))
+        || !fits(opponent, m_size * sizeof(uint64_t))
+        || !fits(scores, m_size * Board::width * sizeof(int16_t)))
+        return fail("is corrupt");
+    m_own = reinterpret_cast<const uint64_t*>(&data[own]);
+    m_opponent = reinterpret_cast<const uint64_t*>(&data[opponent]);
+    m_scores = reinterpret_cast<const int16_t*>(&data[scores]);
+
+    if (verify) {
+        // drops every chunk once it's hashed, so the whole file is never
+        // resident at once
+        auto hash_array = [&](size_t offset, size_t bytes, uint64_t hash) {
+            for (size_t done = 0; done < bytes; done += verify_chunk) {
+                auto size = std::min(verify_chunk, bytes - done);
+                hash = fnv1a(&data[offset + done], size, hash);
+                m_file.advise(MADV_DONTNEED, offset + done, size);
+            }
+            return hash;
+        };
+        m_file.advise(MADV_SEQUENTIAL);
+        auto hash = hash_array(own, m_size * sizeof(uint64_t), fnv1a_basis);
+        hash = hash_array(opponent, m_size * sizeof(uint64_t), hash);
+        hash = hash_array(
+            scores, m_size * Board::width * sizeof(int16_t), hash);
+        m_file.advise(MADV_NORMAL);
+        if (hash != read_value<uint64_t>(&data[48]))
+            return fail("has a wrong checksum");
+    }
+    return true;
+}
+
+auto DatasetFile::side_to_move(size_t index) const -> Color
+{
+    return dataset_side_to_move(m_own[index], m_opponent[index]);
+}
+
+auto DatasetFile::board(size_t index) const -> Board
+{
+    return dataset_board(m_own[index], m_opponent[index]);
+}
+
+auto DatasetFile::to_data(Encoding encoding, size_t first, size_t count) const
+    -> Model::Data
+{
+    first = std::min(first, m_size);
+    count = std::min(count, m_size - first);
+    auto data = Model::Data();
+    data.reserve(count);
+    for (auto i = first; i < first + count; ++i) {
+        auto entry = Model::DataEntry {
+            .input = Mx1(encoded_size(encoding)),
+            .correct = Mx1(Board::width),
+        };
+        board(i).encode(entry.input.span(), encoding, side_to_move(i));
+        auto scores = this->scores(i);
+        for (size_t col = 0; col < Board::width; ++col)
+            entry.correct.span()[col] = score_target(scores[col]);
+        data.push_back(std::move(entry));
+    }
+    return data;
+}
@@ -0,0 +1,138 @@
+#ifndef DATASET_HPP
+#define DATASET_HPP
+
+#include "agent.hpp"
+#include "board.hpp"
+#include "mapped_file.hpp"
+#include "nn_model.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <span>
+
+namespace connect_four {
+
+// A dataset file is a header
+//
+//     magic "C4DS" | u32 format version | u32 search depth | u32 columns
+//     u64 positions | u64 own tiles offset | u64 opponent tiles offset
+//     u64 scores offset | u64 fnv-1a of the arrays | u64 reserved
+//
+// followed by 3 arrays, each starting at a multiple of 64 bytes:
+//
+//     own tiles       u64 per position, as `Board::tiles` of the side to move
+//     opponent tiles  u64 per position
+//     scores          i16 per position and column
+//
+// The checksum covers the used part of the arrays, in that order. A score
+// is `Minimax::column_points` for the side to move, or `full_column`. All
+// fields are in native byte order.
+
+/// score of a column no tile fits in
+constexpr int16_t full_column = std::numeric_limits<int16_t>::min();
+
+/// The target a net should output for a column scored `score`: 1 for a
+/// win, 0 for a loss or a full column, and heuristic scores in between.
+constexpr auto score_target(int16_t score) -> double
+{
+    if (score == full_column)
+        return 0;
+    return std::clamp(0.5 + score / 2000.0, 0.0, 1.0);
+}
+
+/// The side to move in a position with `own` and `opponent` tiles, as a
+/// dataset stores them.
+auto dataset_side_to_move(uint64_t own, uint64_t opponent) -> Color;
+auto dataset_board(uint64_t own, uint64_t opponent) -> Board;
+
+struct DatasetOptions {
+    std::filesystem::path output {};
+    size_t positions = 100'000;
+    /// `Minimax` depth the columns are scored at, as `minimax:<depth>`
+    /// searches
+    size_t depth = 4;
+    /// plays both sides of the games the positions are taken from
+    AgentSpec agent {};
+    /// random plies played before the agent takes over, so the games of
+    /// a deterministic agent differ
+    size_t opening_plies = 0;
+    size_t threads = 1;
+    uint64_t seed = 0;
+    std::chrono::seconds report_interval { 10 };
+};
+
+/// Plays games on `threads` threads and scores every position in them not
+/// seen before, a position and its mirror image being the same, until
+/// `positions` positions are written to `output`. Every thread writes
+/// its positions in chunks to the place in the file reserved for them, so
+/// memory doesn't grow with the dataset, apart from the hashes of the
+/// positions seen. The positions only depend on `seed` with one thread.
+auto generate_dataset(const DatasetOptions& opts) -> bool;
+
+/// A dataset file mapped read-only.
+class DatasetFile {
+public:
+    /// `verify` checks the checksum, which reads the whole file once
+    explicit DatasetFile(
+        const std::filesystem::path& path, bool verify = true);
+
+    DatasetFile(const DatasetFile&) = delete;
+    auto operator=(const DatasetFile&) -> DatasetFile& = delete;
+
+    auto ok() const -> bool
+    {
+        return m_ok;
+    }
+
+    auto size() const -> size_t
+    {
+        return m_size;
+    }
+    auto depth() const -> size_t
+    {
+        return m_depth;
+    }
+
+    auto own_tiles() const -> std::span<const uint64_t>
+    {
+        return { m_own, m_size };
+    }
+    auto opponent_tiles() const -> std::span<const uint64_t>
+    {
+        return { m_opponent, m_size };
+    }
+    /// the scores of every column of the position at `index`
+    auto scores(size_t index) const -> std::span<const int16_t, Board::width>
+    {
+        return std::span<const int16_t, Board::width>(
+            &m_scores[index * Board::width], Board::width);
+    }
+
+    auto side_to_move(size_t index) const -> Color;
+    auto board(size_t index) const -> Board;
+
+    /// `count` positions from `first` on as `Model::train_sgd` takes them,
+    /// encoded as seen by the side to move, with a `score_target` per
+    /// column.
+    auto to_data(Encoding encoding, size_t first = 0,
+        size_t count = std::numeric_limits<size_t>::max()) const
+        -> Model::Data;
+
+private:
+    auto map(const std::filesystem::path& path, bool verify) -> bool;
+
+    MappedFile m_file;
+    size_t m_size = 0;
+    size_t m_depth = 0;
+    const uint64_t* m_own = nullptr;
+    const uint64_t* m_opponent = nullptr;
+    const int16_t* m_scores = nullptr;
+    bool m_ok = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include "dataset_stream.hpp"
+#include "board.hpp"
+#include "dataset.hpp"
+#include "nn_file.hpp"
+#include "nn_model.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <numeric>
+#include <print>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace connect_four;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Linux maps the pages up to this far around one faulting in, so reading a
+/// block maps parts of its neighbours
+constexpr size_t fault_around = 64 * 1024;
+
+/// gives `advice` for the pages holding [`begin`, `end`) of `array`,
+/// widened by `margin` bytes on both sides
+void advise(std::span<const std::byte> array, size_t begin, size_t end,
+    size_t margin, int advice)
+{
+    static const auto page_size
+        = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    begin -= std::min(begin, margin);
+    end = std::min(end + margin, array.size());
+    auto first = reinterpret_cast<uintptr_t>(array.data() + begin);
+    first = first / page_size * page_size;
+    auto last = reinterpret_cast<uintptr_t>(array.data() + end);
+    ::madvise(reinterpret_cast<void*>(first), last - first, advice);
+}
+
+}
+
+
+template <typename T>
+BasicDatasetStream<T>::BasicDatasetStream(
+    const DatasetFile& file, Options opts)
+    : m_file(file)
+    , m_opts(opts)
+    , m_rng(opts.seed)
+{
+    m_opts.batch_size = std::max<size_t>(m_opts.batch_size, 1);
+    m_opts.shuffle_buffer = std::max<size_t>(m_opts.shuffle_buffer, 1);
+    m_opts.positions = std::min(m_opts.positions, m_file.size());
+    m_blocks.resize((m_opts.positions + block_size - 1) / block_size);
+    m_buffer.reserve(m_opts.shuffle_buffer);
+    for (auto* batch : { &m_current, &m_next }) {
+        batch->inputs.resize(m_opts.batch_size * inputs());
+        batch->targets.resize(m_opts.batch_size * Board::width);
+    }
+    start_epoch();
+    m_thread = std::jthread([this](std::stop_token stop) { prefetch(stop); });
+}
+
+template <typename T>
+auto BasicDatasetStream<T>::next() -> size_t
+{
+    auto lock = std::unique_lock(m_mutex);
+    if (!m_next_ready)
+        m_waits += 1;
+    m_next_changed.wait(lock, [&] { return m_next_ready; });
+    std::swap(m_current, m_next);
+    m_next_ready = false;
+    lock.unlock();
+    m_next_changed.notify_all();
+    return m_current.size;
+}
+
+template <typename T>
+void BasicDatasetStream<T>::prefetch(std::stop_token stop)
+{
+    while (true) {
+        // `m_next` is this thread's until it's ready
+        fill(m_next);
+        auto lock = std::unique_lock(m_mutex);
+        m_next_ready = true;
+        m_next_changed.notify_all();
+        if (!m_next_changed.wait(lock, stop, [&] { return !m_next_ready; }))
+            return;
+    }
+}
+
+template <typename T>
+void BasicDatasetStream<T>::fill(Batch& batch)
+{
+    batch.size = 0;
+    auto record = Record();
+    while (batch.size < m_opts.batch_size) {
+        while (m_buffer.size() < m_opts.shuffle_buffer && next_record(record))
+            m_buffer.push_back(record);
+        if (m_buffer.empty())
+            break;
+
+        auto pick = m_rng.below(m_buffer.size());
+        std::swap(m_buffer[pick], m_buffer.back());
+        const auto& [own, opponent, scores] = m_buffer.back();
+        auto input = std::span(batch.inputs)
+                         .subspan(batch.size * inputs(), inputs());
+        dataset_board(own, opponent)
+            .encode(input, m_opts.encoding,
+                dataset_side_to_move(own, opponent));
+        for (size_t col = 0; col < Board::width; ++col)
+            batch.targets[batch.size * Board::width + col]
+                = static_cast<T>(score_target(scores[col]));
+        m_buffer.pop_back();
+        batch.size += 1;
+    }
+    // the empty mini-batch ending the epoch
+    if (batch.size == 0)
+        start_epoch();
+}
+
+template <typename T>
+void BasicDatasetStream<T>::start_epoch()
+{
+    std::iota(m_blocks.begin(), m_blocks.end(), 0);
+    std::shuffle(m_blocks.begin(), m_blocks.end(), m_rng);
+    m_block = 0;
+    m_position = 0;
+    for (size_t i = 0; i < std::min<size_t>(m_blocks.size(), 2); ++i)
+        advise_block(m_blocks[i], MADV_WILLNEED);
+}
+
+template <typename T>
+auto BasicDatasetStream<T>::next_record(Record& record) -> bool
+{
+    while (m_block < m_blocks.size()) {
+        auto first = m_blocks[m_block] * block_size;
+        auto index = first + m_position;
+        if (m_position < block_size && index < m_opts.positions) {
+            record.own = m_file.own_tiles()[index];
+            record.opponent = m_file.opponent_tiles()[index];
+            auto scores = m_file.scores(index);
+            std::copy(scores.begin(), scores.end(), record.scores.begin());
+            m_position += 1;
+            return true;
+        }
+
+        // every position of the block is in the buffer, read the one
+        // after the next while this one's are handed out
+        advise_block(m_blocks[m_block], MADV_DONTNEED);
+        m_block += 1;
+        m_position = 0;
+        if (m_block + 1 < m_blocks.size())
+            advise_block(m_blocks[m_block + 1], MADV_WILLNEED);
+    }
+    return false;
+}
+
+template <typename T>
+void BasicDatasetStream<T>::advise_block(size_t block, int advice) const
+{
+    // dropping a block also drops what reading it mapped of its neighbours,
+    // which may have been dropped before
+    auto margin = advice == MADV_DONTNEED ? fault_around : 0;
+    auto first = block * block_size;
+    auto end = std::min(first + block_size, m_opts.positions);
+    for (auto tiles : { m_file.own_tiles(), m_file.opponent_tiles() })
+        advise(std::as_bytes(tiles), first * sizeof(uint64_t),
+            end * sizeof(uint64_t), margin, advice);
+    auto scores = std::span(
+        m_file.scores(0).data(), m_file.size() * Board::width);
+    advise(std::as_bytes(scores), first * Board::width * sizeof(int16_t),
+        end * Board::width * sizeof(int16_t), margin, advice);
+}
+
+template class connect_four::BasicDatasetStream<double>;
+template class connect_four::BasicDatasetStream<float>;
+
+auto connect_four::fit_dataset(const FitOptions& opts) -> bool
+{
+    auto file = DatasetFile(opts.data);
+    if (!file.ok())
+        return false;
+    auto holdout = std::min(opts.holdout, file.size() / 10);
+    auto positions = file.size() - holdout;
+
+    auto rng = Rng(opts.seed);
+    auto model = Model({ 42, 42, 18, 7 }, rng);
+    auto stream = DatasetStream(file,
+        {
+            .batch_size = opts.batch_size,
+            .shuffle_buffer = opts.shuffle_buffer,
+            .encoding = Encoding::Legacy,
+            .seed = opts.seed,
+            .positions = positions,
+        });
+    auto holdout_data = file.to_data(Encoding::Legacy, positions, holdout);
+
+    std::println("training on {} positions scored at depth {} for {} epochs, "
+                 "{} held out",
+        positions, file.depth(), opts.epochs, holdout);
+    auto start = Clock::now();
+    auto epoch_start = start;
+    auto on_epoch = [&](size_t epoch) {
+        auto now = Clock::now();
+        auto elapsed = std::chrono::duration<double>(now - epoch_start);
+        auto loss = holdout_data.empty()
+            ? std::string("-")
+            : std::format("{:.4f}", model.mean_squared_error(holdout_data));
+        std::println(
+            "epoch {}/{}  held out mse {}  {:.0f} positions/s  {} waits", epoch,
+            opts.epochs, loss, static_cast<double>(positions) / elapsed.count(),
+            stream.waits());
+        epoch_start = Clock::now();
+    };
+    train_sgd(model, stream,
+        {
+            .epochs = opts.epochs,
+            .learn_rate = opts.learn_rate,
+            .threads = opts.threads,
+            .on_epoch = on_epoch,
+        });
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    std::println("trained in {:.1f} s", elapsed.count());
+    return save_model(model, opts.output);
+}
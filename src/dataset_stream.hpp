@@ -0,0 +1,152 @@
+#ifndef DATASET_STREAM_HPP
+#define DATASET_STREAM_HPP
+
+#include "board.hpp"
+#include "dataset.hpp"
+#include "nn_model.hpp"
+#include "rng.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace connect_four {
+
+/// Mini-batches of the positions of a `DatasetFile`, in a new random order
+/// every epoch, read from its mapping with memory that doesn't grow with
+/// the dataset.
+///
+/// An epoch goes through blocks of `block_size` positions in a random
+/// order. The positions pass through a shuffle buffer, which hands out a
+/// random one of the positions it holds and refills from the blocks. A
+/// background thread encodes the next mini-batch while the current one is
+/// trained on. It asks the kernel to read the following block ahead, and to
+/// drop every block once it's copied to the buffer, so the part of the file
+/// resident stays a few blocks.
+template <typename T>
+class BasicDatasetStream {
+public:
+    static constexpr size_t block_size = 4096;
+
+    struct Options {
+        size_t batch_size = 32;
+        /// positions the shuffle buffer holds
+        size_t shuffle_buffer = 64 * 1024;
+        Encoding encoding = Encoding::Legacy;
+        uint64_t seed = 0;
+        /// only the first this many positions of the file are streamed
+        size_t positions = std::numeric_limits<size_t>::max();
+    };
+
+    /// starts prefetching the first mini-batch. `file` must be ok and
+    /// outlive the stream.
+    BasicDatasetStream(const DatasetFile& file, Options opts);
+
+    BasicDatasetStream(const BasicDatasetStream&) = delete;
+    auto operator=(const BasicDatasetStream&)
+        -> BasicDatasetStream& = delete;
+
+    auto batch_size() const -> size_t
+    {
+        return m_opts.batch_size;
+    }
+    auto inputs() const -> size_t
+    {
+        return encoded_size(m_opts.encoding);
+    }
+
+    /// Makes the next mini-batch current and returns its size, 0 at the
+    /// end of an epoch, as `run_batches` takes it. The stream is one of
+    /// the `Batches` of `train_sgd`.
+    auto next() -> size_t;
+    /// the encoded position at `index` in the current mini-batch
+    auto input(size_t index) const -> std::span<const T>
+    {
+        return std::span(m_current.inputs).subspan(index * inputs(), inputs());
+    }
+    /// `score_target` of every column of the position at `index`
+    auto target(size_t index) const -> std::span<const T>
+    {
+        return std::span(m_current.targets)
+            .subspan(index * Board::width, Board::width);
+    }
+
+    /// times `next` had to wait for the mini-batch to be prefetched
+    auto waits() const -> size_t
+    {
+        return m_waits;
+    }
+
+private:
+    struct Record {
+        uint64_t own;
+        uint64_t opponent;
+        std::array<int16_t, Board::width> scores;
+    };
+
+    struct Batch {
+        size_t size = 0;
+        std::vector<T> inputs;
+        std::vector<T> targets;
+    };
+
+    void prefetch(std::stop_token stop);
+    void fill(Batch& batch);
+    void start_epoch();
+    auto next_record(Record& record) -> bool;
+    void advise_block(size_t block, int advice) const;
+
+    const DatasetFile& m_file;
+    Options m_opts;
+
+    // only used by the prefetching thread
+    Rng m_rng;
+    std::vector<size_t> m_blocks;
+    /// index in `m_blocks` of the block being read
+    size_t m_block = 0;
+    /// next position in that block
+    size_t m_position = 0;
+    std::vector<Record> m_buffer;
+
+    Batch m_current;
+    Batch m_next;
+    std::mutex m_mutex;
+    std::condition_variable_any m_next_changed;
+    bool m_next_ready = false;
+    size_t m_waits = 0;
+    /// last, so it stops before the rest is destroyed
+    std::jthread m_thread;
+};
+
+using DatasetStream = BasicDatasetStream<double>;
+using DatasetStreamf = BasicDatasetStream<float>;
+
+struct FitOptions {
+    std::filesystem::path data {};
+    std::filesystem::path output {};
+    size_t epochs = 10;
+    size_t batch_size = 32;
+    double learn_rate = 0.5;
+    size_t shuffle_buffer = 64 * 1024;
+    size_t threads = 1;
+    uint64_t seed = 0;
+    /// positions at the end of the file kept out of training to measure
+    /// the loss on after every epoch, at most a tenth of the file
+    size_t holdout = 4096;
+};
+
+/// Trains a net shaped like the `nn` agent's, starting from `seed`, on a
+/// dataset file through a `DatasetStream`, and saves it to `output` for
+/// the `nn-file` agent. The file's checksum is verified first.
+auto fit_dataset(const FitOptions& opts) -> bool;
+
+}
+
+#endif
@@ -1,9 +1,13 @@
 #include "deci_tree_ai.hpp"
 #include "board.hpp"
+#include "deci_tree_file.hpp"
+#include "rng.hpp"
 #include <cstdint>
 #include <cstdlib>
+#include <format>
 #include <iostream>
 #include <print>
+#include <vector>
 
 using namespace connect_four;
 
@@ -34,9 +38,7 @@ auto DeciTreeAi::next_move(const Board& board) -> size_t
         std::cerr << "no candidates\n";
         std::exit(EXIT_FAILURE);
     }
-    auto cand_idx = cand_size > 1
-        ? static_cast<size_t>(std::rand()) % (cand_size - 1)
-        : 0;
+    auto cand_idx = cand_size > 1 ? thread_rng().below(cand_size - 1) : 0;
     auto col = candidates[cand_idx];
     m_current_choices.push_back({ hash, col });
 
@@ -46,13 +48,17 @@ auto DeciTreeAi::next_move(const Board& board) -> size_t
 auto DeciTreeAi::lookup_choices(Board board)
     -> std::tuple<Board::Hash, const ColWeights*>
 {
-    auto hash = board.hash();
+    // a position and its mirror image share an entry, so tables learned by
+    // different processes can be merged by hash
+    auto hash = board.canonical_hash();
     if (m_choice_weights.contains(hash))
         return { hash, &m_choice_weights.at(hash) };
 
-    auto flipped = board.flipped_hash();
-    if (m_choice_weights.contains(flipped))
-        return { flipped, &m_choice_weights.at(flipped) };
+    // positions not yet admitted behave like fresh entries, but choices made
+    // in them aren't rewarded or punished
+    static constexpr auto unadmitted_weights = ColWeights { 0 };
+    if (!m_admission_filter.visit(hash))
+        return { hash, &unadmitted_weights };
 
     m_choice_weights.insert_or_assign(hash, ColWeights { 0 });
     return { hash, &m_choice_weights.at(hash) };
@@ -81,13 +87,17 @@ void DeciTreeAi::report_loss()
 
 void DeciTreeAi::report_draw()
 {
-    reward_punish_current_choices(static_cast<Weight>(std::rand()) % 5 - 2);
+    reward_punish_current_choices(
+        static_cast<Weight>(static_cast<Weight>(thread_rng().below(5)) - 2));
 }
 
 void DeciTreeAi::reward_punish_current_choices(Weight reward)
 {
     for (auto [hash, col] : m_current_choices) {
-        auto& weight = m_choice_weights.at(hash).at(col);
+        auto entry = m_choice_weights.find(hash);
+        if (entry == m_choice_weights.end())
+            continue;
+        auto& weight = entry->second.at(col);
         int64_t val = weight;
         if (val + reward < weight_min) {
             weight = weight_min;
@@ -98,3 +108,36 @@ void DeciTreeAi::reward_punish_current_choices(Weight reward)
         }
     }
 }
+
+auto DeciTreeAi::save(const std::filesystem::path& path) const -> bool
+{
+    auto entries = snapshot();
+    return save_deci_tree_entries(path, m_color, entries);
+}
+
+auto DeciTreeAi::load(const std::filesystem::path& path) -> bool
+{
+    auto reader = DeciTreeFileReader(path);
+    if (!reader.ok())
+        return false;
+    if (reader.color() != m_color) {
+        std::cerr << std::format(
+            "'{}' is a model for the other color\n", path.string());
+        return false;
+    }
+
+    m_choice_weights.clear();
+    m_choice_weights.reserve(reader.entries());
+    while (auto entry = reader.next())
+        m_choice_weights.insert_or_assign(entry->hash, entry->weights);
+    return reader.ok();
+}
+
+auto DeciTreeAi::snapshot() const -> std::vector<DeciTreeEntry>
+{
+    auto entries = std::vector<DeciTreeEntry>();
+    entries.reserve(m_choice_weights.size());
+    for (const auto& [hash, weights] : m_choice_weights)
+        entries.push_back({ .hash = hash, .weights = weights });
+    return entries;
+}
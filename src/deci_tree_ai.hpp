@@ -1,9 +1,11 @@
 #ifndef DECITREE_AI_HPP
 #define DECITREE_AI_HPP
 
+#include "admission_filter.hpp"
 #include "board.hpp"
 #include "tile.hpp"
 #include <cstdint>
+#include <filesystem>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
@@ -17,11 +19,20 @@ using Weight = int16_t;
 using ColWeights = std::array<Weight, Board::width>;
 using Choice = std::tuple<Board::Hash, Col>;
 
+struct DeciTreeEntry {
+    Board::Hash hash;
+    ColWeights weights;
+};
+
 /// AI using decision tree strategy, like the one used for tic tac toe
 class DeciTreeAi {
 public:
-    DeciTreeAi(Tile color)
-        : m_color(color_from_tile(color))
+    /// positions only get an entry on their second visit, unless
+    /// `admission_bits` is 0
+    DeciTreeAi(
+        Tile color, size_t admission_bits = AdmissionFilter::default_bits)
+        : m_admission_filter(admission_bits)
+        , m_color(color_from_tile(color))
     {
     }
 
@@ -55,6 +66,18 @@ public:
         return model_entries() * estimated_entry_size;
     }
 
+    /// writes the weight table as a model file, see `deci_tree_file.hpp`
+    auto save(const std::filesystem::path& path) const -> bool;
+    /// replaces the weight table with the one in a model file
+    auto load(const std::filesystem::path& path) -> bool;
+    /// copy of the weight table in no particular order
+    auto snapshot() const -> std::vector<DeciTreeEntry>;
+
+    auto admission_filter() const -> const AdmissionFilter&
+    {
+        return m_admission_filter;
+    }
+
     auto set_exploration(Weight exploration)
     {
         m_exploration = exploration;
@@ -68,6 +91,7 @@ private:
     void reward_punish_current_choices(Weight reward);
 
     std::unordered_map<Board::Hash, ColWeights> m_choice_weights {};
+    AdmissionFilter m_admission_filter;
 
     std::vector<Choice> m_current_choices {};
 
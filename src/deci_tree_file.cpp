@@ -0,0 +1,243 @@
+#include "deci_tree_file.hpp"
+#include "board.hpp"
+#include "deci_tree_ai.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+constexpr auto magic = std::array { 'C', '4', 'D', 'T' };
+/// 2 keys entries by `Board::canonical_hash`, 1 by whichever orientation
+/// was seen first
+constexpr uint32_t version = 2;
+constexpr size_t header_size = 4 + 4 + 4 + 8;
+constexpr size_t entry_size = sizeof(Board::Hash) + sizeof(ColWeights);
+constexpr size_t buffer_entries = 4096;
+
+}
+
+DeciTreeFileWriter::DeciTreeFileWriter(
+    const std::filesystem::path& path, Color color)
+    : m_file(path, std::ios::binary | std::ios::trunc)
+    , m_ok(m_file.good())
+{
+    if (!m_ok) {
+        std::cerr << std::format("could not open '{}' for writing\n",
+            path.string());
+        return;
+    }
+    m_buffer.reserve(buffer_entries * entry_size);
+
+    auto header = std::array<char, header_size> {};
+    auto color_byte = std::to_underlying(color);
+    std::memcpy(&header[0], magic.data(), magic.size());
+    std::memcpy(&header[4], &version, sizeof(version));
+    std::memcpy(&header[8], &color_byte, sizeof(color_byte));
+    m_file.write(header.data(), header.size());
+}
+
+void DeciTreeFileWriter::write(const DeciTreeEntry& entry)
+{
+    auto offset = m_buffer.size();
+    m_buffer.resize(offset + entry_size);
+    std::memcpy(&m_buffer[offset], &entry.hash, sizeof(entry.hash));
+    std::memcpy(&m_buffer[offset + sizeof(entry.hash)], entry.weights.data(),
+        sizeof(entry.weights));
+    m_entries += 1;
+
+    if (m_buffer.size() >= buffer_entries * entry_size)
+        flush();
+}
+
+auto DeciTreeFileWriter::finish() -> bool
+{
+    if (!m_ok)
+        return false;
+    flush();
+    m_file.seekp(12);
+    m_file.write(reinterpret_cast<const char*>(&m_entries), sizeof(m_entries));
+    m_file.flush();
+    m_ok = m_file.good();
+    if (!m_ok)
+        std::cerr << "could not write model file\n";
+    return m_ok;
+}
+
+void DeciTreeFileWriter::flush()
+{
+    m_file.write(
+        m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+    m_buffer.clear();
+}
+
+DeciTreeFileReader::DeciTreeFileReader(const std::filesystem::path& path)
+    : m_file(path, std::ios::binary)
+    , m_buffer(buffer_entries * entry_size)
+    , m_ok(m_file.good())
+{
+    if (!m_ok) {
+        std::cerr << std::format("could not open '{}'\n", path.string());
+        return;
+    }
+
+    auto header = std::array<char, header_size> {};
+    m_file.read(header.data(), header.size());
+    uint32_t file_version = 0;
+    std::memcpy(&file_version, &header[4], sizeof(file_version));
+    if (!m_file.good() || !std::equal(magic.begin(), magic.end(), &header[0])) {
+        std::cerr << std::format(
+            "'{}' is not a decision tree model\n", path.string());
+        m_ok = false;
+        return;
+    }
+    if (file_version != version) {
+        std::cerr << std::format("'{}' is a version {} model, expected {}\n",
+            path.string(), file_version, version);
+        m_ok = false;
+        return;
+    }
+
+    uint8_t color_byte = 0;
+    std::memcpy(&color_byte, &header[8], sizeof(color_byte));
+    m_color = static_cast<Color>(color_byte);
+    std::memcpy(&m_entries, &header[12], sizeof(m_entries));
+}
+
+auto DeciTreeFileReader::next() -> std::optional<DeciTreeEntry>
+{
+    if (m_entries_read == m_entries)
+        return {};
+    if (m_buffer_pos == m_buffer_size && !fill())
+        return {};
+
+    auto entry = DeciTreeEntry {};
+    std::memcpy(&entry.hash, &m_buffer[m_buffer_pos], sizeof(entry.hash));
+    std::memcpy(entry.weights.data(),
+        &m_buffer[m_buffer_pos + sizeof(entry.hash)], sizeof(entry.weights));
+    m_buffer_pos += entry_size;
+    m_entries_read += 1;
+    return entry;
+}
+
+auto DeciTreeFileReader::fill() -> bool
+{
+    auto remaining = m_entries - m_entries_read;
+    auto count = std::min<uint64_t>(remaining, buffer_entries);
+    m_file.read(m_buffer.data(),
+        static_cast<std::streamsize>(count * entry_size));
+    if (!m_file.good()) {
+        std::cerr << "model file is truncated\n";
+        m_ok = false;
+        return false;
+    }
+    m_buffer_pos = 0;
+    m_buffer_size = count * entry_size;
+    return true;
+}
+
+auto connect_four::save_deci_tree_entries(const std::filesystem::path& path,
+    Color color, std::span<DeciTreeEntry> entries) -> bool
+{
+    std::sort(entries.begin(), entries.end(),
+        [](const auto& a, const auto& b) { return a.hash < b.hash; });
+
+    auto writer = DeciTreeFileWriter(path, color);
+    if (!writer.ok())
+        return false;
+    for (const auto& entry : entries)
+        writer.write(entry);
+    return writer.finish();
+}
+
+auto connect_four::merge_deci_tree_files(
+    std::span<const std::filesystem::path> inputs,
+    const std::filesystem::path& output, MergeMode mode) -> bool
+{
+    if (inputs.empty()) {
+        std::cerr << "no models to merge\n";
+        return false;
+    }
+
+    auto readers = std::vector<DeciTreeFileReader>();
+    readers.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        auto& reader = readers.emplace_back(input);
+        if (!reader.ok())
+            return false;
+        if (reader.color() != readers[0].color()) {
+            std::cerr << std::format(
+                "'{}' is for a different color than '{}'\n", input.string(),
+                inputs[0].string());
+            return false;
+        }
+    }
+
+    auto writer = DeciTreeFileWriter(output, readers[0].color());
+    if (!writer.ok())
+        return false;
+
+    // (hash, reader index) with the smallest hash on top
+    using Head = std::tuple<Board::Hash, size_t>;
+    auto heads = std::priority_queue<Head, std::vector<Head>, std::greater<>>();
+    auto current = std::vector<std::optional<DeciTreeEntry>>(readers.size());
+
+    auto advance = [&](size_t reader_idx) -> bool {
+        auto entry = readers[reader_idx].next();
+        if (!entry)
+            return readers[reader_idx].ok();
+        if (current[reader_idx] && entry->hash <= current[reader_idx]->hash) {
+            std::cerr << std::format(
+                "'{}' is not sorted\n", inputs[reader_idx].string());
+            return false;
+        }
+        current[reader_idx] = *entry;
+        heads.push({ entry->hash, reader_idx });
+        return true;
+    };
+
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (!advance(i))
+            return false;
+    }
+
+    while (!heads.empty()) {
+        auto hash = std::get<0>(heads.top());
+        auto sums = std::array<int64_t, Board::width> {};
+        int64_t count = 0;
+
+        while (!heads.empty() && std::get<0>(heads.top()) == hash) {
+            auto reader_idx = std::get<1>(heads.top());
+            heads.pop();
+
+            const auto& weights = current[reader_idx]->weights;
+            for (size_t col = 0; col < Board::width; ++col)
+                sums[col] += weights[col];
+            count += 1;
+
+            if (!advance(reader_idx))
+                return false;
+        }
+
+        auto entry = DeciTreeEntry { .hash = hash, .weights = {} };
+        for (size_t col = 0; col < Board::width; ++col) {
+            auto value = mode == MergeMode::Average ? sums[col] / count
+                                                    : sums[col];
+            entry.weights[col] = static_cast<Weight>(
+                std::clamp<int64_t>(value, weight_min, weight_max));
+        }
+        writer.write(entry);
+    }
+
+    return writer.finish();
+}
@@ -0,0 +1,100 @@
+#ifndef DECI_TREE_FILE_HPP
+#define DECI_TREE_FILE_HPP
+
+#include "board.hpp"
+#include "deci_tree_ai.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+// A model file is a header followed by entries sorted by ascending
+// `Board::canonical_hash`, all fields stored in native byte order:
+//
+//     magic "C4DT" | u32 version | u8 color | 3 bytes padding | u64 entries
+//     u64 hash | i16 weights[Board::width]
+//     ...
+//
+// Sorting lets models be merged by streaming them side by side.
+
+class DeciTreeFileWriter {
+public:
+    DeciTreeFileWriter(const std::filesystem::path& path, Color color);
+
+    auto ok() const -> bool
+    {
+        return m_ok;
+    }
+
+    /// entries must be written in ascending hash order
+    void write(const DeciTreeEntry& entry);
+    /// flushes remaining entries and fills in the header's entry count
+    auto finish() -> bool;
+
+private:
+    void flush();
+
+    std::ofstream m_file;
+    std::vector<char> m_buffer;
+    uint64_t m_entries = 0;
+    bool m_ok;
+};
+
+class DeciTreeFileReader {
+public:
+    explicit DeciTreeFileReader(const std::filesystem::path& path);
+
+    auto ok() const -> bool
+    {
+        return m_ok;
+    }
+
+    auto color() const -> Color
+    {
+        return m_color;
+    }
+
+    auto entries() const -> uint64_t
+    {
+        return m_entries;
+    }
+
+    auto next() -> std::optional<DeciTreeEntry>;
+
+private:
+    auto fill() -> bool;
+
+    std::ifstream m_file;
+    std::vector<char> m_buffer;
+    size_t m_buffer_pos = 0;
+    size_t m_buffer_size = 0;
+    uint64_t m_entries = 0;
+    uint64_t m_entries_read = 0;
+    Color m_color = Color::Red;
+    bool m_ok;
+};
+
+/// sorts `entries` and writes them as a model file
+auto save_deci_tree_entries(const std::filesystem::path& path, Color color,
+    std::span<DeciTreeEntry> entries) -> bool;
+
+enum class MergeMode {
+    /// sum weights, saturating at the weight limits
+    Sum,
+    /// average weights over the models containing the entry
+    Average,
+};
+
+/// Merges models of the same color into `output` with a k-way merge.
+/// Memory use only depends on the number of inputs, not their sizes.
+auto merge_deci_tree_files(std::span<const std::filesystem::path> inputs,
+    const std::filesystem::path& output, MergeMode mode) -> bool;
+
+}
+
+#endif
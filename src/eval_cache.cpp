@@ -0,0 +1,102 @@
+#include "eval_cache.hpp"
+#include "board.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+using namespace connect_four;
+
+namespace {
+
+/// splitmix64's finalizer
+auto mix(uint64_t value) -> uint64_t
+{
+    value = (value ^ value >> 30) * 0xbf58476d1ce4e5b9;
+    value = (value ^ value >> 27) * 0x94d049bb133111eb;
+    return value ^ value >> 31;
+}
+
+/// Every value is mixed in, rather than xored, so the values of two
+/// entries torn into one don't cancel out.
+auto check_of(uint64_t key, std::span<const uint64_t, EvalCache::outputs> bits)
+    -> uint64_t
+{
+    auto check = key;
+    for (auto value : bits)
+        check = mix(check ^ value);
+    return check;
+}
+
+struct Lookup {
+    uint64_t key;
+    /// whether `board` is stored as its mirror image
+    bool mirrored;
+};
+
+auto lookup(const Board& board, uint64_t version) -> Lookup
+{
+    auto hash = board.hash();
+    auto flipped = board.flipped_hash();
+    return {
+        mix(std::min(hash, flipped) ^ mix(version)),
+        flipped < hash,
+    };
+}
+
+}
+
+EvalCache::EvalCache(size_t log2_size)
+    : m_entries(size_t { 1 } << log2_size)
+    , m_mask((uint64_t { 1 } << log2_size) - 1)
+{
+}
+
+auto EvalCache::find(const Board& board, uint64_t version,
+    std::span<double, outputs> out) -> bool
+{
+    auto [key, mirrored] = lookup(board, version);
+    const auto& entry = m_entries[key & m_mask];
+
+    auto check = entry.check.load(std::memory_order_relaxed);
+    std::array<uint64_t, outputs> bits;
+    for (size_t i = 0; i < outputs; ++i)
+        bits[i] = entry.values[i].load(std::memory_order_relaxed);
+    if (check != check_of(key, bits)) {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    for (size_t i = 0; i < outputs; ++i)
+        out[i] = std::bit_cast<double>(bits[i]);
+    if (mirrored)
+        std::reverse(out.begin(), out.end());
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void EvalCache::store(const Board& board, uint64_t version,
+    std::span<const double, outputs> values)
+{
+    auto [key, mirrored] = lookup(board, version);
+    auto& entry = m_entries[key & m_mask];
+
+    std::array<uint64_t, outputs> bits;
+    for (size_t i = 0; i < outputs; ++i) {
+        bits[i] = std::bit_cast<uint64_t>(
+            values[mirrored ? outputs - 1 - i : i]);
+        entry.values[i].store(bits[i], std::memory_order_relaxed);
+    }
+    entry.check.store(check_of(key, bits), std::memory_order_relaxed);
+}
+
+auto EvalCache::stats() const -> Stats
+{
+    return {
+        m_hits.load(std::memory_order_relaxed),
+        m_misses.load(std::memory_order_relaxed),
+    };
+}
@@ -0,0 +1,67 @@
+#ifndef EVAL_CACHE_HPP
+#define EVAL_CACHE_HPP
+
+#include "board.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+/// Outputs of models per position, one per column, shared by threads
+/// without locks. A position and its mirror image share an entry, with the
+/// outputs mirrored too.
+///
+/// Entries are keyed by the position and the model's `version`, so a model
+/// whose weights changed never finds the outputs of its old weights.
+class EvalCache {
+public:
+    static constexpr size_t outputs = Board::width;
+
+    /// room for `1 << log2_size` positions, 64 bytes each
+    explicit EvalCache(size_t log2_size = 16);
+
+    /// Writes the cached outputs of `board` to `out`, returns false if
+    /// there are none.
+    auto find(const Board& board, uint64_t version,
+        std::span<double, outputs> out) -> bool;
+    /// Caches `values`, replacing whatever shared the entry.
+    void store(const Board& board, uint64_t version,
+        std::span<const double, outputs> values);
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+
+        auto hit_rate() const -> double
+        {
+            if (hits + misses == 0)
+                return 0;
+            return static_cast<double>(hits)
+                / static_cast<double>(hits + misses);
+        }
+    };
+    auto stats() const -> Stats;
+
+private:
+    /// Besides the outputs, every entry holds a check word: the key hashed
+    /// together with the outputs. An entry torn by threads writing it at
+    /// once, or holding another position, fails the check and reads as a
+    /// miss.
+    struct alignas(64) Entry {
+        std::atomic<uint64_t> check;
+        std::array<std::atomic<uint64_t>, outputs> values;
+    };
+
+    std::vector<Entry> m_entries;
+    uint64_t m_mask;
+    std::atomic<uint64_t> m_hits { 0 };
+    std::atomic<uint64_t> m_misses { 0 };
+};
+
+}
+
+#endif
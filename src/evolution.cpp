@@ -0,0 +1,391 @@
+#include "evolution.hpp"
+#include "agent.hpp"
+#include "board.hpp"
+#include "nn_file.hpp"
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include "nn_noise.hpp"
+#include "parallel.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <print>
+#include <random>
+#include <span>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+Population::Population(std::vector<size_t> layers, size_t size, Rng& rng)
+    : m_layers(std::move(layers))
+    , m_size(size)
+    , m_parameter_count(0)
+    , m_parameters()
+    , m_next()
+{
+    for (size_t i = 0; i + 1 < m_layers.size(); ++i)
+        m_parameter_count += (m_layers[i] + 1) * m_layers[i + 1];
+    m_parameters.resize(m_size * m_parameter_count);
+    m_next.resize(m_size * m_parameter_count);
+
+    for (size_t member = 0; member < m_size; ++member)
+        Model(m_layers, rng).write_parameters(std::span(m_parameters)
+                .subspan(member * m_parameter_count, m_parameter_count));
+}
+
+void Population::Scratch::fit(const Population& population)
+{
+    const auto& layers = population.m_layers;
+    auto widest = *std::max_element(layers.begin(), layers.end());
+    if (m_data.size() < widest * 2)
+        m_data.resize(widest * 2);
+}
+
+auto Population::feed(size_t member, std::span<const double> input,
+    Scratch& scratch) const -> std::span<const double>
+{
+    ASSERT_EQ(input.size(), m_layers.front());
+    const auto& kernels = nn_kernels<double>();
+    scratch.fit(*this);
+    auto half = scratch.m_data.size() / 2;
+    auto front = std::span(scratch.m_data).first(half);
+    auto back = std::span(scratch.m_data).subspan(half);
+
+    auto parameters = this->parameters(member);
+    auto outputs = input;
+    for (size_t i = 0; i + 1 < m_layers.size(); ++i) {
+        auto rows = m_layers[i + 1];
+        auto cols = m_layers[i];
+        const auto* weights = parameters.data();
+        const auto* biases = weights + rows * cols;
+        parameters = parameters.subspan((cols + 1) * rows);
+
+        auto layer = front.first(rows);
+        kernels.gemv(weights, outputs.data(), layer.data(), rows, cols);
+        kernels.bias_sigmoid(layer.data(), biases, rows);
+        outputs = layer;
+        std::swap(front, back);
+    }
+    return outputs;
+}
+
+auto Population::parameters(size_t member) const -> std::span<const double>
+{
+    return std::span(m_parameters)
+        .subspan(member * m_parameter_count, m_parameter_count);
+}
+
+auto Population::next_parameters(size_t member) -> std::span<double>
+{
+    return std::span(m_next).subspan(
+        member * m_parameter_count, m_parameter_count);
+}
+
+void Population::advance()
+{
+    std::swap(m_parameters, m_next);
+}
+
+auto Population::model(size_t member) const -> Model
+{
+    auto model = Model(m_layers, zeroed);
+    model.read_parameters(parameters(member));
+    return model;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Match {
+    size_t red;
+    size_t blue;
+    uint64_t opening_seed;
+};
+
+/// Plays a game, with `select(color, board)` picking the moves after the
+/// opening.
+auto play_game(size_t opening_plies, uint64_t opening_seed, auto select)
+    -> GameState
+{
+    auto opening_rng = Rng(opening_seed);
+    auto board = Board();
+    auto turn = Color::Red;
+    for (size_t ply = 0;; ++ply) {
+        Col col;
+        if (ply < opening_plies) {
+            auto possible_moves = board.possible_moves();
+            do {
+                col = opening_rng.below(Board::width);
+            } while (!possible_moves.at(col));
+        } else {
+            col = select(turn, board);
+        }
+        board.insert(col, color_to_tile(turn));
+
+        auto state = board.game_state();
+        if (state != GameState::Ongoing)
+            return state;
+        turn = color_opposite(turn);
+    }
+}
+
+/// points of a game for red, a win is 1 and a draw 0.5
+auto red_points(GameState state) -> double
+{
+    switch (state) {
+        case GameState::RedWon:
+            return 1;
+        case GameState::Draw:
+            return 0.5;
+        case GameState::BlueWon:
+        case GameState::Ongoing:
+            return 0;
+    }
+    return 0;
+}
+
+auto select_col(const Population& population, size_t member,
+    const Board& board, Population::Scratch& scratch) -> Col
+{
+    auto inputs = FixedMx1<Board::width * Board::height>();
+    board.write_inputs(inputs.span());
+    return best_possible_col(
+        board, population.feed(member, inputs.span(), scratch));
+}
+
+/// Every round pairs all members at random, and each pair plays one game
+/// per color from a shared opening.
+auto schedule_matches(const EvolveOptions& opts, Rng& rng) -> std::vector<Match>
+{
+    auto matches = std::vector<Match>();
+    auto order = std::vector<size_t>(opts.population);
+    std::iota(order.begin(), order.end(), 0);
+    for (size_t round = 0; round < opts.rounds; ++round) {
+        std::shuffle(order.begin(), order.end(), rng);
+        for (size_t i = 0; i + 1 < order.size(); i += 2) {
+            auto opening_seed = rng.next();
+            matches.push_back({ order[i], order[i + 1], opening_seed });
+            matches.push_back({ order[i + 1], order[i], opening_seed });
+        }
+    }
+    return matches;
+}
+
+/// mean points per game of every member
+auto play_generation(const EvolveOptions& opts, const Population& population,
+    std::span<const Match> matches, std::vector<Population::Scratch>& scratch)
+    -> std::vector<double>
+{
+    auto results = std::vector<GameState>(matches.size());
+    parallel_for(matches.size(), opts.threads, [&](size_t thread, size_t i) {
+        const auto& match = matches[i];
+        results[i] = play_game(opts.opening_plies, match.opening_seed,
+            [&](Color color, const Board& board) {
+                auto member = color == Color::Red ? match.red : match.blue;
+                return select_col(population, member, board, scratch[thread]);
+            });
+    });
+
+    auto points = std::vector<double>(population.size(), 0.0);
+    auto games = std::vector<size_t>(population.size(), 0);
+    for (size_t i = 0; i < matches.size(); ++i) {
+        auto red = red_points(results[i]);
+        points[matches[i].red] += red;
+        points[matches[i].blue] += 1 - red;
+        games[matches[i].red] += 1;
+        games[matches[i].blue] += 1;
+    }
+    // with an odd population, one member sits out every round
+    for (size_t member = 0; member < points.size(); ++member)
+        points[member]
+            /= static_cast<double>(std::max<size_t>(games[member], 1));
+    return points;
+}
+
+struct Child {
+    size_t first_parent;
+    size_t second_parent;
+    uint64_t seed;
+};
+
+/// Child with every neuron, i.e. its incoming weights and bias, taken from
+/// either parent, and then mutated.
+void breed(const EvolveOptions& opts, const Population& population,
+    const Child& child, std::span<double> out)
+{
+    auto rng = Rng(child.seed);
+    auto first = population.parameters(child.first_parent);
+    auto second = population.parameters(child.second_parent);
+
+    const auto& layers = population.layers();
+    size_t offset = 0;
+    for (size_t i = 0; i + 1 < layers.size(); ++i) {
+        auto rows = layers[i + 1];
+        auto cols = layers[i];
+        auto biases = offset + rows * cols;
+        for (size_t row = 0; row < rows; ++row) {
+            auto parent = rng.below(2) == 0 ? first : second;
+            std::copy_n(&parent[offset + row * cols], cols,
+                &out[offset + row * cols]);
+            out[biases + row] = parent[biases + row];
+        }
+        offset = biases + rows;
+    }
+
+    auto noise = NoiseGenerator(rng);
+    noise.mutate(out, opts.mutation);
+}
+
+/// Members ordered from fittest, ties keep the member order.
+auto rank_members(std::span<const double> fitness) -> std::vector<size_t>
+{
+    auto ranking = std::vector<size_t>(fitness.size());
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::stable_sort(ranking.begin(), ranking.end(),
+        [&](size_t a, size_t b) { return fitness[a] > fitness[b]; });
+    return ranking;
+}
+
+/// The elite keeps its place at the start of the next generation, every
+/// other member is bred from two parents chosen by tournaments of three.
+void next_generation(const EvolveOptions& opts, Population& population,
+    std::span<const double> fitness, std::span<const size_t> ranking,
+    Rng& rng)
+{
+    for (size_t i = 0; i < opts.elite; ++i) {
+        auto parameters = population.parameters(ranking[i]);
+        std::copy(parameters.begin(), parameters.end(),
+            population.next_parameters(i).begin());
+    }
+
+    auto tournament = [&] {
+        auto best = rng.below(population.size());
+        for (size_t i = 1; i < 3; ++i) {
+            auto other = rng.below(population.size());
+            if (fitness[other] > fitness[best])
+                best = other;
+        }
+        return best;
+    };
+    auto children = std::vector<Child>();
+    for (size_t i = opts.elite; i < population.size(); ++i) {
+        auto first_parent = tournament();
+        auto second_parent = tournament();
+        children.push_back({ first_parent, second_parent, rng.next() });
+    }
+
+    parallel_for(children.size(), opts.threads, [&](size_t, size_t i) {
+        breed(opts, population, children[i],
+            population.next_parameters(opts.elite + i));
+    });
+    population.advance();
+}
+
+/// Score of `member` against random moves, from both colors.
+auto score_against_random(const EvolveOptions& opts,
+    const Population& population, size_t member, size_t games,
+    std::vector<Population::Scratch>& scratch, Rng& rng) -> double
+{
+    auto seeds = std::vector<uint64_t>(games);
+    rng.fill(seeds);
+    auto points = std::vector<double>(games);
+    parallel_for(games, opts.threads, [&](size_t thread, size_t game) {
+        auto member_color = game % 2 == 0 ? Color::Red : Color::Blue;
+        auto random_moves = Rng(seeds[game]);
+        auto state = play_game(opts.opening_plies, seeds[game],
+            [&](Color color, const Board& board) {
+                if (color == member_color)
+                    return select_col(population, member, board,
+                        scratch[thread]);
+                auto possible_moves = board.possible_moves();
+                Col col;
+                do {
+                    col = random_moves.below(Board::width);
+                } while (!possible_moves.at(col));
+                return col;
+            });
+        auto red = red_points(state);
+        points[game] = member_color == Color::Red ? red : 1 - red;
+    });
+    return std::accumulate(points.begin(), points.end(), 0.0)
+        / static_cast<double>(games);
+}
+
+}
+
+auto connect_four::run_evolution(const EvolveOptions& opts) -> bool
+{
+    if (opts.population < 2 || opts.elite >= opts.population
+        || opts.layers.size() < 2) {
+        std::cerr << "the population needs at least 2 members and more "
+                     "members than elite\n";
+        return false;
+    }
+    auto threads = std::max<size_t>(opts.threads, 1);
+
+    auto rng = Rng(opts.seed);
+    auto population = Population(opts.layers, opts.population, rng);
+    std::println("evolving {} nets of {} parameters for {} generations on {} "
+                 "threads, seed {}",
+        population.size(), population.parameter_count(), opts.generations,
+        threads, opts.seed);
+
+    auto scratch = std::vector<Population::Scratch>(threads);
+    auto ranking = std::vector<size_t>();
+    auto fitness = std::vector<double>();
+
+    auto start = Clock::now();
+    auto last_report = start;
+    size_t last_generation = 0;
+    for (size_t generation = 0; generation < opts.generations; ++generation) {
+        auto matches = schedule_matches(opts, rng);
+        fitness = play_generation(opts, population, matches, scratch);
+        ranking = rank_members(fitness);
+
+        auto done = generation + 1;
+        if (done % std::max<size_t>(opts.report_interval, 1) == 0
+            || done == opts.generations) {
+            auto now = Clock::now();
+            auto elapsed = std::chrono::duration<double>(now - last_report);
+            auto mean = std::accumulate(fitness.begin(), fitness.end(), 0.0)
+                / static_cast<double>(fitness.size());
+            std::println("generation {:6}  best {:5.3f}  mean {:5.3f}  "
+                         "{:8.2f} generations/s",
+                done, fitness[ranking[0]], mean,
+                static_cast<double>(done - last_generation) / elapsed.count());
+            last_report = now;
+            last_generation = done;
+        }
+
+        if (!opts.output.empty() && opts.checkpoint_interval != 0
+            && done % opts.checkpoint_interval == 0 && done < opts.generations)
+            save_model(population.model(ranking[0]), opts.output);
+
+        if (done < opts.generations)
+            next_generation(opts, population, fitness, ranking, rng);
+    }
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    std::println("{} generations in {:.1f} s, {:.2f} generations/s",
+        opts.generations, elapsed.count(),
+        static_cast<double>(opts.generations) / elapsed.count());
+
+    if (!ranking.empty()) {
+        constexpr size_t games = 1000;
+        std::println("best net scores {:.3f} against random moves",
+            score_against_random(
+                opts, population, ranking[0], games, scratch, rng));
+        if (!opts.output.empty()) {
+            if (!save_model(population.model(ranking[0]), opts.output))
+                return false;
+            std::println("saved the best net to '{}'", opts.output.string());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef EVOLUTION_HPP
+#define EVOLUTION_HPP
+
+#include "nn_model.hpp"
+#include "nn_noise.hpp"
+#include "rng.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+/// Nets of the same shape with the parameters of all of them in one
+/// contiguous arena, laid out like `Model::write_parameters`.
+///
+/// A second arena of the same size holds the generation being bred, so
+/// breeding never allocates.
+class Population {
+public:
+    /// every member starts as `Model(layers, rng)`
+    Population(std::vector<size_t> layers, size_t size, Rng& rng);
+
+    /// Buffers `feed` works in, so it doesn't have to allocate.
+    class Scratch {
+    public:
+        void fit(const Population& population);
+
+    private:
+        friend class Population;
+        std::vector<double> m_data;
+    };
+
+    /// Like `Model::feed`. The returned outputs live in `scratch`.
+    auto feed(size_t member, std::span<const double> input,
+        Scratch& scratch) const -> std::span<const double>;
+
+    auto parameters(size_t member) const -> std::span<const double>;
+    /// parameters of `member` in the generation being bred
+    auto next_parameters(size_t member) -> std::span<double>;
+    /// makes the bred generation the current one
+    void advance();
+
+    /// a copy of `member` as a standalone model
+    auto model(size_t member) const -> Model;
+
+    auto size() const -> size_t
+    {
+        return m_size;
+    }
+    auto parameter_count() const -> size_t
+    {
+        return m_parameter_count;
+    }
+    auto layers() const -> const std::vector<size_t>&
+    {
+        return m_layers;
+    }
+
+private:
+    std::vector<size_t> m_layers;
+    size_t m_size;
+    size_t m_parameter_count;
+    std::vector<double> m_parameters;
+    std::vector<double> m_next;
+};
+
+struct EvolveOptions {
+    std::vector<size_t> layers { 42, 42, 18, 7 };
+    size_t population = 64;
+    size_t generations = 100;
+    /// every round, each member plays a game pair, one game per color,
+    /// against another random member
+    size_t rounds = 4;
+    /// best members copied unchanged to the next generation
+    size_t elite = 8;
+    /// how each child is mutated after crossover
+    MutationOptions mutation {};
+    /// random plies played before the nets take over. Both games of a pair
+    /// share an opening.
+    size_t opening_plies = 2;
+    size_t threads = 1;
+    uint64_t seed = 0;
+    /// generations between progress reports
+    size_t report_interval = 10;
+    /// where the best net is saved at the end, if not empty
+    std::filesystem::path output {};
+    /// generations between saves of the best net so far, 0 for only at the
+    /// end
+    size_t checkpoint_interval = 0;
+};
+
+/// Evolves nets by self-play tournaments: every generation plays its games
+/// in parallel, then the fittest survive and breed the rest through
+/// crossover and mutation. Results only depend on `seed`, not on the
+/// number of threads.
+auto run_evolution(const EvolveOptions& opts) -> bool;
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include "game_record.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <mutex>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+constexpr auto magic = std::array<uint8_t, 4> { 'C', '4', 'G', 'R' };
+constexpr size_t block_header_size = 16;
+constexpr size_t game_header_size = 4;
+
+/// the checksum of a block's payload
+auto checksum(const uint8_t* data, size_t size) -> uint32_t
+{
+    return static_cast<uint32_t>(fnv1a(data, size));
+}
+
+}
+
+GameRecordFile::GameRecordFile(const std::filesystem::path& path)
+    : m_file(std::fopen(path.c_str(), "wb"))
+{
+    if (!m_file)
+        std::cerr << std::format(
+            "could not open '{}' for writing\n", path.string());
+}
+
+GameRecordFile::~GameRecordFile()
+{
+    if (m_file)
+        std::fclose(m_file);
+}
+
+void GameRecordFile::append_block(const std::vector<uint8_t>& block)
+{
+    auto lock = std::lock_guard(m_mutex);
+    if (!m_file || m_failed)
+        return;
+    if (std::fwrite(block.data(), 1, block.size(), m_file) != block.size()) {
+        std::cerr << "could not write game records\n";
+        m_failed = true;
+    }
+}
+
+GameRecordWriter::GameRecordWriter(GameRecordFile& file)
+    : m_file(file)
+{
+    m_block.reserve(block_size + block_header_size + game_header_size
+        + sizeof(GameRecord::moves));
+    m_block.resize(block_header_size);
+}
+
+GameRecordWriter::~GameRecordWriter()
+{
+    flush();
+}
+
+void GameRecordWriter::append(const GameRecord& game)
+{
+    auto offset = m_block.size();
+    auto packed_size = (game.move_count * 3u + 7) / 8;
+    m_block.resize(offset + game_header_size + packed_size, 0);
+
+    auto* out = &m_block[offset];
+    out[0] = game.move_count;
+    out[1] = static_cast<uint8_t>(std::to_underlying(game.result));
+    write_value(&out[2], game.tag);
+
+    auto* packed = out + game_header_size;
+    for (size_t i = 0; i < game.move_count; ++i) {
+        auto bit = i * 3;
+        auto bits = static_cast<unsigned>(game.moves[i] & 0b111) << bit % 8;
+        packed[bit / 8] |= static_cast<uint8_t>(bits);
+        if (bit % 8 > 5)
+            packed[bit / 8 + 1] |= static_cast<uint8_t>(bits >> 8);
+    }
+
+    m_games += 1;
+    if (m_block.size() >= block_size)
+        flush();
+}
+
+void GameRecordWriter::flush()
+{
+    if (m_games == 0)
+        return;
+
+    auto payload_size
+        = static_cast<uint32_t>(m_block.size() - block_header_size);
+    std::memcpy(&m_block[0], magic.data(), magic.size());
+    write_value(&m_block[4], m_games);
+    write_value(&m_block[8], payload_size);
+    write_value(&m_block[12],
+        checksum(&m_block[block_header_size], payload_size));
+    m_file.append_block(m_block);
+
+    m_block.resize(block_header_size);
+    m_games = 0;
+}
+
+GameRecordReader::GameRecordReader(const std::filesystem::path& path)
+    : m_file(path, 0, "game record")
+    , m_ok(m_file.ok())
+{
+    m_file.advise(MADV_SEQUENTIAL);
+}
+
+auto GameRecordReader::next(GameView& game) -> bool
+{
+    if (!m_ok)
+        return false;
+    while (m_block_games_left == 0) {
+        m_pos = std::max(m_pos, m_block_end);
+        if (m_pos == m_file.size())
+            return false;
+        if (!enter_block())
+            return false;
+    }
+
+    if (m_block_end - m_pos < game_header_size) {
+        std::cerr << "corrupt game record\n";
+        m_ok = false;
+        return false;
+    }
+    const auto* in = &m_file.data()[m_pos];
+    game.move_count = in[0];
+    game.result = static_cast<GameState>(in[1]);
+    game.tag = read_value<uint16_t>(&in[2]);
+    game.packed_moves = in + game_header_size;
+
+    auto packed_size = (game.move_count * 3u + 7) / 8;
+    if (m_block_end - m_pos < game_header_size + packed_size) {
+        std::cerr << "corrupt game record\n";
+        m_ok = false;
+        return false;
+    }
+    m_pos += game_header_size + packed_size;
+    m_block_games_left -= 1;
+    return true;
+}
+
+auto GameRecordReader::enter_block() -> bool
+{
+    const auto* header = &m_file.data()[m_pos];
+    auto size = m_file.size();
+    if (size - m_pos < block_header_size
+        || std::memcmp(header, magic.data(), magic.size()) != 0) {
+        std::cerr << "corrupt game record block\n";
+        m_ok = false;
+        return false;
+    }
+
+    auto games = read_value<uint32_t>(header + 4);
+    auto payload_size = read_value<uint32_t>(header + 8);
+    const auto* payload = header + block_header_size;
+    if (size - m_pos - block_header_size < payload_size
+        || checksum(payload, payload_size)
+            != read_value<uint32_t>(header + 12)) {
+        std::cerr << "corrupt game record block\n";
+        m_ok = false;
+        return false;
+    }
+
+    m_pos += block_header_size;
+    m_block_end = m_pos + payload_size;
+    m_block_games_left = games;
+    return true;
+}
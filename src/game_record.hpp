@@ -0,0 +1,132 @@
+#ifndef GAME_RECORD_HPP
+#define GAME_RECORD_HPP
+
+#include "board.hpp"
+#include "mapped_file.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace connect_four {
+
+// A game record file is a sequence of blocks:
+//
+//     magic "C4GR" | u32 games | u32 payload bytes
+//     u32 low half of the fnv-1a 64 of the payload
+//     game...
+//
+// and every game is
+//
+//     u8 moves | u8 result (GameState) | u16 tag | moves, 3 bits each
+//
+// with moves packed starting from the least significant bit. All fields are
+// in native byte order. The tag is free for the producer to use.
+
+struct GameRecord {
+    std::array<uint8_t, Board::width * Board::height> moves {};
+    uint8_t move_count = 0;
+    GameState result = GameState::Ongoing;
+    uint16_t tag = 0;
+
+    void push(Col col)
+    {
+        moves[move_count] = static_cast<uint8_t>(col);
+        move_count += 1;
+    }
+};
+
+/// File games get appended to in whole blocks. Safe to share between
+/// threads, each of which should use its own `GameRecordWriter`.
+class GameRecordFile {
+public:
+    explicit GameRecordFile(const std::filesystem::path& path);
+    ~GameRecordFile();
+
+    GameRecordFile(const GameRecordFile&) = delete;
+    auto operator=(const GameRecordFile&) -> GameRecordFile& = delete;
+
+    auto ok() const -> bool
+    {
+        return m_file != nullptr && !m_failed;
+    }
+
+    void append_block(const std::vector<uint8_t>& block);
+
+private:
+    std::FILE* m_file;
+    std::mutex m_mutex;
+    bool m_failed = false;
+};
+
+/// Buffers games into blocks and hands full blocks to a `GameRecordFile`.
+class GameRecordWriter {
+public:
+    static constexpr const size_t block_size = 64 * 1024;
+
+    explicit GameRecordWriter(GameRecordFile& file);
+    ~GameRecordWriter();
+
+    GameRecordWriter(const GameRecordWriter&) = delete;
+    auto operator=(const GameRecordWriter&) -> GameRecordWriter& = delete;
+
+    void append(const GameRecord& game);
+    void flush();
+
+private:
+    GameRecordFile& m_file;
+    std::vector<uint8_t> m_block;
+    uint32_t m_games = 0;
+};
+
+/// A game inside a mapped record file.
+struct GameView {
+    uint8_t move_count = 0;
+    GameState result = GameState::Ongoing;
+    uint16_t tag = 0;
+    const uint8_t* packed_moves = nullptr;
+
+    auto move(size_t i) const -> Col
+    {
+        auto bit = i * 3;
+        auto bits = static_cast<unsigned>(packed_moves[bit / 8]);
+        if (bit % 8 > 5)
+            bits |= static_cast<unsigned>(packed_moves[bit / 8 + 1]) << 8;
+        return bits >> bit % 8 & 0b111;
+    }
+};
+
+/// Iterates the games of a record file through a read-only memory map,
+/// without allocating.
+class GameRecordReader {
+public:
+    explicit GameRecordReader(const std::filesystem::path& path);
+
+    GameRecordReader(const GameRecordReader&) = delete;
+    auto operator=(const GameRecordReader&) -> GameRecordReader& = delete;
+
+    auto ok() const -> bool
+    {
+        return m_ok;
+    }
+
+    /// false at the end of the file, or when hitting a corrupt block, in
+    /// which case `ok()` becomes false
+    auto next(GameView& game) -> bool;
+
+private:
+    auto enter_block() -> bool;
+
+    MappedFile m_file;
+    size_t m_pos = 0;
+    size_t m_block_end = 0;
+    uint32_t m_block_games_left = 0;
+    bool m_ok = false;
+};
+
+}
+
+#endif
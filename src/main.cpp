@@ -1,14 +1,34 @@
+#include "agent.hpp"
+#include "arena.hpp"
+#include "bench.hpp"
 #include "board.hpp"
 #include "console.hpp"
+#include "dataset.hpp"
+#include "dataset_stream.hpp"
 #include "deci_tree_ai.hpp"
+#include "deci_tree_file.hpp"
+#include "eval_cache.hpp"
+#include "evolution.hpp"
+#include "game_record.hpp"
 #include "minimax.hpp"
 #include "nn_model.hpp"
+#include "rng.hpp"
+#include "trainer.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <ctime>
+#include <filesystem>
 #include <format>
 #include <iostream>
 #include <print>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -32,7 +52,7 @@ public:
     Program()
         : m_bot1(Tile::Red)
         , m_bot2(Tile::Blue)
-        , m_model({ 42, 42, 18, 6 })
+        , m_model({ 42, 42, 18, 7 })
     {
     }
 
@@ -172,25 +192,6 @@ private:
         }
     }
 
-    size_t model_select_col(Board& board, Model& model)
-    {
-
-        auto inputs = board.as_mx1();
-        auto outputs = model.feed(inputs);
-
-        auto possible_moves = board.possible_moves();
-
-        size_t selected_col = 0;
-        double max = 0;
-        for (size_t col = 0; col < 7; ++col) {
-            if (outputs[col] > max && possible_moves.at(col)) {
-                max = outputs[col];
-                selected_col = col;
-            }
-        }
-        return selected_col;
-    }
-
     void run_nn_models_against_each_other()
     {
         constexpr auto training_iters = 100'000;
@@ -202,11 +203,16 @@ private:
         auto clone = m_model;
         clone.mutate();
 
+        // the surviving model keeps its version, so its positions stay
+        // cached from game to game
+        auto cache = EvalCache();
+        auto scratch = Model::Scratch();
+
         for (int i = 0; i < training_iters; ++i) {
             auto board = Board();
 
             while (true) {
-                size_t col = model_select_col(board, m_model);
+                size_t col = model_select_col(board, m_model, cache, scratch);
                 board.insert(col, Tile::Red);
                 // board.print(m_printer);
 
@@ -236,7 +242,7 @@ private:
                     break;
                 }
 
-                col = model_select_col(board, clone);
+                col = model_select_col(board, clone, cache, scratch);
                 board.insert(col, Tile::Blue);
                 // board.print(m_printer);
 
@@ -272,7 +278,8 @@ private:
             }
         }
 
-        std::println("done");
+        std::println("done, {:.1f}% of the moves came from the cache",
+            cache.stats().hit_rate() * 100);
 
         for (;;) {
             auto board = Board();
@@ -369,7 +376,17 @@ private:
             bot1.model_entries(), bot1.model_size(), wins.at(bot1.color()));
         std::cout << std::format(l, "{}\t{:10L}\t{:12L}\t{:7}\n",
             bot2.color() == Color::Red ? "  Red" : " Blue",
-            bot2.model_entries(), bot2.model_size(), wins.at(bot1.color()));
+            bot2.model_entries(), bot2.model_size(), wins.at(bot2.color()));
+
+        std::println("color\t    visits\t hit rate\t est. fp rate\t resets");
+        for (auto* bot : { &bot1, &bot2 }) {
+            const auto& filter = bot->admission_filter();
+            std::cout << std::format(l,
+                "{}\t{:10L}\t{:8.2f}%\t{:12.4f}%\t{:7}\n",
+                bot->color() == Color::Red ? "  Red" : " Blue",
+                filter.visits(), filter.hit_rate() * 100,
+                filter.estimated_false_positive_rate() * 100, filter.resets());
+        }
 
         bot1.set_exploration(0);
         bot2.set_exploration(0);
@@ -457,9 +474,383 @@ private:
     }
 };
 
-int main()
+static auto parse_number(std::string_view text, auto& value) -> bool
+{
+    auto [end, error] = std::from_chars(text.begin(), text.end(), value);
+    return error == std::errc() && end == text.end();
+}
+
+static int run_train(std::span<const std::string_view> args)
+{
+    auto usage = [] {
+        std::cerr << "usage: game train --out <path> [--agent deci-tree] "
+                     "[--iters <n>] [--threads <n>] [--seed <n>] "
+                     "[--checkpoint-every <games>] [--report-every <secs>] "
+                     "[--record <path>]\n";
+        return EXIT_FAILURE;
+    };
+
+    auto opts = TrainOptions();
+    opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    opts.seed = static_cast<uint64_t>(std::time(nullptr));
+
+    for (size_t i = 0; i < args.size(); i += 2) {
+        if (i + 1 >= args.size())
+            return usage();
+        auto flag = args[i];
+        auto value = args[i + 1];
+
+        bool valid = true;
+        if (flag == "--out") {
+            opts.output = value;
+        } else if (flag == "--agent") {
+            valid = value == "deci-tree";
+            opts.agent = AgentType::DeciTree;
+        } else if (flag == "--iters") {
+            valid = parse_number(value, opts.iterations);
+        } else if (flag == "--threads") {
+            valid = parse_number(value, opts.threads);
+        } else if (flag == "--seed") {
+            valid = parse_number(value, opts.seed);
+        } else if (flag == "--checkpoint-every") {
+            valid = parse_number(value, opts.checkpoint_interval);
+        } else if (flag == "--record") {
+            opts.record = value;
+        } else if (flag == "--report-every") {
+            auto secs = int64_t { 0 };
+            valid = parse_number(value, secs);
+            opts.report_interval = std::chrono::seconds(secs);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << std::format("invalid argument '{} {}'\n", flag, value);
+            return usage();
+        }
+    }
+    if (opts.output.empty())
+        return usage();
+
+    return run_training(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_evolve(std::span<const std::string_view> args)
+{
+    auto usage = [] {
+        std::cerr << "usage: game evolve [--population <n>] "
+                     "[--generations <n>] [--rounds <n>] [--elite <n>] "
+                     "[--mutation-rate <p>] [--mutation-scale <x>] "
+                     "[--mutation-noise gaussian|laplace] "
+                     "[--opening-plies <n>] [--threads <n>] [--seed <n>] "
+                     "[--report-every <generations>] [--out <path>] "
+                     "[--checkpoint-every <generations>]\n";
+        return EXIT_FAILURE;
+    };
+
+    auto opts = EvolveOptions();
+    opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    opts.seed = static_cast<uint64_t>(std::time(nullptr));
+
+    for (size_t i = 0; i < args.size(); i += 2) {
+        if (i + 1 >= args.size())
+            return usage();
+        auto flag = args[i];
+        auto value = args[i + 1];
+
+        bool valid = true;
+        if (flag == "--population") {
+            valid = parse_number(value, opts.population);
+        } else if (flag == "--generations") {
+            valid = parse_number(value, opts.generations);
+        } else if (flag == "--rounds") {
+            valid = parse_number(value, opts.rounds);
+        } else if (flag == "--elite") {
+            valid = parse_number(value, opts.elite);
+        } else if (flag == "--mutation-rate") {
+            valid = parse_number(value, opts.mutation.rate);
+        } else if (flag == "--mutation-scale") {
+            valid = parse_number(value, opts.mutation.scale);
+        } else if (flag == "--mutation-noise") {
+            if (value == "gaussian")
+                opts.mutation.noise = Noise::Gaussian;
+            else if (value == "laplace")
+                opts.mutation.noise = Noise::Laplace;
+            else
+                valid = false;
+        } else if (flag == "--opening-plies") {
+            valid = parse_number(value, opts.opening_plies);
+        } else if (flag == "--threads") {
+            valid = parse_number(value, opts.threads);
+        } else if (flag == "--seed") {
+            valid = parse_number(value, opts.seed);
+        } else if (flag == "--report-every") {
+            valid = parse_number(value, opts.report_interval);
+        } else if (flag == "--out") {
+            opts.output = value;
+        } else if (flag == "--checkpoint-every") {
+            valid = parse_number(value, opts.checkpoint_interval);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << std::format("invalid argument '{} {}'\n", flag, value);
+            return usage();
+        }
+    }
+
+    return run_evolution(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_arena(std::span<const std::string_view> args)
+{
+    auto usage = [] {
+        std::cerr << "usage: game arena <agent> <agent> [--games <n>] "
+                     "[--threads <n>] [--seed <n>] [--opening-plies <n>] "
+                     "[--record <path>]\n"
+                     "agents: deci-tree:<model>, minimax:<depth>, "
+                     "nn[:<seed>], nn-conv[:<seed>], nn-file:<model>, "
+                     "nn-int8[:<seed>], random\n";
+        return EXIT_FAILURE;
+    };
+    if (args.size() < 2)
+        return usage();
+
+    auto first = AgentSpec::parse(args[0]);
+    auto second = AgentSpec::parse(args[1]);
+    if (!first || !second)
+        return usage();
+
+    auto opts = ArenaOptions();
+    opts.first = *first;
+    opts.second = *second;
+    opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    opts.seed = static_cast<uint64_t>(std::time(nullptr));
+
+    for (size_t i = 2; i < args.size(); i += 2) {
+        if (i + 1 >= args.size())
+            return usage();
+        auto flag = args[i];
+        auto value = args[i + 1];
+
+        bool valid = true;
+        if (flag == "--games") {
+            valid = parse_number(value, opts.games);
+        } else if (flag == "--threads") {
+            valid = parse_number(value, opts.threads);
+        } else if (flag == "--seed") {
+            valid = parse_number(value, opts.seed);
+        } else if (flag == "--opening-plies") {
+            valid = parse_number(value, opts.opening_plies);
+        } else if (flag == "--record") {
+            opts.record = value;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << std::format("invalid argument '{} {}'\n", flag, value);
+            return usage();
+        }
+    }
+
+    auto result = run_arena(opts);
+    if (!result)
+        return EXIT_FAILURE;
+    print_arena_result(opts, *result);
+    return EXIT_SUCCESS;
+}
+
+static int run_dataset(std::span<const std::string_view> args)
+{
+    auto usage = [] {
+        std::cerr << "usage: game dataset --out <path> [--positions <n>] "
+                     "[--depth <n>] [--agent <agent>] [--opening-plies <n>] "
+                     "[--threads <n>] [--seed <n>] "
+                     "[--report-every <secs>]\n";
+        return EXIT_FAILURE;
+    };
+
+    auto opts = DatasetOptions();
+    opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    opts.seed = static_cast<uint64_t>(std::time(nullptr));
+
+    for (size_t i = 0; i < args.size(); i += 2) {
+        if (i + 1 >= args.size())
+            return usage();
+        auto flag = args[i];
+        auto value = args[i + 1];
+
+        bool valid = true;
+        if (flag == "--out") {
+            opts.output = value;
+        } else if (flag == "--positions") {
+            valid = parse_number(value, opts.positions);
+        } else if (flag == "--depth") {
+            valid = parse_number(value, opts.depth);
+        } else if (flag == "--agent") {
+            auto agent = AgentSpec::parse(value);
+            valid = agent.has_value();
+            if (agent)
+                opts.agent = *agent;
+        } else if (flag == "--opening-plies") {
+            valid = parse_number(value, opts.opening_plies);
+        } else if (flag == "--threads") {
+            valid = parse_number(value, opts.threads);
+        } else if (flag == "--seed") {
+            valid = parse_number(value, opts.seed);
+        } else if (flag == "--report-every") {
+            auto secs = int64_t { 0 };
+            valid = parse_number(value, secs);
+            opts.report_interval = std::chrono::seconds(secs);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << std::format("invalid argument '{} {}'\n", flag, value);
+            return usage();
+        }
+    }
+    if (opts.output.empty())
+        return usage();
+
+    return generate_dataset(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_fit(std::span<const std::string_view> args)
+{
+    auto usage = [] {
+        std::cerr << "usage: game fit --data <path> --out <path> "
+                     "[--epochs <n>] [--batch-size <n>] [--learn-rate <x>] "
+                     "[--shuffle-buffer <n>] [--holdout <n>] [--threads <n>] "
+                     "[--seed <n>]\n";
+        return EXIT_FAILURE;
+    };
+
+    auto opts = FitOptions();
+    opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    opts.seed = static_cast<uint64_t>(std::time(nullptr));
+
+    for (size_t i = 0; i < args.size(); i += 2) {
+        if (i + 1 >= args.size())
+            return usage();
+        auto flag = args[i];
+        auto value = args[i + 1];
+
+        bool valid = true;
+        if (flag == "--data") {
+            opts.data = value;
+        } else if (flag == "--out") {
+            opts.output = value;
+        } else if (flag == "--epochs") {
+            valid = parse_number(value, opts.epochs);
+        } else if (flag == "--batch-size") {
+            valid = parse_number(value, opts.batch_size);
+        } else if (flag == "--learn-rate") {
+            valid = parse_number(value, opts.learn_rate);
+        } else if (flag == "--shuffle-buffer") {
+            valid = parse_number(value, opts.shuffle_buffer);
+        } else if (flag == "--holdout") {
+            valid = parse_number(value, opts.holdout);
+        } else if (flag == "--threads") {
+            valid = parse_number(value, opts.threads);
+        } else if (flag == "--seed") {
+            valid = parse_number(value, opts.seed);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << std::format("invalid argument '{} {}'\n", flag, value);
+            return usage();
+        }
+    }
+    if (opts.data.empty() || opts.output.empty())
+        return usage();
+
+    return fit_dataset(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_records(std::span<const std::string_view> args)
+{
+    if (args.size() != 1) {
+        std::cerr << "usage: game records <path>\n";
+        return EXIT_FAILURE;
+    }
+
+    auto reader = GameRecordReader(std::filesystem::path(args[0]));
+    size_t games = 0;
+    size_t moves = 0;
+    auto results = std::array<size_t, 4> {};
+    auto game = GameView {};
+    while (reader.next(game)) {
+        games += 1;
+        moves += game.move_count;
+        results[std::to_underlying(game.result) & 0b11] += 1;
+    }
+    if (!reader.ok())
+        return EXIT_FAILURE;
+
+    std::println("{} games, {:.1f} moves per game", games,
+        games == 0 ? 0.0
+                   : static_cast<double>(moves) / static_cast<double>(games));
+    std::println("red won {}, blue won {}, draw {}, unfinished {}",
+        results[std::to_underlying(GameState::RedWon)],
+        results[std::to_underlying(GameState::BlueWon)],
+        results[std::to_underlying(GameState::Draw)],
+        results[std::to_underlying(GameState::Ongoing)]);
+    return EXIT_SUCCESS;
+}
+
+static int run_bench_command(std::span<const std::string_view> args)
+{
+    if (args.size() > 1 || !run_bench(args.empty() ? "" : args[0])) {
+        std::cerr << "usage: game bench [kernels|sigmoid|expr|batch|"
+                     "precision|quantized|mutation|encode|accumulator|"
+                     "cache|static|file|conv]\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int run_merge(std::span<const std::string_view> args)
+{
+    auto mode = MergeMode::Sum;
+    if (!args.empty() && args[0] == "--average") {
+        mode = MergeMode::Average;
+        args = args.subspan(1);
+    }
+    if (args.size() < 2) {
+        std::cerr << "usage: game merge [--average] <output> <input>...\n";
+        return EXIT_FAILURE;
+    }
+
+    auto output = std::filesystem::path(args[0]);
+    auto inputs = std::vector<std::filesystem::path>(
+        args.begin() + 1, args.end());
+    if (!merge_deci_tree_files(inputs, output, mode))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
 {
-    std::srand(static_cast<uint32_t>(std::time(nullptr)));
+    auto args = std::vector<std::string_view>(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "train")
+        return run_train(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "evolve")
+        return run_evolve(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "arena")
+        return run_arena(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "dataset")
+        return run_dataset(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "fit")
+        return run_fit(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "records")
+        return run_records(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "bench")
+        return run_bench_command(std::span(args).subspan(1));
+    if (!args.empty() && args[0] == "merge")
+        return run_merge(std::span(args).subspan(1));
+
+    seed_thread_rng(static_cast<uint64_t>(std::time(nullptr)), 0);
     auto program = Program();
     program.run();
 }
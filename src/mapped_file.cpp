@@ -0,0 +1,99 @@
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace connect_four;
+
+auto connect_four::fnv1a(const uint8_t* data, size_t size, uint64_t hash)
+    -> uint64_t
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path, size_t min_size,
+    std::string_view kind)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << std::format("could not open '{}'\n", path.string());
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        std::cerr << std::format("could not stat '{}'\n", path.string());
+        return;
+    }
+    auto size = static_cast<size_t>(info.st_size);
+    if (size < min_size) {
+        ::close(fd);
+        std::cerr << std::format("'{}' is no {} file\n", path.string(), kind);
+        return;
+    }
+    // nothing can be mapped of an empty file
+    if (size == 0) {
+        ::close(fd);
+        m_ok = true;
+        return;
+    }
+    auto* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << std::format("could not map '{}'\n", path.string());
+        return;
+    }
+    m_data = static_cast<const uint8_t*>(mapping);
+    m_size = size;
+    m_ok = true;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        ::munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+    , m_ok(std::exchange(other.m_ok, false))
+{
+}
+
+auto MappedFile::operator=(MappedFile&& other) noexcept -> MappedFile&
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_ok, other.m_ok);
+    return *this;
+}
+
+void MappedFile::advise(int advice) const
+{
+    if (m_data)
+        ::madvise(const_cast<uint8_t*>(m_data), m_size, advice);
+}
+
+void MappedFile::advise(int advice, size_t offset, size_t size) const
+{
+    static const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    if (!m_data || offset >= m_size)
+        return;
+    auto end = std::min(offset + size, m_size);
+    offset = offset / page_size * page_size;
+    ::madvise(const_cast<uint8_t*>(m_data + offset), end - offset, advice);
+}
@@ -0,0 +1,82 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+
+namespace connect_four {
+
+// Helpers for the binary file formats, which are mapped to be read.
+
+/// `size` rounded up to a multiple of `alignment`
+constexpr auto align(size_t size, size_t alignment) -> size_t
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+constexpr uint64_t fnv1a_basis = 0xcbf29ce484222325;
+
+/// FNV-1a 64 of `size` bytes at `data`, continuing from `hash`
+auto fnv1a(const uint8_t* data, size_t size, uint64_t hash = fnv1a_basis)
+    -> uint64_t;
+
+/// the `U` stored in native byte order at `data`, which needn't be aligned
+template <typename U>
+auto read_value(const uint8_t* data) -> U
+{
+    U value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+template <typename U>
+void write_value(uint8_t* data, U value)
+{
+    std::memcpy(data, &value, sizeof(value));
+}
+
+/// A whole file mapped read-only.
+class MappedFile {
+public:
+    /// no file, not ok
+    MappedFile() = default;
+    /// Maps `path`. Files shorter than `min_size` are reported as no
+    /// `kind` file, e.g. "model". An empty file is ok without any data if
+    /// `min_size` is 0.
+    MappedFile(const std::filesystem::path& path, size_t min_size,
+        std::string_view kind);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    auto operator=(MappedFile&& other) noexcept -> MappedFile&;
+
+    auto ok() const -> bool
+    {
+        return m_ok;
+    }
+    auto data() const -> const uint8_t*
+    {
+        return m_data;
+    }
+    auto size() const -> size_t
+    {
+        return m_size;
+    }
+
+    /// `madvise` of the whole file
+    void advise(int advice) const;
+    /// `madvise` of the pages holding [`offset`, `offset + size`)
+    void advise(int advice, size_t offset, size_t size) const;
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_ok = false;
+};
+
+}
+
+#endif
@@ -1,7 +1,10 @@
 #include "minimax.hpp"
 #include "board.hpp"
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdint>
+#include <limits>
 #include <print>
 #include <tuple>
 #include <vector>
@@ -14,6 +17,25 @@ auto Minimax::choose(Board board, size_t depth) const -> Col
     return choice.col;
 }
 
+auto Minimax::column_points(Board board, size_t depth) const
+    -> std::array<int32_t, Board::width>
+{
+    auto points = std::array<int32_t, Board::width> {};
+    auto possible_moves = board.possible_moves();
+    for (uint16_t col = 0; col < board.width; ++col) {
+        if (!possible_moves.at(col)) {
+            points[col] = no_move;
+            continue;
+        }
+        auto board_clone = board;
+        board_clone.insert(col, m_tile);
+        points[col] = alpha_beta(board_clone, depth, color_opposite(m_color),
+            std::numeric_limits<int32_t>::min(),
+            std::numeric_limits<int32_t>::max());
+    }
+    return points;
+}
+
 auto Minimax::find_move(Board board, size_t depth, Color turn) const -> Choice
 {
     auto moves = std::vector<std::tuple<uint16_t, int32_t>>();
@@ -69,20 +91,73 @@ auto Minimax::after_move(Board board, size_t depth, Color turn,
     return find_move(board, depth - 1, turn);
 }
 
-auto Minimax::value_of_board(Board board) const -> int32_t
+auto Minimax::alpha_beta(Board board, size_t depth, Color turn,
+    int32_t alpha, int32_t beta) const -> int32_t
 {
-    int32_t value = 0;
-
-    for (uint16_t col = 0; col < board.width; ++col) {
-        for (uint16_t row = 0; row < board.height; ++row) {
-            auto possible_wins = (int32_t)board.win_possibilities_at_pos(m_color, col, row);
-            auto opponent_possible_wins = (int32_t)board.win_possibilities_at_pos(color_opposite(m_color), col, row);
-
-            value += possible_wins;
-            value -= opponent_possible_wins;
+    // the same cases as `after_move`
+    if (board.is_draw())
+        return 0;
+    auto state = board.game_state();
+    if (state == GameState::RedWon || state == GameState::BlueWon)
+        return state == color_win_state(m_color) ? 1000 : -1000;
+    if (depth == 0)
+        return value_of_board(board) * 8;
+
+    constexpr auto center_first = std::array<uint16_t, Board::width> {
+        3, 2, 4, 1, 5, 0, 6,
+    };
+    auto maximizing = turn == m_color;
+    auto best = maximizing ? std::numeric_limits<int32_t>::min()
+                           : std::numeric_limits<int32_t>::max();
+    auto possible_moves = board.possible_moves();
+    for (auto col : center_first) {
+        if (!possible_moves.at(col))
+            continue;
+        auto board_clone = board;
+        board_clone.insert(col, color_to_tile(turn));
+
+        auto points = alpha_beta(
+            board_clone, depth - 1, color_opposite(turn), alpha, beta);
+        if (maximizing) {
+            best = std::max(best, points);
+            alpha = std::max(alpha, best);
+        } else {
+            best = std::min(best, points);
+            beta = std::min(beta, best);
         }
+        if (alpha >= beta)
+            break;
     }
-
-    return value;
+    return best;
 }
 
+auto Minimax::value_of_board(Board board) const -> int32_t
+{
+    // Sums `win_possibilities_at_pos` of every tile, own minus the
+    // opponent's, with bit masks. All but one of the windows it counts per
+    // direction cancel out between the colors. The one left starts at the
+    // tile and takes 4 steps of `offset`, to `offset + 3 * step`, which may
+    // run past the board, where there are no tiles. The window counts for a
+    // color if none of the other color's tiles are in it.
+    constexpr uint64_t all_tiles
+        = (uint64_t { 1 } << board.width * board.height) - 1;
+    constexpr auto steps = std::array<size_t, 4> {
+        board.height - 1,
+        board.height,
+        1,
+        board.height + 1,
+    };
+    auto free_windows = [&](uint64_t blocking) {
+        int32_t count = 0;
+        for (auto step : steps) {
+            auto blocked = blocking | blocking >> step | blocking >> 2 * step
+                | blocking >> 3 * step;
+            count += std::popcount(~blocked & all_tiles);
+        }
+        return count;
+    };
+
+    auto own = board.tiles(m_color);
+    auto opponent = board.tiles(color_opposite(m_color));
+    return free_windows(opponent) - free_windows(own);
+}
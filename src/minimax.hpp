@@ -2,7 +2,9 @@
 #define MINIMAX_HPP
 
 #include "board.hpp"
+#include <array>
 #include <cstdint>
+#include <limits>
 namespace connect_four {
 
 class Minimax {
@@ -24,12 +26,25 @@ public:
         ChoiceType type;
     };
 
+    /// `column_points` of a full column
+    static constexpr int32_t no_move = std::numeric_limits<int32_t>::min();
+
     auto choose(Board board, size_t depth) const -> Col;
+    /// The points `choose` gives every column, for the color of this
+    /// `Minimax` to move. Found by alpha-beta search, so only the best
+    /// line below each column is searched in full, and ordering the moves
+    /// center first prunes most of the others.
+    auto column_points(Board board, size_t depth) const
+        -> std::array<int32_t, Board::width>;
 
 private:
     auto find_move(Board board, size_t depth, Color turn) const -> Choice;
     auto after_move(Board board, size_t depth, Color turn, Pos pos) const
         -> Choice;
+    /// the points of `after_move`, exact if they're between `alpha` and
+    /// `beta`, otherwise only a bound past them
+    auto alpha_beta(Board board, size_t depth, Color turn, int32_t alpha,
+        int32_t beta) const -> int32_t;
     auto value_of_board(Board board) const -> int32_t;
 
     Color m_color;
@@ -0,0 +1,66 @@
+#include "nn_accumulator.hpp"
+#include "board.hpp"
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+using namespace connect_four;
+
+template <typename T>
+BasicAccumulator<T>::BasicAccumulator(
+    const BasicModel<T>& model, const Board& board)
+    : m_model(&model)
+{
+    constexpr size_t inputs = Board::width * Board::height;
+    const auto& weights = model.weights(0);
+    ASSERT_EQ(weights.cols(), inputs);
+
+    // red moves an input from 0.5 to 1, blue from 0.5 to 0
+    auto rows = weights.rows();
+    m_columns.resize(inputs * rows);
+    for (size_t row = 0; row < rows; ++row)
+        for (size_t input = 0; input < inputs; ++input)
+            m_columns[input * rows + row]
+                = T(0.5) * weights.span()[row * inputs + input];
+
+    m_weighted.resize(rows);
+    reset(board);
+}
+
+template <typename T>
+void BasicAccumulator<T>::reset(const Board& board)
+{
+    T inputs[Board::width * Board::height];
+    board.encode(std::span<T>(inputs), Encoding::Legacy, Color::Red);
+    m_model->weights(0).dot_into(inputs, m_weighted);
+}
+
+template <typename T>
+void BasicAccumulator<T>::insert(Pos pos, Color color)
+{
+    const auto& kernels = nn_kernels<T>();
+    auto rows = m_weighted.size();
+    const auto* column = &m_columns[Board::offset(pos) * rows];
+    if (color == Color::Red)
+        kernels.add(m_weighted.data(), column, rows);
+    else
+        kernels.sub(m_weighted.data(), column, rows);
+}
+
+template <typename T>
+void BasicAccumulator<T>::undo(Pos pos, Color color)
+{
+    insert(pos, color_opposite(color));
+}
+
+template <typename T>
+auto BasicAccumulator<T>::feed(typename BasicModel<T>::Scratch& scratch) const
+    -> std::span<const T>
+{
+    return m_model->feed_weighted(m_weighted, scratch);
+}
+
+template class connect_four::BasicAccumulator<double>;
+template class connect_four::BasicAccumulator<float>;
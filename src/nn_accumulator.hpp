@@ -0,0 +1,53 @@
+#ifndef NN_ACCUMULATOR_HPP
+#define NN_ACCUMULATOR_HPP
+
+#include "board.hpp"
+#include "nn_model.hpp"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+/// Keeps the product of a model's first weights and the `Encoding::Legacy`
+/// inputs of a position up to date as tiles are inserted and undone, like
+/// the accumulator of an NNUE. A move changes one input, so it costs one
+/// column of weights instead of the whole first layer.
+///
+/// Holds on to the model, which must outlive it and not change meanwhile.
+template <typename T>
+class BasicAccumulator {
+public:
+    explicit BasicAccumulator(
+        const BasicModel<T>& model, const Board& board = Board());
+
+    /// recomputes the product for `board`
+    void reset(const Board& board);
+    /// a tile of `color` was inserted at `pos`
+    void insert(Pos pos, Color color);
+    /// the tile of `color` at `pos` was taken back
+    void undo(Pos pos, Color color);
+
+    /// Outputs of the model for the current position, living in `scratch`.
+    auto feed(typename BasicModel<T>::Scratch& scratch) const
+        -> std::span<const T>;
+
+    auto weighted() const -> std::span<const T>
+    {
+        return m_weighted;
+    }
+
+private:
+    const BasicModel<T>* m_model;
+    /// the first weights of every input, times the change of that input
+    /// when a red tile replaces an empty one, input by input
+    std::vector<T> m_columns;
+    std::vector<T> m_weighted;
+};
+
+using Accumulator = BasicAccumulator<double>;
+using Accumulatorf = BasicAccumulator<float>;
+
+}
+
+#endif
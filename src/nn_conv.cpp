@@ -0,0 +1,339 @@
+#include "nn_conv.hpp"
+#include "board.hpp"
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include "nn_noise.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <print>
+#include <random>
+#include <span>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+constexpr size_t kernel_size = ConvLayer::kernel_size;
+constexpr size_t out_height = ConvLayer::out_height;
+
+/// index of the input under tap `kx`, `ky` of plane `plane` for the window
+/// at column `x` and row `y`
+constexpr auto input_index(
+    size_t plane, size_t x, size_t y, size_t kx, size_t ky) -> size_t
+{
+    return plane * Board::width * Board::height + (x + kx) * Board::height
+        + y + ky;
+}
+
+// The windows and taps are fixed by the board, so the loops over them
+// unroll, and only the channels vary. Cloned per instruction set like
+// `fixed_product`.
+
+/// `out[window * channels + channel]`, the sum over the taps of a window of
+/// the input times `weights[tap * channels + channel]`
+template <typename T>
+__attribute__((target_clones("default", "avx2", "arch=x86-64-v4"))) void
+conv_sums(const T* weights, const T* in, T* out, size_t channels)
+{
+    constexpr size_t lanes = 64 / sizeof(T);
+    constexpr size_t windows = ConvLayer::positions;
+    size_t channel = 0;
+    // A cache line of channels for every window at a time. Each weight row
+    // is loaded once for all windows, and the windows' sums don't wait on
+    // each other.
+    for (; channel + lanes <= channels; channel += lanes) {
+        T sums[windows][lanes] = {};
+        const auto* row = &weights[channel];
+        for (size_t plane = 0; plane < ConvLayer::planes; ++plane)
+            for (size_t kx = 0; kx < kernel_size; ++kx)
+                for (size_t ky = 0; ky < kernel_size; ++ky) {
+                    for (size_t x = 0; x < ConvLayer::out_width; ++x)
+                        for (size_t y = 0; y < out_height; ++y) {
+                            auto value = in[input_index(plane, x, y, kx, ky)];
+                            auto& window = sums[x * out_height + y];
+                            for (size_t i = 0; i < lanes; ++i)
+                                window[i] += row[i] * value;
+                        }
+                    row += channels;
+                }
+        for (size_t window = 0; window < windows; ++window)
+            std::copy_n(sums[window], lanes, &out[window * channels + channel]);
+    }
+    for (; channel < channels; ++channel) {
+        T sums[windows] = {};
+        const auto* row = &weights[channel];
+        for (size_t plane = 0; plane < ConvLayer::planes; ++plane)
+            for (size_t kx = 0; kx < kernel_size; ++kx)
+                for (size_t ky = 0; ky < kernel_size; ++ky) {
+                    for (size_t x = 0; x < ConvLayer::out_width; ++x)
+                        for (size_t y = 0; y < out_height; ++y)
+                            sums[x * out_height + y] += *row
+                                * in[input_index(plane, x, y, kx, ky)];
+                    row += channels;
+                }
+        for (size_t window = 0; window < windows; ++window)
+            out[window * channels + channel] = sums[window];
+    }
+}
+
+/// adds the input under every tap times `delta` of its window to
+/// `gradients[tap * channels + channel]`
+template <typename T>
+__attribute__((target_clones("default", "avx2", "arch=x86-64-v4"))) void
+conv_gradients(const T* delta, const T* in, T* gradients, size_t channels)
+{
+    for (size_t x = 0; x < ConvLayer::out_width; ++x) {
+        for (size_t y = 0; y < out_height; ++y) {
+            const auto* window_delta = &delta[(x * out_height + y) * channels];
+            auto* row = gradients;
+            for (size_t plane = 0; plane < ConvLayer::planes; ++plane)
+                for (size_t kx = 0; kx < kernel_size; ++kx)
+                    for (size_t ky = 0; ky < kernel_size; ++ky) {
+                        auto value = in[input_index(plane, x, y, kx, ky)];
+                        // the planes are mostly empty
+                        if (value != 0) {
+                            for (size_t c = 0; c < channels; ++c)
+                                row[c] += window_delta[c] * value;
+                        }
+                        row += channels;
+                    }
+        }
+    }
+}
+
+auto with_inputs(size_t inputs, std::vector<size_t> layers)
+    -> std::vector<size_t>
+{
+    layers.insert(layers.begin(), inputs);
+    return layers;
+}
+
+}
+
+template <typename T>
+BasicConvLayer<T>::BasicConvLayer(size_t channels, Rng& rng)
+    : m_channels(channels)
+    , m_weights(taps * channels)
+    , m_biases(channels)
+{
+    auto normal_dist = std::normal_distribution(0.0, 0.5);
+    auto draw = [&] { return static_cast<T>(normal_dist(rng)); };
+    std::generate(m_weights.begin(), m_weights.end(), draw);
+    std::generate(m_biases.begin(), m_biases.end(), draw);
+    tile_biases();
+}
+
+template <typename T>
+void BasicConvLayer<T>::tile_biases()
+{
+    m_window_biases.resize(outputs());
+    for (size_t window = 0; window < positions; ++window)
+        std::copy(m_biases.begin(), m_biases.end(),
+            &m_window_biases[window * m_channels]);
+}
+
+template <typename T>
+void BasicConvLayer<T>::feed(std::span<const T> input, std::span<T> out) const
+{
+    ASSERT_EQ(input.size(), inputs);
+    ASSERT_EQ(out.size(), outputs());
+    conv_sums(m_weights.data(), input.data(), out.data(), m_channels);
+    nn_kernels<T>().bias_sigmoid(
+        out.data(), m_window_biases.data(), out.size());
+}
+
+template <typename T>
+void BasicConvLayer<T>::Gradients::fit(const BasicConvLayer& layer)
+{
+    m_weights.assign(layer.m_weights.size(), T(0));
+    m_biases.assign(layer.m_biases.size(), T(0));
+}
+
+template <typename T>
+void BasicConvLayer<T>::Gradients::add(const Gradients& other)
+{
+    const auto& kernels = nn_kernels<T>();
+    kernels.add(m_weights.data(), other.m_weights.data(), m_weights.size());
+    kernels.add(m_biases.data(), other.m_biases.data(), m_biases.size());
+}
+
+template <typename T>
+void BasicConvLayer<T>::backprop(std::span<const T> input,
+    std::span<const T> delta, Gradients& gradients) const
+{
+    ASSERT_EQ(input.size(), inputs);
+    ASSERT_EQ(delta.size(), outputs());
+    conv_gradients(
+        delta.data(), input.data(), gradients.m_weights.data(), m_channels);
+    const auto& kernels = nn_kernels<T>();
+    for (size_t window = 0; window < positions; ++window)
+        kernels.add(gradients.m_biases.data(), &delta[window * m_channels],
+            m_channels);
+}
+
+template <typename T>
+void BasicConvLayer<T>::descend(const Gradients& gradients, T rate)
+{
+    const auto& kernels = nn_kernels<T>();
+    kernels.axpy(m_weights.data(), -rate, gradients.m_weights.data(),
+        m_weights.size());
+    kernels.axpy(
+        m_biases.data(), -rate, gradients.m_biases.data(), m_biases.size());
+    tile_biases();
+}
+
+template <typename T>
+void BasicConvLayer<T>::mutate(
+    const MutationOptions& opts, NoiseGenerator& noise)
+{
+    noise.mutate(std::span(m_weights), opts);
+    noise.mutate(std::span(m_biases), opts);
+    tile_biases();
+}
+
+template <typename T>
+void BasicConvLayer<T>::write_parameters(std::span<T> out) const
+{
+    ASSERT_EQ(out.size(), parameter_count());
+    for (size_t channel = 0; channel < m_channels; ++channel)
+        for (size_t tap = 0; tap < taps; ++tap)
+            out[channel * taps + tap] = m_weights[tap * m_channels + channel];
+    std::copy(m_biases.begin(), m_biases.end(), &out[m_weights.size()]);
+}
+
+template <typename T>
+void BasicConvLayer<T>::read_parameters(std::span<const T> in)
+{
+    ASSERT_EQ(in.size(), parameter_count());
+    for (size_t channel = 0; channel < m_channels; ++channel)
+        for (size_t tap = 0; tap < taps; ++tap)
+            m_weights[tap * m_channels + channel] = in[channel * taps + tap];
+    std::copy_n(&in[m_weights.size()], m_biases.size(), m_biases.begin());
+    tile_biases();
+}
+
+template <typename T>
+BasicConvModel<T>::BasicConvModel(
+    size_t channels, std::vector<size_t> layers, Rng& rng)
+    : m_conv(channels, rng)
+    , m_dense(with_inputs(m_conv.outputs(), std::move(layers)), rng)
+{
+}
+
+template <typename T>
+BasicConvModel<T>::BasicConvModel(
+    BasicConvLayer<T> conv, BasicModel<T> dense)
+    : m_conv(std::move(conv))
+    , m_dense(std::move(dense))
+{
+    ASSERT_EQ(m_dense.layers().front(), m_conv.outputs());
+}
+
+template <typename T>
+void BasicConvModel<T>::Scratch::fit(const BasicConvModel& model)
+{
+    m_conv.resize(model.m_conv.outputs());
+    m_dense.fit(model.m_dense);
+}
+
+template <typename T>
+auto BasicConvModel<T>::feed(std::span<const T> input, Scratch& scratch) const
+    -> std::span<const T>
+{
+    scratch.fit(*this);
+    m_conv.feed(input, scratch.m_conv);
+    return m_dense.feed(scratch.m_conv, scratch.m_dense);
+}
+
+template <typename T>
+void BasicConvModel<T>::Workspace::fit(const BasicConvModel& model)
+{
+    m_conv.fit(model.m_conv);
+    m_dense.fit(model.m_dense);
+    m_outputs.resize(model.m_conv.outputs());
+    m_delta.resize(model.m_conv.outputs());
+}
+
+template <typename T>
+void BasicConvModel<T>::Workspace::add(const Workspace& other)
+{
+    m_conv.add(other.m_conv);
+    m_dense.add(other.m_dense);
+}
+
+template <typename T>
+void BasicConvModel<T>::backprop(std::span<const T> input,
+    std::span<const T> correct, Workspace& workspace) const
+{
+    auto outputs = std::span(workspace.m_outputs);
+    auto delta = std::span(workspace.m_delta);
+    m_conv.feed(input, outputs);
+    m_dense.backprop(outputs, correct, workspace.m_dense, delta);
+    nn_kernels<T>().sigmoid_backward(
+        delta.data(), outputs.data(), delta.size());
+    m_conv.backprop(input, delta, workspace.m_conv);
+}
+
+template <typename T>
+void BasicConvModel<T>::descend(const Workspace& gradients, T rate)
+{
+    m_conv.descend(gradients.m_conv, rate);
+    m_dense.descend(gradients.m_dense, rate);
+}
+
+template <typename T>
+void BasicConvModel<T>::train_sgd(std::span<const DataEntry> train_data,
+    std::span<const DataEntry> test_data, TrainOpts opts)
+{
+    if (opts.epochs == 0 || opts.batch_size == 0 || train_data.empty())
+        return;
+    auto batches = ShuffledBatches<T>(train_data, opts.batch_size);
+    auto on_epoch = [&](size_t epoch) {
+        if (!test_data.empty())
+            std::println("epoch {}/{} done, loss mse: {:.3f}", epoch - 1,
+                opts.epochs, mean_squared_error(test_data));
+        if (opts.on_epoch)
+            opts.on_epoch(epoch);
+    };
+    connect_four::train_sgd(*this, batches,
+        {
+            .epochs = opts.epochs,
+            .learn_rate = opts.learn_rate,
+            .threads = opts.threads,
+            .on_epoch = on_epoch,
+        });
+}
+
+template <typename T>
+auto BasicConvModel<T>::mean_squared_error(
+    std::span<const DataEntry> data) const -> double
+{
+    auto outputs = m_dense.layers().back();
+    auto scratch = Scratch();
+    double square_error = 0;
+    for (const auto& [input, correct] : data) {
+        auto results = feed(input.span(), scratch);
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto error = results[i] - correct[i];
+            square_error += error * error;
+        }
+    }
+    return square_error / static_cast<double>(data.size() * outputs);
+}
+
+template <typename T>
+void BasicConvModel<T>::mutate(
+    const MutationOptions& opts, NoiseGenerator& noise)
+{
+    m_conv.mutate(opts, noise);
+    m_dense.mutate(opts, noise);
+}
+
+template class connect_four::BasicConvLayer<double>;
+template class connect_four::BasicConvLayer<float>;
+template class connect_four::BasicConvModel<double>;
+template class connect_four::BasicConvModel<float>;
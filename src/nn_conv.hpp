@@ -0,0 +1,185 @@
+#ifndef NN_CONV_HPP
+#define NN_CONV_HPP
+
+#include "board.hpp"
+#include "nn_model.hpp"
+#include "nn_noise.hpp"
+#include "rng.hpp"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+/// A convolution over a board encoded as `Encoding::Planes`, followed by a
+/// sigmoid like the dense layers.
+///
+/// Each of `channels` filters covers 4x4 tiles of both planes, and slides
+/// over every window lying fully on the 7x6 board, 4 columns by 3 rows of
+/// them. A four in a row fits in one window, and a filter has 32 weights
+/// where a dense layer needs 42 per neuron. The outputs are stored window
+/// by window, column by column like the tiles, with the channels of a
+/// window together.
+template <typename T>
+class BasicConvLayer {
+public:
+    static constexpr size_t planes = 2;
+    static constexpr size_t kernel_size = 4;
+    static constexpr size_t out_width = Board::width - kernel_size + 1;
+    static constexpr size_t out_height = Board::height - kernel_size + 1;
+    static constexpr size_t positions = out_width * out_height;
+    static constexpr size_t inputs = encoded_size(Encoding::Planes);
+    static constexpr size_t taps = planes * kernel_size * kernel_size;
+
+    /// draws the initial weights and biases from `rng` like `BasicModel`
+    BasicConvLayer(size_t channels, Rng& rng);
+
+    /// converts every weight and bias to `T`
+    template <typename U>
+    explicit BasicConvLayer(const BasicConvLayer<U>& other)
+        : m_channels(other.m_channels)
+        , m_weights(other.m_weights.begin(), other.m_weights.end())
+        , m_biases(other.m_biases.begin(), other.m_biases.end())
+    {
+        tile_biases();
+    }
+
+    auto channels() const -> size_t
+    {
+        return m_channels;
+    }
+    auto outputs() const -> size_t
+    {
+        return positions * m_channels;
+    }
+
+    void feed(std::span<const T> input, std::span<T> out) const;
+
+    /// Gradients of the weights and biases, summed over samples.
+    class Gradients {
+    public:
+        /// sizes the gradients for `layer` and zeroes them
+        void fit(const BasicConvLayer& layer);
+        /// adds the gradients of `other`, fit to the same layer
+        void add(const Gradients& other);
+
+    private:
+        friend class BasicConvLayer;
+        std::vector<T> m_weights;
+        std::vector<T> m_biases;
+    };
+
+    /// Adds the gradients for one sample to `gradients`, given `delta`, the
+    /// gradient of the cost by the outputs before the sigmoid.
+    void backprop(std::span<const T> input, std::span<const T> delta,
+        Gradients& gradients) const;
+    /// moves the parameters against `gradients`, times `rate`
+    void descend(const Gradients& gradients, T rate);
+    void mutate(const MutationOptions& opts, NoiseGenerator& noise);
+
+    auto parameter_count() const -> size_t
+    {
+        return m_weights.size() + m_biases.size();
+    }
+    /// copies the weights, channel by channel, then the biases to `out`
+    void write_parameters(std::span<T> out) const;
+    /// the reverse of `write_parameters`
+    void read_parameters(std::span<const T> in);
+
+private:
+    template <typename>
+    friend class BasicConvLayer;
+
+    void tile_biases();
+
+    size_t m_channels;
+    /// tap by tap, with the weights of every channel for a tap together,
+    /// so a window is summed for all channels at once
+    std::vector<T> m_weights;
+    std::vector<T> m_biases;
+    /// `m_biases` repeated for every window, so one kernel call adds them
+    /// to the whole output
+    std::vector<T> m_window_biases;
+};
+
+/// A `BasicConvLayer` feeding a dense `BasicModel`, which takes boards
+/// encoded as `Encoding::Planes`.
+template <typename T>
+class BasicConvModel {
+public:
+    using DataEntry = typename BasicModel<T>::DataEntry;
+    using TrainOpts = typename BasicModel<T>::TrainOpts;
+
+    /// `layers` are the neurons per dense layer after the convolution,
+    /// outputs last
+    BasicConvModel(size_t channels, std::vector<size_t> layers, Rng& rng);
+    /// `dense` must take the outputs of `conv`
+    BasicConvModel(BasicConvLayer<T> conv, BasicModel<T> dense);
+
+    /// Buffers `feed` works in, so it doesn't have to allocate.
+    class Scratch {
+    public:
+        void fit(const BasicConvModel& model);
+
+    private:
+        friend class BasicConvModel;
+        std::vector<T> m_conv;
+        typename BasicModel<T>::Scratch m_dense;
+    };
+
+    /// Like `BasicModel::feed`. The returned outputs live in `scratch`.
+    auto feed(std::span<const T> input, Scratch& scratch) const
+        -> std::span<const T>;
+
+    /// Buffers `train_sgd` needs per thread, see `BasicModel::Workspace`.
+    class Workspace {
+    public:
+        void fit(const BasicConvModel& model);
+        void add(const Workspace& other);
+
+    private:
+        friend class BasicConvModel;
+        typename BasicConvLayer<T>::Gradients m_conv;
+        typename BasicModel<T>::Workspace m_dense;
+        std::vector<T> m_outputs;
+        std::vector<T> m_delta;
+    };
+
+    /// mini-batch stochastic gradient descent, like `BasicModel::train_sgd`
+    void train_sgd(std::span<const DataEntry> train_data,
+        std::span<const DataEntry> test_data, TrainOpts opts);
+    auto mean_squared_error(std::span<const DataEntry> data) const -> double;
+    /// adds the gradients of the cost for one sample to `workspace`
+    void backprop(std::span<const T> input, std::span<const T> correct,
+        Workspace& workspace) const;
+    void descend(const Workspace& gradients, T rate);
+    /// like `BasicModel::mutate`, the convolution included
+    void mutate(const MutationOptions& opts = { .rate = 0.6, .scale = 0.4 },
+        NoiseGenerator& noise = thread_noise());
+
+    auto conv() const -> const BasicConvLayer<T>&
+    {
+        return m_conv;
+    }
+    auto dense() const -> const BasicModel<T>&
+    {
+        return m_dense;
+    }
+    auto parameter_count() const -> size_t
+    {
+        return m_conv.parameter_count() + m_dense.parameter_count();
+    }
+
+private:
+    BasicConvLayer<T> m_conv;
+    BasicModel<T> m_dense;
+};
+
+using ConvLayer = BasicConvLayer<double>;
+using ConvLayerf = BasicConvLayer<float>;
+using ConvModel = BasicConvModel<double>;
+using ConvModelf = BasicConvModel<float>;
+
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef NN_EXPR_HPP
+#define NN_EXPR_HPP
+
+#include "nn_kernels.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace connect_four {
+
+/// Lazy element-wise expressions over Mx1 and Mx2, so chains like
+/// `w -= rate * gradient` or `out = sigmoid(product(w, x) + b)` run in one
+/// pass over memory without temporaries.
+///
+/// Assigning an expression evaluates it in blocks small enough to stay in
+/// L1, and every node fills a block with one kernel call, so fusing keeps
+/// the vectorized kernels.
+namespace expr {
+
+    /// values per evaluated block
+    constexpr size_t block_size = 128;
+
+    template <typename E>
+    concept Expression = requires(const E& e, typename E::Value* out) {
+        { e.size() } -> std::same_as<size_t>;
+        e.eval(size_t(), size_t(), out);
+    };
+
+    /// values already in memory, e.g. an Mx1
+    template <typename T>
+    struct Leaf {
+        using Value = T;
+        std::span<const T> values;
+
+        auto size() const -> size_t
+        {
+            return values.size();
+        }
+        /// writes values `begin..begin + n` to `out`
+        void eval(size_t begin, size_t n, T* out) const
+        {
+            std::copy_n(values.data() + begin, n, out);
+        }
+    };
+
+    template <typename E>
+    constexpr bool is_leaf = false;
+    template <typename T>
+    constexpr bool is_leaf<Leaf<T>> = true;
+
+    /// `matrix` · `vector`, evaluated a block of rows at a time
+    template <typename T>
+    struct Product {
+        using Value = T;
+        const T* matrix;
+        size_t rows;
+        size_t cols;
+        const T* vector;
+
+        auto size() const -> size_t
+        {
+            return rows;
+        }
+        void eval(size_t begin, size_t n, T* out) const
+        {
+            nn_kernels<T>().gemv(matrix + begin * cols, vector, out, n, cols);
+        }
+    };
+
+    /// one value from `func` per element, e.g. noise
+    template <typename T, typename F>
+    struct Generated {
+        using Value = T;
+        size_t count;
+        F func;
+
+        auto size() const -> size_t
+        {
+            return count;
+        }
+        void eval(size_t, size_t n, T* out) const
+        {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = func();
+        }
+    };
+
+    enum class Op {
+        Add,
+        Sub,
+        Mul,
+    };
+
+    template <Op op, Expression L, Expression R>
+    struct Binary {
+        using Value = typename L::Value;
+        static_assert(std::same_as<Value, typename R::Value>);
+        L lhs;
+        R rhs;
+
+        auto size() const -> size_t
+        {
+            return lhs.size();
+        }
+        void eval(size_t begin, size_t n, Value* out) const
+        {
+            lhs.eval(begin, n, out);
+            alignas(64) Value block[block_size];
+            const Value* values = block;
+            if constexpr (is_leaf<R>)
+                values = rhs.values.data() + begin;
+            else
+                rhs.eval(begin, n, block);
+
+            const auto& kernels = nn_kernels<Value>();
+            if constexpr (op == Op::Add)
+                kernels.add(out, values, n);
+            else if constexpr (op == Op::Sub)
+                kernels.sub(out, values, n);
+            else
+                kernels.mul(out, values, n);
+        }
+    };
+
+    template <Expression E>
+    struct Scaled {
+        using Value = typename E::Value;
+        Value factor;
+        E operand;
+
+        auto size() const -> size_t
+        {
+            return operand.size();
+        }
+        void eval(size_t begin, size_t n, Value* out) const
+        {
+            operand.eval(begin, n, out);
+            nn_kernels<Value>().scale(out, factor, n);
+        }
+    };
+
+    template <Expression E, typename F>
+    struct Map {
+        using Value = typename E::Value;
+        E operand;
+        F func;
+
+        auto size() const -> size_t
+        {
+            return operand.size();
+        }
+        void eval(size_t begin, size_t n, Value* out) const
+        {
+            operand.eval(begin, n, out);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = func(out[i]);
+        }
+    };
+
+    template <typename E>
+    constexpr bool is_scaled_leaf = false;
+    template <typename T>
+    constexpr bool is_scaled_leaf<Scaled<Leaf<T>>> = true;
+
+    template <typename E>
+    constexpr bool is_biased = false;
+    template <Expression L, typename T>
+    constexpr bool is_biased<Binary<Op::Add, L, Leaf<T>>> = true;
+
+    template <Expression E>
+    struct Sigmoid {
+        using Value = typename E::Value;
+        E operand;
+
+        auto size() const -> size_t
+        {
+            return operand.size();
+        }
+        void eval(size_t begin, size_t n, Value* out) const
+        {
+            const auto& kernels = nn_kernels<Value>();
+            // `sigmoid(x + bias)` adds the bias in the sigmoid kernel
+            if constexpr (is_biased<E>) {
+                operand.lhs.eval(begin, n, out);
+                kernels.bias_sigmoid(
+                    out, operand.rhs.values.data() + begin, n);
+            } else {
+                static constexpr Value zeros[block_size] {};
+                operand.eval(begin, n, out);
+                kernels.bias_sigmoid(out, zeros, n);
+            }
+        }
+    };
+
+    template <typename E>
+    auto as_expression(const E& operand)
+    {
+        if constexpr (Expression<E>)
+            return operand;
+        else
+            return Leaf { operand.span() };
+    }
+
+    /// an expression, or a matrix with `span()`
+    template <typename E>
+    concept Operand = Expression<E> || requires(const E& e) {
+        { Leaf { e.span() } } -> Expression;
+    };
+
+    template <Operand E>
+    using ValueOf = typename decltype(as_expression(
+        std::declval<const E&>()))::Value;
+
+    template <Operand L, Operand R>
+    auto operator+(const L& lhs, const R& rhs)
+    {
+        return Binary<Op::Add, decltype(as_expression(lhs)),
+            decltype(as_expression(rhs))> { as_expression(lhs),
+            as_expression(rhs) };
+    }
+
+    template <Operand L, Operand R>
+    auto operator-(const L& lhs, const R& rhs)
+    {
+        return Binary<Op::Sub, decltype(as_expression(lhs)),
+            decltype(as_expression(rhs))> { as_expression(lhs),
+            as_expression(rhs) };
+    }
+
+    /// element-wise
+    template <Operand L, Operand R>
+    auto operator*(const L& lhs, const R& rhs)
+    {
+        return Binary<Op::Mul, decltype(as_expression(lhs)),
+            decltype(as_expression(rhs))> { as_expression(lhs),
+            as_expression(rhs) };
+    }
+
+    template <Operand E>
+    auto operator*(ValueOf<E> factor, const E& operand)
+    {
+        return Scaled<decltype(as_expression(operand))> {
+            factor, as_expression(operand)
+        };
+    }
+
+    template <Operand E>
+    auto sigmoid(const E& operand)
+    {
+        return Sigmoid<decltype(as_expression(operand))> {
+            as_expression(operand)
+        };
+    }
+
+    /// `func` applied to every element
+    template <Operand E, typename F>
+    auto map(const E& operand, F func)
+    {
+        return Map<decltype(as_expression(operand)), F> {
+            as_expression(operand), std::move(func)
+        };
+    }
+
+    /// `count` values of `func()`
+    template <typename T, typename F>
+    auto generate(size_t count, F func)
+    {
+        return Generated<T, F> { count, std::move(func) };
+    }
+
+    /// `out` = `e`, through a block, so `e` may read `out`
+    template <Expression E>
+    void assign(std::span<typename E::Value> out, const E& e)
+    {
+        alignas(64) typename E::Value block[block_size];
+        for (size_t begin = 0; begin < out.size(); begin += block_size) {
+            auto n = std::min(block_size, out.size() - begin);
+            e.eval(begin, n, block);
+            std::copy_n(block, n, out.data() + begin);
+        }
+    }
+
+    /// `out` += `sign` * `e`
+    template <Expression E>
+    void add_to(std::span<typename E::Value> out, const E& e,
+        typename E::Value sign)
+    {
+        using T = typename E::Value;
+        const auto& kernels = nn_kernels<T>();
+        if constexpr (is_scaled_leaf<E>) {
+            kernels.axpy(out.data(), sign * e.factor,
+                e.operand.values.data(), out.size());
+        } else {
+            alignas(64) T block[block_size];
+            for (size_t begin = 0; begin < out.size(); begin += block_size) {
+                auto n = std::min(block_size, out.size() - begin);
+                e.eval(begin, n, block);
+                if (sign > 0)
+                    kernels.add(out.data() + begin, block, n);
+                else
+                    kernels.sub(out.data() + begin, block, n);
+            }
+        }
+    }
+
+}
+
+using expr::operator+;
+using expr::operator-;
+using expr::operator*;
+using expr::generate;
+using expr::map;
+using expr::sigmoid;
+
+}
+
+#endif
@@ -0,0 +1,330 @@
+#include "nn_file.hpp"
+#include "mapped_file.hpp"
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/mman.h>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+constexpr auto magic = std::array<uint8_t, 4> { 'C', '4', 'N', 'N' };
+constexpr uint32_t format_version = 1;
+constexpr size_t header_size = 40;
+constexpr size_t block_alignment = 64;
+
+enum class Scalar : uint32_t {
+    Double = 0,
+    Float = 1,
+};
+
+template <typename T>
+constexpr auto scalar_of() -> Scalar
+{
+    return std::is_same_v<T, double> ? Scalar::Double : Scalar::Float;
+}
+
+auto scalar_name(Scalar scalar) -> const char*
+{
+    return scalar == Scalar::Double ? "double" : "float";
+}
+
+auto scalar_size(Scalar scalar) -> size_t
+{
+    return scalar == Scalar::Double ? sizeof(double) : sizeof(float);
+}
+
+/// where the weights and the biases of every layer start in the payload,
+/// followed by the size of the payload
+auto block_offsets(const std::vector<size_t>& layers, size_t scalar_size)
+    -> std::vector<size_t>
+{
+    auto offsets = std::vector<size_t>();
+    size_t offset = 0;
+    for (size_t i = 0; i + 1 < layers.size(); ++i) {
+        offsets.push_back(offset);
+        offset += align(
+            layers[i + 1] * layers[i] * scalar_size, block_alignment);
+        offsets.push_back(offset);
+        offset += align(layers[i + 1] * scalar_size, block_alignment);
+    }
+    offsets.push_back(offset);
+    return offsets;
+}
+
+struct ModelFile {
+    MappedFile mapping;
+    Scalar scalar;
+    std::vector<size_t> layers;
+    /// `block_offsets` from the start of the file
+    std::vector<size_t> offsets;
+};
+
+/// Maps `path` and checks its header and checksum.
+auto map_model_file(const std::filesystem::path& path)
+    -> std::optional<ModelFile>
+{
+    auto file = ModelFile {
+        .mapping = MappedFile(path, header_size, "model"),
+        .scalar = Scalar::Double,
+        .layers = {},
+        .offsets = {},
+    };
+    if (!file.mapping.ok())
+        return {};
+    auto fail = [&](std::string_view problem) -> std::optional<ModelFile> {
+        std::cerr << std::format("'{}' {}\n", path.string(), problem);
+        return {};
+    };
+
+    const auto* data = file.mapping.data();
+    auto size = file.mapping.size();
+    if (std::memcmp(data, magic.data(), magic.size()) != 0)
+        return fail("is no model file");
+    if (read_value<uint32_t>(&data[4]) != format_version)
+        return fail(std::format("has format version {}, expected {}",
+            read_value<uint32_t>(&data[4]), format_version));
+    auto scalar = read_value<uint32_t>(&data[8]);
+    if (scalar > std::to_underlying(Scalar::Float))
+        return fail("has an unknown scalar type");
+    file.scalar = static_cast<Scalar>(scalar);
+
+    auto layer_count = size_t { read_value<uint32_t>(&data[12]) };
+    auto payload_offset = read_value<uint64_t>(&data[16]);
+    auto payload_size = read_value<uint64_t>(&data[24]);
+    if (layer_count < 2 || layer_count > (size - header_size) / 4)
+        return fail("is corrupt");
+    for (size_t i = 0; i < layer_count; ++i)
+        file.layers.push_back(
+            read_value<uint32_t>(&data[header_size + i * 4]));
+    // every neuron has a bias in the file
+    if (std::ranges::any_of(file.layers,
+            [&](size_t neurons) { return neurons == 0 || neurons > size; }))
+        return fail("is corrupt");
+
+    file.offsets = block_offsets(file.layers, scalar_size(file.scalar));
+    if (payload_offset % block_alignment != 0
+        || payload_offset < header_size + layer_count * 4
+        || payload_offset > size || payload_size != file.offsets.back()
+        || payload_size > size - payload_offset)
+        return fail("is corrupt");
+    auto checksum = read_value<uint64_t>(&data[32]);
+    if (fnv1a(&data[payload_offset], payload_size) != checksum)
+        return fail("has a wrong checksum");
+
+    for (auto& offset : file.offsets)
+        offset += payload_offset;
+    return file;
+}
+
+/// the model stored at `offsets` in `data`
+template <typename U>
+auto model_from(const uint8_t* data, const std::vector<size_t>& layers,
+    const std::vector<size_t>& offsets) -> BasicModel<U>
+{
+    auto model = BasicModel<U>(layers, zeroed);
+    auto parameters = std::vector<U>(model.parameter_count());
+    auto* out = reinterpret_cast<uint8_t*>(parameters.data());
+    for (size_t i = 0; i + 1 < layers.size(); ++i) {
+        auto weights = layers[i + 1] * layers[i] * sizeof(U);
+        auto biases = layers[i + 1] * sizeof(U);
+        std::memcpy(out, &data[offsets[i * 2]], weights);
+        std::memcpy(out + weights, &data[offsets[i * 2 + 1]], biases);
+        out += weights + biases;
+    }
+    model.read_parameters(parameters);
+    return model;
+}
+
+}
+
+template <typename T>
+auto connect_four::save_model(
+    const BasicModel<T>& model, const std::filesystem::path& path) -> bool
+{
+    const auto& layers = model.layers();
+    auto offsets = block_offsets(layers, sizeof(T));
+    auto payload_offset
+        = align(header_size + layers.size() * 4, block_alignment);
+    auto payload_size = offsets.back();
+
+    auto file = std::vector<uint8_t>(payload_offset + payload_size, 0);
+    auto* payload = &file[payload_offset];
+    for (size_t i = 0; i + 1 < layers.size(); ++i) {
+        auto weights = model.weights(i).span();
+        auto biases = model.biases(i).span();
+        std::memcpy(&payload[offsets[i * 2]], weights.data(),
+            weights.size_bytes());
+        std::memcpy(&payload[offsets[i * 2 + 1]], biases.data(),
+            biases.size_bytes());
+    }
+
+    std::memcpy(&file[0], magic.data(), magic.size());
+    write_value(&file[4], format_version);
+    write_value(&file[8], std::to_underlying(scalar_of<T>()));
+    write_value(&file[12], static_cast<uint32_t>(layers.size()));
+    write_value(&file[16], uint64_t { payload_offset });
+    write_value(&file[24], uint64_t { payload_size });
+    write_value(&file[32], fnv1a(payload, payload_size));
+    for (size_t i = 0; i < layers.size(); ++i)
+        write_value(
+            &file[header_size + i * 4], static_cast<uint32_t>(layers[i]));
+
+    auto temp = path;
+    temp += ".tmp";
+    auto* out = std::fopen(temp.c_str(), "wb");
+    if (!out) {
+        std::cerr << std::format(
+            "could not open '{}' for writing\n", temp.string());
+        return false;
+    }
+    bool written = std::fwrite(file.data(), 1, file.size(), out) == file.size();
+    written = std::fclose(out) == 0 && written;
+    auto error = std::error_code();
+    if (!written) {
+        std::cerr << std::format("could not write '{}'\n", temp.string());
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    std::filesystem::rename(temp, path, error);
+    if (error) {
+        std::cerr << std::format("could not rename '{}' to '{}': {}\n",
+            temp.string(), path.string(), error.message());
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+auto connect_four::load_model(const std::filesystem::path& path)
+    -> std::optional<BasicModel<T>>
+{
+    auto file = map_model_file(path);
+    if (!file)
+        return {};
+    const auto* data = file->mapping.data();
+    auto model = file->scalar == Scalar::Double
+        ? BasicModel<T>(model_from<double>(data, file->layers, file->offsets))
+        : BasicModel<T>(model_from<float>(data, file->layers, file->offsets));
+    return model;
+}
+
+template <typename T>
+auto connect_four::checkpoint_every(const BasicModel<T>& model,
+    std::filesystem::path path, size_t interval) -> std::function<void(size_t)>
+{
+    return [&model, path = std::move(path), interval](size_t epoch) {
+        if (interval != 0 && epoch % interval == 0)
+            save_model(model, path);
+    };
+}
+
+template <typename T>
+BasicMappedModel<T>::BasicMappedModel(const std::filesystem::path& path)
+{
+    auto file = map_model_file(path);
+    if (!file)
+        return;
+    m_file = std::move(file->mapping);
+    if (file->scalar != scalar_of<T>()) {
+        std::cerr << std::format("'{}' holds {} weights, not {}\n",
+            path.string(), scalar_name(file->scalar),
+            scalar_name(scalar_of<T>()));
+        return;
+    }
+    m_layers = std::move(file->layers);
+    m_offsets = std::move(file->offsets);
+    m_file.advise(MADV_WILLNEED);
+    m_ok = true;
+}
+
+template <typename T>
+void BasicMappedModel<T>::Scratch::fit(const BasicMappedModel& model)
+{
+    const auto& layers = model.m_layers;
+    auto widest = *std::max_element(layers.begin(), layers.end());
+    if (m_data.size() < widest * 2)
+        m_data.resize(widest * 2);
+}
+
+template <typename T>
+auto BasicMappedModel<T>::feed(std::span<const T> input,
+    Scratch& scratch) const -> std::span<const T>
+{
+    ASSERT_EQ(input.size(), m_layers.front());
+    const auto& kernels = nn_kernels<T>();
+    scratch.fit(*this);
+    auto half = scratch.m_data.size() / 2;
+    auto front = std::span(scratch.m_data).first(half);
+    auto back = std::span(scratch.m_data).subspan(half);
+
+    auto outputs = input;
+    for (size_t i = 0; i + 1 < m_layers.size(); ++i) {
+        auto rows = m_layers[i + 1];
+        auto cols = m_layers[i];
+        auto layer = front.first(rows);
+        kernels.gemv(weights(i).data(), outputs.data(), layer.data(), rows,
+            cols);
+        kernels.bias_sigmoid(layer.data(), biases(i).data(), rows);
+        outputs = layer;
+        std::swap(front, back);
+    }
+    return outputs;
+}
+
+template <typename T>
+auto BasicMappedModel<T>::weights(size_t layer) const -> std::span<const T>
+{
+    const auto* data = &m_file.data()[m_offsets[layer * 2]];
+    return { reinterpret_cast<const T*>(data),
+        m_layers[layer + 1] * m_layers[layer] };
+}
+
+template <typename T>
+auto BasicMappedModel<T>::biases(size_t layer) const -> std::span<const T>
+{
+    const auto* data = &m_file.data()[m_offsets[layer * 2 + 1]];
+    return { reinterpret_cast<const T*>(data),
+        m_layers[layer + 1] };
+}
+
+template <typename T>
+auto BasicMappedModel<T>::to_model() const -> BasicModel<T>
+{
+    return model_from<T>(m_file.data(), m_layers, m_offsets);
+}
+
+template auto connect_four::save_model<double>(
+    const Model& model, const std::filesystem::path& path) -> bool;
+template auto connect_four::save_model<float>(
+    const Modelf& model, const std::filesystem::path& path) -> bool;
+template auto connect_four::load_model<double>(
+    const std::filesystem::path& path) -> std::optional<Model>;
+template auto connect_four::load_model<float>(
+    const std::filesystem::path& path) -> std::optional<Modelf>;
+template auto connect_four::checkpoint_every<double>(const Model& model,
+    std::filesystem::path path, size_t interval)
+    -> std::function<void(size_t)>;
+template auto connect_four::checkpoint_every<float>(const Modelf& model,
+    std::filesystem::path path, size_t interval)
+    -> std::function<void(size_t)>;
+
+template class connect_four::BasicMappedModel<double>;
+template class connect_four::BasicMappedModel<float>;
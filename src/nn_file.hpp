@@ -0,0 +1,104 @@
+#ifndef NN_FILE_HPP
+#define NN_FILE_HPP
+
+#include "mapped_file.hpp"
+#include "nn_model.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+// A model file is a header
+//
+//     magic "C4NN" | u32 format version | u32 scalar type | u32 layers
+//     u64 payload offset | u64 payload bytes | u64 fnv-1a of payload
+//     u32 neurons per layer, inputs first...
+//
+// followed by the payload at a multiple of 64 bytes: for every layer but the
+// inputs, its weights row by row, then its biases, each block starting at a
+// multiple of 64 bytes. The scalar type is 0 for double and 1 for float. All
+// fields are in native byte order.
+
+/// Writes `model` to `path`. The file is written next to `path` and renamed
+/// over it when complete, so readers see either the old or the new model,
+/// and processes that mapped the old one keep it.
+template <typename T>
+auto save_model(const BasicModel<T>& model, const std::filesystem::path& path)
+    -> bool;
+
+/// Reads a model file into a standalone model, converting the weights to
+/// `T` if the file holds the other scalar type.
+template <typename T>
+auto load_model(const std::filesystem::path& path)
+    -> std::optional<BasicModel<T>>;
+
+/// A `TrainOpts::on_epoch` saving `model` to `path` every `interval`
+/// epochs. `model` must outlive the training.
+template <typename T>
+auto checkpoint_every(const BasicModel<T>& model,
+    std::filesystem::path path, size_t interval) -> std::function<void(size_t)>;
+
+/// A model file mapped read-only, for inference. The weights are used where
+/// they are in the mapping and never copied, so every process mapping the
+/// same file shares one resident copy, and opening it only costs the page
+/// faults.
+template <typename T>
+class BasicMappedModel {
+public:
+    /// fails if the file is corrupt or doesn't hold weights of type `T`
+    explicit BasicMappedModel(const std::filesystem::path& path);
+
+    BasicMappedModel(const BasicMappedModel&) = delete;
+    auto operator=(const BasicMappedModel&) -> BasicMappedModel& = delete;
+
+    auto ok() const -> bool
+    {
+        return m_ok;
+    }
+
+    /// Buffers `feed` works in, so it doesn't have to allocate.
+    class Scratch {
+    public:
+        void fit(const BasicMappedModel& model);
+
+    private:
+        friend class BasicMappedModel;
+        std::vector<T> m_data;
+    };
+
+    /// Like `BasicModel::feed`. The returned outputs live in `scratch`.
+    auto feed(std::span<const T> input, Scratch& scratch) const
+        -> std::span<const T>;
+
+    /// neurons per layer, inputs first
+    auto layers() const -> const std::vector<size_t>&
+    {
+        return m_layers;
+    }
+    /// weights from layer `layer` to layer `layer + 1`, row by row
+    auto weights(size_t layer) const -> std::span<const T>;
+    auto biases(size_t layer) const -> std::span<const T>;
+
+    /// a copy as a standalone model
+    auto to_model() const -> BasicModel<T>;
+
+private:
+    MappedFile m_file;
+    std::vector<size_t> m_layers;
+    /// where the weights, then the biases, of every layer start in
+    /// `m_file`
+    std::vector<size_t> m_offsets;
+    bool m_ok = false;
+};
+
+using MappedModel = BasicMappedModel<double>;
+using MappedModelf = BasicMappedModel<float>;
+
+}
+
+#endif
@@ -0,0 +1,437 @@
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+using namespace connect_four;
+
+namespace {
+
+namespace scalar {
+
+    template <typename T>
+    struct Ops {
+        static constexpr size_t width = 1;
+        using Reg = T;
+
+        static inline auto zero() -> Reg
+        {
+            return 0;
+        }
+        static inline auto set1(T v) -> Reg
+        {
+            return v;
+        }
+        static inline auto load(const T* p) -> Reg
+        {
+            return *p;
+        }
+        static inline void store(T* p, Reg v)
+        {
+            *p = v;
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return a + b;
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return a - b;
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return a * b;
+        }
+        static inline auto fmadd(Reg a, Reg b, Reg c) -> Reg
+        {
+            return a * b + c;
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return a / b;
+        }
+        static inline auto min(Reg a, Reg b) -> Reg
+        {
+            return a < b ? a : b;
+        }
+        static inline auto max(Reg a, Reg b) -> Reg
+        {
+            return a > b ? a : b;
+        }
+        /// 2^n, with the integer n in the low mantissa bits of `t`, as
+        /// `exp` leaves it after rounding with `ExpConstants::round_magic`
+        static inline auto pow2(Reg t) -> Reg
+        {
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                auto bits = std::bit_cast<uint64_t>(t);
+                return std::bit_cast<T>((bits + 1023) << 52);
+            } else {
+                auto bits = std::bit_cast<uint32_t>(t);
+                return std::bit_cast<T>((bits + 127) << 23);
+            }
+        }
+        static inline auto hsum(Reg a) -> T
+        {
+            return a;
+        }
+    };
+
+#include "nn_kernels_impl.hpp"
+
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+namespace avx2 {
+
+    template <typename T>
+    struct Ops;
+
+    template <>
+    struct Ops<double> {
+        static constexpr size_t width = 4;
+        using Reg = __m256d;
+
+        static inline auto zero() -> Reg
+        {
+            return _mm256_setzero_pd();
+        }
+        static inline auto set1(double v) -> Reg
+        {
+            return _mm256_set1_pd(v);
+        }
+        static inline auto load(const double* p) -> Reg
+        {
+            return _mm256_loadu_pd(p);
+        }
+        static inline void store(double* p, Reg v)
+        {
+            _mm256_storeu_pd(p, v);
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return _mm256_add_pd(a, b);
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return _mm256_sub_pd(a, b);
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return _mm256_mul_pd(a, b);
+        }
+        static inline auto fmadd(Reg a, Reg b, Reg c) -> Reg
+        {
+            return _mm256_fmadd_pd(a, b, c);
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return _mm256_div_pd(a, b);
+        }
+        static inline auto min(Reg a, Reg b) -> Reg
+        {
+            return _mm256_min_pd(a, b);
+        }
+        static inline auto max(Reg a, Reg b) -> Reg
+        {
+            return _mm256_max_pd(a, b);
+        }
+        static inline auto pow2(Reg t) -> Reg
+        {
+            auto bias = _mm256_set1_epi64x(1023);
+            auto bits = _mm256_add_epi64(_mm256_castpd_si256(t), bias);
+            return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+        }
+        static inline auto hsum(Reg a) -> double
+        {
+            auto v = _mm_add_pd(
+                _mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+            return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+        }
+    };
+
+    template <>
+    struct Ops<float> {
+        static constexpr size_t width = 8;
+        using Reg = __m256;
+
+        static inline auto zero() -> Reg
+        {
+            return _mm256_setzero_ps();
+        }
+        static inline auto set1(float v) -> Reg
+        {
+            return _mm256_set1_ps(v);
+        }
+        static inline auto load(const float* p) -> Reg
+        {
+            return _mm256_loadu_ps(p);
+        }
+        static inline void store(float* p, Reg v)
+        {
+            _mm256_storeu_ps(p, v);
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return _mm256_add_ps(a, b);
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return _mm256_sub_ps(a, b);
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return _mm256_mul_ps(a, b);
+        }
+        static inline auto fmadd(Reg a, Reg b, Reg c) -> Reg
+        {
+            return _mm256_fmadd_ps(a, b, c);
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return _mm256_div_ps(a, b);
+        }
+        static inline auto min(Reg a, Reg b) -> Reg
+        {
+            return _mm256_min_ps(a, b);
+        }
+        static inline auto max(Reg a, Reg b) -> Reg
+        {
+            return _mm256_max_ps(a, b);
+        }
+        static inline auto pow2(Reg t) -> Reg
+        {
+            auto bias = _mm256_set1_epi32(127);
+            auto bits = _mm256_add_epi32(_mm256_castps_si256(t), bias);
+            return _mm256_castsi256_ps(_mm256_slli_epi32(bits, 23));
+        }
+        static inline auto hsum(Reg a) -> float
+        {
+            // the lanes are summed in double, as the last few adds are
+            // where float loses the most
+            auto low = _mm256_cvtps_pd(_mm256_castps256_ps128(a));
+            auto high = _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1));
+            auto v = _mm256_add_pd(low, high);
+            return static_cast<float>(Ops<double>::hsum(v));
+        }
+    };
+
+#include "nn_kernels_impl.hpp"
+
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+namespace avx512 {
+
+    template <typename T>
+    struct Ops;
+
+    template <>
+    struct Ops<double> {
+        static constexpr size_t width = 8;
+        using Reg = __m512d;
+
+        static inline auto zero() -> Reg
+        {
+            return _mm512_setzero_pd();
+        }
+        static inline auto set1(double v) -> Reg
+        {
+            return _mm512_set1_pd(v);
+        }
+        static inline auto load(const double* p) -> Reg
+        {
+            return _mm512_loadu_pd(p);
+        }
+        static inline void store(double* p, Reg v)
+        {
+            _mm512_storeu_pd(p, v);
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return _mm512_add_pd(a, b);
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return _mm512_sub_pd(a, b);
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return _mm512_mul_pd(a, b);
+        }
+        static inline auto fmadd(Reg a, Reg b, Reg c) -> Reg
+        {
+            return _mm512_fmadd_pd(a, b, c);
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return _mm512_div_pd(a, b);
+        }
+        // the unmasked min, max and shifts trip -Wuninitialized on GCC 12
+        static constexpr __mmask8 all = 0xff;
+
+        static inline auto min(Reg a, Reg b) -> Reg
+        {
+            return _mm512_maskz_min_pd(all, a, b);
+        }
+        static inline auto max(Reg a, Reg b) -> Reg
+        {
+            return _mm512_maskz_max_pd(all, a, b);
+        }
+        static inline auto pow2(Reg t) -> Reg
+        {
+            auto bias = _mm512_set1_epi64(1023);
+            auto bits = _mm512_add_epi64(_mm512_castpd_si512(t), bias);
+            return _mm512_castsi512_pd(_mm512_maskz_slli_epi64(all, bits, 52));
+        }
+        static inline auto hsum(Reg a) -> double
+        {
+            // _mm512_reduce_add_pd trips -Wmaybe-uninitialized on GCC 12
+            alignas(64) double lanes[width];
+            _mm512_store_pd(lanes, a);
+            return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+                + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+        }
+    };
+
+    template <>
+    struct Ops<float> {
+        static constexpr size_t width = 16;
+        using Reg = __m512;
+
+        static inline auto zero() -> Reg
+        {
+            return _mm512_setzero_ps();
+        }
+        static inline auto set1(float v) -> Reg
+        {
+            return _mm512_set1_ps(v);
+        }
+        static inline auto load(const float* p) -> Reg
+        {
+            return _mm512_loadu_ps(p);
+        }
+        static inline void store(float* p, Reg v)
+        {
+            _mm512_storeu_ps(p, v);
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return _mm512_add_ps(a, b);
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return _mm512_sub_ps(a, b);
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return _mm512_mul_ps(a, b);
+        }
+        static inline auto fmadd(Reg a, Reg b, Reg c) -> Reg
+        {
+            return _mm512_fmadd_ps(a, b, c);
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return _mm512_div_ps(a, b);
+        }
+        static constexpr __mmask16 all = 0xffff;
+
+        static inline auto min(Reg a, Reg b) -> Reg
+        {
+            return _mm512_maskz_min_ps(all, a, b);
+        }
+        static inline auto max(Reg a, Reg b) -> Reg
+        {
+            return _mm512_maskz_max_ps(all, a, b);
+        }
+        static inline auto pow2(Reg t) -> Reg
+        {
+            auto bias = _mm512_set1_epi32(127);
+            auto bits = _mm512_add_epi32(_mm512_castps_si512(t), bias);
+            return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(all, bits, 23));
+        }
+        static inline auto hsum(Reg a) -> float
+        {
+            // through memory, as extracting the halves trips
+            // -Wuninitialized on GCC 12 like _mm512_reduce_add_pd
+            alignas(64) float lanes[width];
+            _mm512_store_ps(lanes, a);
+            auto v = _mm256_add_ps(
+                _mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+            auto sum = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)),
+                _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+            auto half = _mm_add_pd(_mm256_castpd256_pd128(sum),
+                _mm256_extractf128_pd(sum, 1));
+            return static_cast<float>(
+                _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half))));
+        }
+    };
+
+#include "nn_kernels_impl.hpp"
+
+}
+
+#pragma GCC pop_options
+
+template <typename T>
+auto supported_kernels(Isa isa) -> const NnKernels<T>*
+{
+    // the tables are only made once the CPU is known to support them, as
+    // making them runs code compiled for that instruction set
+    switch (isa) {
+        case Isa::Scalar: {
+            static const auto kernels = scalar::make_kernels<T>(isa);
+            return &kernels;
+        }
+        case Isa::Avx2: {
+            if (!__builtin_cpu_supports("avx2")
+                || !__builtin_cpu_supports("fma"))
+                return nullptr;
+            static const auto kernels = avx2::make_kernels<T>(isa);
+            return &kernels;
+        }
+        case Isa::Avx512: {
+            if (!__builtin_cpu_supports("avx512f"))
+                return nullptr;
+            static const auto kernels = avx512::make_kernels<T>(isa);
+            return &kernels;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+template <typename T>
+auto connect_four::nn_kernels() -> const NnKernels<T>&
+{
+    static const auto* best = [] {
+        for (auto isa : { Isa::Avx512, Isa::Avx2 }) {
+            if (const auto* kernels = supported_kernels<T>(isa))
+                return kernels;
+        }
+        return supported_kernels<T>(Isa::Scalar);
+    }();
+    return *best;
+}
+
+template <typename T>
+auto connect_four::nn_kernels_for(Isa isa) -> const NnKernels<T>*
+{
+    return supported_kernels<T>(isa);
+}
+
+template auto connect_four::nn_kernels<double>() -> const NnKernels<double>&;
+template auto connect_four::nn_kernels<float>() -> const NnKernels<float>&;
+template auto connect_four::nn_kernels_for<double>(Isa isa)
+    -> const NnKernels<double>*;
+template auto connect_four::nn_kernels_for<float>(Isa isa)
+    -> const NnKernels<float>*;
@@ -0,0 +1,79 @@
+#ifndef NN_KERNELS_HPP
+#define NN_KERNELS_HPP
+
+#include <cstddef>
+#include <string_view>
+
+namespace connect_four {
+
+enum class Isa {
+    Scalar,
+    Avx2,
+    Avx512,
+};
+
+[[maybe_unused]] inline auto isa_name(Isa isa) -> std::string_view
+{
+    switch (isa) {
+        case Isa::Scalar:
+            return "scalar";
+        case Isa::Avx2:
+            return "avx2";
+        case Isa::Avx512:
+            return "avx512";
+    }
+    return "unknown";
+}
+
+/// Vectorized loops of the neural net for one instruction set.
+///
+/// Matrices are row-major `rows x cols`, vectors are contiguous.
+template <typename T>
+struct NnKernels {
+    Isa isa;
+
+    /// out = m * v
+    void (*gemv)(const T* m, const T* v, T* out, size_t rows, size_t cols);
+    /// out = transpose(m) * v, so `v` has `rows` elements and `out` `cols`
+    void (*gemv_t)(const T* m, const T* v, T* out, size_t rows, size_t cols);
+    /// out = in * transpose(m), i.e. a gemv of `m` with each of the `batch`
+    /// rows of `in`, giving a `batch x rows` matrix
+    void (*gemm)(const T* in, const T* m, T* out, size_t batch, size_t rows,
+        size_t cols);
+    /// out = sigmoid(out + bias), with a polynomial e^x that is accurate to
+    /// the rounding of `T`
+    void (*bias_sigmoid)(T* out, const T* bias, size_t n);
+    /// delta *= the slope of the sigmoid, computed from its output
+    /// `activation` instead of its input
+    void (*sigmoid_backward)(T* delta, const T* activation, size_t n);
+
+    /// a += b
+    void (*add)(T* a, const T* b, size_t n);
+    /// a -= b
+    void (*sub)(T* a, const T* b, size_t n);
+    /// a *= b
+    void (*mul)(T* a, const T* b, size_t n);
+    /// a += alpha * b
+    void (*axpy)(T* a, T alpha, const T* b, size_t n);
+    /// a *= alpha
+    void (*scale)(T* a, T alpha, size_t n);
+
+    /// every row of m += v
+    void (*add_rows)(T* m, const T* v, size_t rows, size_t cols);
+    /// every row of m -= v
+    void (*sub_rows)(T* m, const T* v, size_t rows, size_t cols);
+    /// every row of m *= v
+    void (*mul_rows)(T* m, const T* v, size_t rows, size_t cols);
+};
+
+/// Kernels for the best instruction set the CPU supports.
+template <typename T>
+auto nn_kernels() -> const NnKernels<T>&;
+
+/// Kernels for `isa`, or nullptr if the CPU doesn't support it.
+template <typename T>
+auto nn_kernels_for(Isa isa) -> const NnKernels<T>*;
+
+}
+
+#endif
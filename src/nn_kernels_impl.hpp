@@ -0,0 +1,373 @@
+// Kernel bodies, generic over `Ops<T>`. Included once per instruction set by
+// nn_kernels.cpp, inside a namespace defining `Ops` and with the matching
+// target enabled, so this must not include anything itself.
+
+template <typename T>
+void gemv(const T* m, const T* v, T* out, size_t rows, size_t cols)
+{
+    using O = Ops<T>;
+    constexpr auto w = O::width;
+
+    size_t row = 0;
+    // four rows at a time, so every load of `v` is used four times
+    for (; row + 4 <= rows; row += 4) {
+        const T* r0 = m + row * cols;
+        const T* r1 = r0 + cols;
+        const T* r2 = r1 + cols;
+        const T* r3 = r2 + cols;
+        auto a0 = O::zero(), a1 = O::zero(), a2 = O::zero(), a3 = O::zero();
+        size_t col = 0;
+        for (; col + w <= cols; col += w) {
+            auto x = O::load(v + col);
+            a0 = O::fmadd(O::load(r0 + col), x, a0);
+            a1 = O::fmadd(O::load(r1 + col), x, a1);
+            a2 = O::fmadd(O::load(r2 + col), x, a2);
+            a3 = O::fmadd(O::load(r3 + col), x, a3);
+        }
+        T s0 = O::hsum(a0), s1 = O::hsum(a1), s2 = O::hsum(a2),
+          s3 = O::hsum(a3);
+        for (; col < cols; ++col) {
+            s0 += r0[col] * v[col];
+            s1 += r1[col] * v[col];
+            s2 += r2[col] * v[col];
+            s3 += r3[col] * v[col];
+        }
+        out[row] = s0;
+        out[row + 1] = s1;
+        out[row + 2] = s2;
+        out[row + 3] = s3;
+    }
+    for (; row < rows; ++row) {
+        const T* r = m + row * cols;
+        auto a = O::zero();
+        size_t col = 0;
+        for (; col + w <= cols; col += w)
+            a = O::fmadd(O::load(r + col), O::load(v + col), a);
+        T s = O::hsum(a);
+        for (; col < cols; ++col)
+            s += r[col] * v[col];
+        out[row] = s;
+    }
+}
+
+template <typename T>
+void gemv_t(const T* m, const T* v, T* out, size_t rows, size_t cols)
+{
+    using O = Ops<T>;
+    constexpr auto w = O::width;
+
+    // walks `m` row by row, adding each row scaled by its element of `v`,
+    // so the matrix is still read contiguously
+    for (size_t col = 0; col < cols; ++col)
+        out[col] = 0;
+    size_t row = 0;
+    for (; row + 4 <= rows; row += 4) {
+        const T* r0 = m + row * cols;
+        const T* r1 = r0 + cols;
+        const T* r2 = r1 + cols;
+        const T* r3 = r2 + cols;
+        auto x0 = O::set1(v[row]), x1 = O::set1(v[row + 1]),
+             x2 = O::set1(v[row + 2]), x3 = O::set1(v[row + 3]);
+        size_t col = 0;
+        for (; col + w <= cols; col += w) {
+            auto a = O::load(out + col);
+            a = O::fmadd(O::load(r0 + col), x0, a);
+            a = O::fmadd(O::load(r1 + col), x1, a);
+            a = O::fmadd(O::load(r2 + col), x2, a);
+            a = O::fmadd(O::load(r3 + col), x3, a);
+            O::store(out + col, a);
+        }
+        for (; col < cols; ++col)
+            out[col] += r0[col] * v[row] + r1[col] * v[row + 1]
+                + r2[col] * v[row + 2] + r3[col] * v[row + 3];
+    }
+    for (; row < rows; ++row) {
+        const T* r = m + row * cols;
+        auto x = O::set1(v[row]);
+        size_t col = 0;
+        for (; col + w <= cols; col += w) {
+            auto a = O::load(out + col);
+            O::store(out + col, O::fmadd(O::load(r + col), x, a));
+        }
+        for (; col < cols; ++col)
+            out[col] += r[col] * v[row];
+    }
+}
+
+/// `Batch` inputs times one panel, accumulating in registers
+template <typename T, size_t Batch>
+void gemm_panel(const T* in, const T* panel, T* out, size_t rows,
+    size_t cols, size_t panel_rows, size_t panel_cols, bool accumulate)
+{
+    using O = Ops<T>;
+    constexpr auto w = O::width;
+    constexpr auto nr = 2 * w;
+
+    typename O::Reg acc[Batch][2];
+    for (size_t b = 0; b < Batch; ++b) {
+        acc[b][0] = O::zero();
+        acc[b][1] = O::zero();
+    }
+
+    for (size_t col = 0; col < panel_cols; ++col) {
+        auto w0 = O::load(panel + col * nr);
+        auto w1 = O::load(panel + col * nr + w);
+        for (size_t b = 0; b < Batch; ++b) {
+            auto x = O::set1(in[b * cols + col]);
+            acc[b][0] = O::fmadd(x, w0, acc[b][0]);
+            acc[b][1] = O::fmadd(x, w1, acc[b][1]);
+        }
+    }
+
+    for (size_t b = 0; b < Batch; ++b) {
+        T sums[nr];
+        O::store(sums, acc[b][0]);
+        O::store(sums + w, acc[b][1]);
+        for (size_t r = 0; r < panel_rows; ++r)
+            out[b * rows + r] = accumulate ? out[b * rows + r] + sums[r]
+                                           : sums[r];
+    }
+}
+
+template <typename T>
+void gemm(const T* in, const T* m, T* out, size_t batch, size_t rows,
+    size_t cols)
+{
+    using O = Ops<T>;
+    // panels of `nr` matrix rows and up to `kc` columns are copied
+    // transposed, so every matrix column is two vectors the inputs are
+    // broadcast against, and no horizontal sums are needed
+    constexpr size_t nr = 2 * O::width;
+    constexpr size_t kc = 256;
+    if (batch < 4) {
+        // packing does not pay off for fewer inputs than a full tile
+        for (size_t b = 0; b < batch; ++b)
+            gemv(m, in + b * cols, out + b * rows, rows, cols);
+        return;
+    }
+    alignas(64) T panel[kc * nr];
+
+    for (size_t row = 0; row < rows; row += nr) {
+        auto panel_rows = rows - row < nr ? rows - row : nr;
+        for (size_t k = 0; k < cols; k += kc) {
+            auto panel_cols = cols - k < kc ? cols - k : kc;
+            for (size_t col = 0; col < panel_cols; ++col) {
+                for (size_t r = 0; r < nr; ++r)
+                    panel[col * nr + r]
+                        = r < panel_rows ? m[(row + r) * cols + k + col] : 0;
+            }
+
+            auto accumulate = k != 0;
+            size_t b = 0;
+            for (; b + 4 <= batch; b += 4)
+                gemm_panel<T, 4>(in + b * cols + k, panel,
+                    out + b * rows + row, rows, cols, panel_rows, panel_cols,
+                    accumulate);
+            for (; b < batch; ++b)
+                gemm_panel<T, 1>(in + b * cols + k, panel,
+                    out + b * rows + row, rows, cols, panel_rows, panel_cols,
+                    accumulate);
+        }
+    }
+}
+
+template <typename T>
+void add(T* a, const T* b, size_t n)
+{
+    using O = Ops<T>;
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(a + i, O::add(O::load(a + i), O::load(b + i)));
+    for (; i < n; ++i)
+        a[i] += b[i];
+}
+
+template <typename T>
+void sub(T* a, const T* b, size_t n)
+{
+    using O = Ops<T>;
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(a + i, O::sub(O::load(a + i), O::load(b + i)));
+    for (; i < n; ++i)
+        a[i] -= b[i];
+}
+
+template <typename T>
+void mul(T* a, const T* b, size_t n)
+{
+    using O = Ops<T>;
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(a + i, O::mul(O::load(a + i), O::load(b + i)));
+    for (; i < n; ++i)
+        a[i] *= b[i];
+}
+
+template <typename T>
+void axpy(T* a, T alpha, const T* b, size_t n)
+{
+    using O = Ops<T>;
+    auto va = O::set1(alpha);
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(a + i, O::fmadd(va, O::load(b + i), O::load(a + i)));
+    for (; i < n; ++i)
+        a[i] += alpha * b[i];
+}
+
+template <typename T>
+void scale(T* a, T alpha, size_t n)
+{
+    using O = Ops<T>;
+    auto va = O::set1(alpha);
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(a + i, O::mul(O::load(a + i), va));
+    for (; i < n; ++i)
+        a[i] *= alpha;
+}
+
+template <typename T>
+void add_rows(T* m, const T* v, size_t rows, size_t cols)
+{
+    for (size_t row = 0; row < rows; ++row)
+        add(m + row * cols, v, cols);
+}
+
+template <typename T>
+void sub_rows(T* m, const T* v, size_t rows, size_t cols)
+{
+    for (size_t row = 0; row < rows; ++row)
+        sub(m + row * cols, v, cols);
+}
+
+template <typename T>
+void mul_rows(T* m, const T* v, size_t rows, size_t cols)
+{
+    for (size_t row = 0; row < rows; ++row)
+        mul(m + row * cols, v, cols);
+}
+
+template <typename T>
+struct ExpConstants;
+
+template <>
+struct ExpConstants<double> {
+    /// past this e^x over- or underflows
+    static constexpr double limit = 708;
+    /// adding this rounds to an integer, which lands in the low mantissa
+    /// bits
+    static constexpr double round_magic = 0x1.8p52;
+    /// ln 2 split in two, so n * ln2_hi is exact
+    static constexpr double ln2_hi = 6.93145751953125e-1;
+    static constexpr double ln2_lo = 1.42860682030941723212e-6;
+    /// (ln 2 / 2)^13 / 13! * sqrt(2) < 2e-16, below double rounding
+    static constexpr int degree = 12;
+};
+
+template <>
+struct ExpConstants<float> {
+    static constexpr float limit = 87;
+    static constexpr float round_magic = 0x1.8p23f;
+    static constexpr float ln2_hi = 0.693359375f;
+    static constexpr float ln2_lo = -2.12194440e-4f;
+    /// (ln 2 / 2)^8 / 8! * sqrt(2) < 8e-9, below float rounding
+    static constexpr int degree = 7;
+};
+
+template <typename T>
+constexpr auto inverse_factorial(int k) -> T
+{
+    double factorial = 1;
+    for (int i = 2; i <= k; ++i)
+        factorial *= i;
+    return static_cast<T>(1 / factorial);
+}
+
+/// e^x as 2^n * e^r with |r| <= ln(2) / 2, and e^r as its Taylor series
+template <typename T>
+auto fast_exp(typename Ops<T>::Reg x) -> typename Ops<T>::Reg
+{
+    using O = Ops<T>;
+    using C = ExpConstants<T>;
+
+    x = O::min(O::max(x, O::set1(-C::limit)), O::set1(C::limit));
+    auto t = O::add(O::mul(x, O::set1(static_cast<T>(0x1.71547652b82fep0))),
+        O::set1(C::round_magic));
+    auto n = O::sub(t, O::set1(C::round_magic));
+    auto r = O::fmadd(n, O::set1(-C::ln2_hi), x);
+    r = O::fmadd(n, O::set1(-C::ln2_lo), r);
+
+    auto p = O::set1(inverse_factorial<T>(C::degree));
+    for (int k = C::degree - 1; k >= 0; --k)
+        p = O::fmadd(p, r, O::set1(inverse_factorial<T>(k)));
+    return O::mul(p, O::pow2(t));
+}
+
+/// `sigmoid` is mirrored, 1 / (1 + e^x)
+template <typename T>
+auto fast_sigmoid(typename Ops<T>::Reg x) -> typename Ops<T>::Reg
+{
+    using O = Ops<T>;
+    auto one = O::set1(1);
+    return O::div(one, O::add(one, fast_exp<T>(x)));
+}
+
+template <typename T>
+void bias_sigmoid(T* out, const T* bias, size_t n)
+{
+    using O = Ops<T>;
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width) {
+        auto z = O::add(O::load(out + i), O::load(bias + i));
+        O::store(out + i, fast_sigmoid<T>(z));
+    }
+    if (i == n)
+        return;
+    // the rest through a padded vector, so every element gets the same
+    // approximation
+    alignas(64) T rest[O::width] = {};
+    for (size_t j = i; j < n; ++j)
+        rest[j - i] = out[j] + bias[j];
+    O::store(rest, fast_sigmoid<T>(O::load(rest)));
+    for (size_t j = i; j < n; ++j)
+        out[j] = rest[j - i];
+}
+
+template <typename T>
+void sigmoid_backward(T* delta, const T* activation, size_t n)
+{
+    using O = Ops<T>;
+    // the slope of the mirrored sigmoid at `a` is -a * (1 - a)
+    auto one = O::set1(1);
+    size_t i = 0;
+    for (; i + O::width <= n; i += O::width) {
+        auto a = O::load(activation + i);
+        auto slope = O::mul(a, O::sub(a, one));
+        O::store(delta + i, O::mul(O::load(delta + i), slope));
+    }
+    for (; i < n; ++i)
+        delta[i] *= activation[i] * (activation[i] - 1);
+}
+
+template <typename T>
+auto make_kernels(Isa isa) -> NnKernels<T>
+{
+    return {
+        .isa = isa,
+        .gemv = gemv<T>,
+        .gemv_t = gemv_t<T>,
+        .gemm = gemm<T>,
+        .bias_sigmoid = bias_sigmoid<T>,
+        .sigmoid_backward = sigmoid_backward<T>,
+        .add = add<T>,
+        .sub = sub<T>,
+        .mul = mul<T>,
+        .axpy = axpy<T>,
+        .scale = scale<T>,
+        .add_rows = add_rows<T>,
+        .sub_rows = sub_rows<T>,
+        .mul_rows = mul_rows<T>,
+    };
+}
@@ -1,15 +1,22 @@
 #include "nn_model.hpp"
+#include "rng.hpp"
 #include <algorithm>
+#include <atomic>
+#include <barrier>
 #include <cmath>
 #include <cstdlib>
 #include <format>
+#include <functional>
 #include <iostream>
+#include <numeric>
 #include <print>
 #include <random>
+#include <thread>
 
 using namespace connect_four;
 
-void Mx1::print() const
+template <typename T>
+void BasicMx1<T>::print() const
 {
 
     std::cout << std::format("\u250c       \u2510\n");
@@ -19,7 +26,8 @@ void Mx1::print() const
     std::cout << std::format("\u2514       \u2518\n");
 }
 
-void Mx2::print() const
+template <typename T>
+void BasicMx2<T>::print() const
 {
     std::cout << "\u250c ";
     for (size_t row = 0; row < m_rows; ++row) {
@@ -29,7 +37,7 @@ void Mx2::print() const
     for (size_t col = 0; col < m_cols; ++col) {
         std::cout << "\u2502 ";
         for (size_t row = 0; row < m_rows; ++row) {
-            double v = this->at(row, col);
+            T v = this->at(row, col);
             if (v == 0) {
                 std::cout << "\x1b[90m";
             }
@@ -46,7 +54,7 @@ void Mx2::print() const
 
 double connect_four::randd(double min, double max)
 {
-    return min + (double)std::rand() / (RAND_MAX / (max - min));
+    return thread_rng().uniform(min, max);
 }
 
 double connect_four::randd_dec(void)
@@ -73,200 +81,430 @@ double connect_four::sigmoid(double x)
 double connect_four::sigmoid_deriv(double x)
 {
     // return x * (1 - x);
-    return sigmoid(x) * (1 - sigmoid(x));
+    // `sigmoid` is mirrored, 1 / (1 + e^x), so its slope is negative
+    auto s = sigmoid(x);
+    return -s * (1 - s);
 }
 
-Model::Model(std::vector<size_t> layers)
+float connect_four::sigmoid(float x)
+{
+    return 1.0f / (1.0f + std::exp(x));
+}
+
+float connect_four::sigmoid_deriv(float x)
+{
+    auto s = sigmoid(x);
+    return -s * (1 - s);
+}
+
+template <typename T>
+BasicModel<T>::BasicModel(std::vector<size_t> layers)
+    : BasicModel(std::move(layers), thread_rng())
+{
+}
+
+template <typename T>
+BasicModel<T>::BasicModel(std::vector<size_t> layers, Rng& random_gen)
+    : BasicModel(std::move(layers), zeroed)
+{
+    auto normal_dist = std::normal_distribution(0.0, 0.5);
+    auto draw = [&](T) { return static_cast<T>(normal_dist(random_gen)); };
+
+    for (size_t i = 0; i < m_layers.size() - 1; i++) {
+        m_weights[i].apply(draw);
+        m_biases[i].apply(draw);
+    }
+}
+
+template <typename T>
+BasicModel<T>::BasicModel(std::vector<size_t> layers, Zeroed)
     : m_layers(std::move(layers))
     , m_weights()
     , m_biases()
 {
     m_weights.reserve(m_layers.size() - 1);
     m_biases.reserve(m_layers.size() - 1);
-
-    auto random_dev = std::random_device();
-    auto random_gen = std::mt19937(random_dev());
-    auto normal_dist = std::normal_distribution(0.0, 0.5);
-
     for (size_t i = 0; i < m_layers.size() - 1; i++) {
         m_weights.emplace_back(m_layers[i + 1], m_layers[i]);
-        m_weights[i].apply([&](double) { return normal_dist(random_gen); });
         m_biases.emplace_back(m_layers[i + 1]);
-        m_biases[i].apply([&](double) { return normal_dist(random_gen); });
     }
 }
 
-auto Model::feed(const Mx1& inputs) -> Mx1
+template <typename T>
+void BasicModel<T>::Scratch::fit(const BasicModel& model, size_t batch)
 {
+    auto widest
+        = *std::max_element(model.m_layers.begin(), model.m_layers.end());
+    if (m_data.size() < widest * batch * 2)
+        m_data.resize(widest * batch * 2);
+}
+
+template <typename T>
+auto BasicModel<T>::feed(const Vector& inputs) const -> Vector
+{
+    auto scratch = Scratch();
+    auto outputs = feed(inputs.span(), scratch);
+    return Vector(std::vector(outputs.begin(), outputs.end()));
+}
+
+template <typename T>
+auto BasicModel<T>::feed(std::span<const T> inputs, Scratch& scratch) const
+    -> std::span<const T>
+{
+    scratch.fit(*this);
+    auto weighted = std::span(scratch.m_data).first(m_layers[1]);
+    m_weights[0].dot_into(inputs, weighted);
+    return feed_weighted(weighted, scratch);
+}
+
+template <typename T>
+auto BasicModel<T>::feed_weighted(
+    std::span<const T> weighted, Scratch& scratch) const -> std::span<const T>
+{
+    ASSERT_EQ(weighted.size(), m_layers[1]);
+    scratch.fit(*this);
+    auto half = scratch.m_data.size() / 2;
+    auto front = std::span(scratch.m_data).first(half);
+    auto back = std::span(scratch.m_data).subspan(half);
+
+    auto layer = front.first(m_layers[1]);
+    if (weighted.data() != layer.data())
+        std::copy(weighted.begin(), weighted.end(), layer.begin());
+    nn_kernels<T>().bias_sigmoid(
+        layer.data(), m_biases[0].span().data(), layer.size());
+    std::span<const T> outputs = layer;
+    std::swap(front, back);
+
+    for (size_t i = 1; i < m_layers.size() - 1; ++i) {
+        layer = front.first(m_layers[i + 1]);
+        m_weights[i].dot_into(outputs, layer);
+        nn_kernels<T>().bias_sigmoid(
+            layer.data(), m_biases[i].span().data(), layer.size());
+        outputs = layer;
+        std::swap(front, back);
+    }
+    return outputs;
+}
+
+template <typename T>
+auto BasicModel<T>::feed_batch(std::span<const T> inputs, size_t batch,
+    Scratch& scratch) const -> std::span<const T>
+{
+    ASSERT_EQ(inputs.size(), batch * m_layers[0]);
+    const auto& kernels = nn_kernels<T>();
+
+    scratch.fit(*this, batch);
+    auto half = scratch.m_data.size() / 2;
+    auto front = std::span(scratch.m_data).first(half);
+    auto back = std::span(scratch.m_data).subspan(half);
+
     auto outputs = inputs;
     for (size_t i = 0; i < m_layers.size() - 1; ++i) {
-        auto l1 = m_weights[i].dot(outputs);
-        l1 += m_biases[i];
-        l1.apply(sigmoid);
-        outputs = l1;
+        auto rows = m_layers[i + 1];
+        auto cols = m_layers[i];
+        auto layer = front.first(rows * batch);
+        kernels.gemm(outputs.data(), m_weights[i].data(), layer.data(), batch,
+            rows, cols);
+        for (size_t b = 0; b < batch; ++b)
+            kernels.bias_sigmoid(
+                &layer[b * rows], m_biases[i].span().data(), rows);
+        outputs = layer;
+        std::swap(front, back);
     }
     return outputs;
 }
 
-static inline double mutation_dec(double in)
+auto connect_four::next_model_version() -> uint64_t
 {
-    (void)in;
-    double r = randd_dec();
-    if (r > 0.5) {
-        double v = pow(r * 2.0, 2.0) / 4.0;
-        return v > 0.5 ? v : 0.0;
-    } else {
-        double v = pow((1.0 - r) * 2.0, 2.0) / 4.0;
-        return v > 0.5 ? -v : 0.0;
-    }
+    static auto version = std::atomic<uint64_t>(0);
+    return version.fetch_add(1, std::memory_order_relaxed) + 1;
 }
 
-void Model::mutate()
+template <typename T>
+void BasicModel<T>::mutate(const MutationOptions& opts, NoiseGenerator& noise)
 {
-    double learning_rate = 0.5;
+    m_version = next_model_version();
+    for (auto& layer_weights : m_weights)
+        noise.mutate(layer_weights.span(), opts);
+    for (auto& layer_bias : m_biases)
+        noise.mutate(layer_bias.span(), opts);
+}
 
-    for (auto& layer_weights : m_weights) {
-        auto mutation = Mx2(layer_weights.rows(), layer_weights.cols());
-        mutation.apply(mutation_dec);
-        mutation *= learning_rate;
-        layer_weights += mutation;
-    }
+template <typename T>
+auto BasicModel<T>::parameter_count() const -> size_t
+{
+    size_t count = 0;
+    for (size_t i = 0; i < m_weights.size(); ++i)
+        count += m_weights[i].span().size() + m_biases[i].cols();
+    return count;
+}
 
-    for (auto& layer_bias : m_biases) {
-        auto mutation = Mx1(layer_bias.cols());
-        mutation.apply(mutation_dec);
-        mutation *= learning_rate;
-        layer_bias += mutation;
+template <typename T>
+void BasicModel<T>::write_parameters(std::span<T> out) const
+{
+    ASSERT_EQ(out.size(), parameter_count());
+    for (size_t i = 0; i < m_weights.size(); ++i) {
+        for (auto in : { m_weights[i].span(), m_biases[i].span() }) {
+            std::copy(in.begin(), in.end(), out.begin());
+            out = out.subspan(in.size());
+        }
     }
 }
 
-void Model::train_sgd(Data train_data, const Data& test_data, TrainOpts opts)
+template <typename T>
+void BasicModel<T>::read_parameters(std::span<const T> in)
 {
-    // http://neuralnetworksanddeeplearning.com/chap1.html
-    auto random_dev = std::random_device();
-    auto random_gen = std::mt19937(random_dev());
-
-    for (size_t epoch = 0; epoch < opts.epochs; ++epoch) {
-        std::shuffle(train_data.begin(), train_data.end(), random_gen);
-
-        //  mini_batches = [
-        //      training_data[k:k+mini_batch_size]
-        //      for k in xrange(0, n, mini_batch_size)]
-        //  for mini_batch in mini_batches:
-        //      self.update_mini_batch(mini_batch, eta)
-        //
-        for (size_t batch = 0; batch < train_data.size();
-            batch += opts.batch_size) {
+    ASSERT_EQ(in.size(), parameter_count());
+    m_version = next_model_version();
+    for (size_t i = 0; i < m_weights.size(); ++i) {
+        for (auto out : { m_weights[i].span(), m_biases[i].span() }) {
+            std::copy_n(in.begin(), out.size(), out.begin());
+            in = in.subspan(out.size());
+        }
+    }
+}
 
-            auto [n_weights, n_biases] = zeroed_weights_biases();
+void connect_four::run_batches(size_t epochs, size_t threads,
+    const std::function<size_t()>& next_batch,
+    const std::function<void(size_t index, size_t thread)>& sample,
+    const std::function<void(size_t batch)>& step,
+    const std::function<void(size_t epoch)>& end_epoch)
+{
+    if (epochs == 0)
+        return;
+    threads = std::max<size_t>(threads, 1);
+
+    size_t epoch = 0;
+    size_t batch = next_batch();
+    if (batch == 0)
+        return;
+
+    // runs on one thread once all threads have finished their share of the
+    // mini-batch
+    auto completion = [&]() noexcept {
+        step(batch);
+
+        batch = next_batch();
+        if (batch != 0)
+            return;
+        epoch += 1;
+        end_epoch(epoch);
+        if (epoch < epochs)
+            batch = next_batch();
+        // an epoch without mini-batches ends the training
+        if (batch == 0)
+            epoch = epochs;
+    };
+    auto barrier
+        = std::barrier(static_cast<std::ptrdiff_t>(threads), completion);
+
+    auto work = [&](size_t thread) {
+        while (epoch < epochs) {
+            auto begin = batch * thread / threads;
+            auto end = batch * (thread + 1) / threads;
+            for (auto i = begin; i < end; ++i)
+                sample(i, thread);
+            barrier.arrive_and_wait();
+        }
+    };
 
-            for (const auto& [input, correct] : train_data) {
-                auto [dn_weights, dn_biases] = backprop(input, correct);
+    auto workers = std::vector<std::jthread>();
+    workers.reserve(threads - 1);
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(work, i);
+    work(0);
+}
 
-                // nabla_w = [nw+dnw for nw, dnw in zip(nabla_w, delta_nabla_w)]
-                for (size_t i = 0; i < n_weights.size(); ++i)
-                    n_weights[i] += dn_weights[i];
+template <typename T>
+ShuffledBatches<T>::ShuffledBatches(
+    std::span<const DataEntry> data, size_t batch_size)
+    : m_data(data)
+    , m_batch_size(std::max<size_t>(batch_size, 1))
+    , m_order(data.size())
+    , m_rng(thread_rng())
+{
+    std::iota(m_order.begin(), m_order.end(), 0);
+    std::shuffle(m_order.begin(), m_order.end(), m_rng);
+}
 
-                // nabla_b = [nb+dnb for nb, dnb in zip(nabla_b, delta_nabla_b)]
-                for (size_t i = 0; i < n_biases.size(); ++i)
-                    n_biases[i] += dn_biases[i];
-            }
+template <typename T>
+auto ShuffledBatches<T>::next() -> size_t
+{
+    if (m_end == m_order.size()) {
+        m_begin = 0;
+        m_end = 0;
+        std::shuffle(m_order.begin(), m_order.end(), m_rng);
+        return 0;
+    }
+    m_begin = m_end;
+    m_end = std::min(m_begin + m_batch_size, m_order.size());
+    return m_end - m_begin;
+}
 
-            auto batch_learn_rate = opts.learn_rate * (double)opts.batch_size;
+template <typename T>
+void BasicModel<T>::train_sgd(std::span<const DataEntry> train_data,
+    std::span<const DataEntry> test_data, TrainOpts opts)
+{
+    // http://neuralnetworksanddeeplearning.com/chap1.html
+    if (opts.epochs == 0 || opts.batch_size == 0 || train_data.empty())
+        return;
+    auto batches = ShuffledBatches<T>(train_data, opts.batch_size);
+    auto on_epoch = [&](size_t epoch) {
+        if (!test_data.empty())
+            std::println("epoch {}/{} done, loss mse: {:.3f}", epoch - 1,
+                opts.epochs, mean_squared_error(test_data));
+        if (opts.on_epoch)
+            opts.on_epoch(epoch);
+    };
+    connect_four::train_sgd(*this, batches,
+        {
+            .epochs = opts.epochs,
+            .learn_rate = opts.learn_rate,
+            .threads = opts.threads,
+            .on_epoch = on_epoch,
+        });
+}
 
-            for (size_t i = 0; i < m_weights.size(); ++i) {
-                auto v = n_weights[i];
-                v *= batch_learn_rate;
-                m_weights[i] -= v;
-            }
+template <typename T>
+void BasicModel<T>::descend(const Workspace& gradients, T rate)
+{
+    for (size_t i = 0; i < m_weights.size(); ++i) {
+        m_weights[i] -= rate * gradients.m_weight_gradients[i];
+        m_biases[i] -= rate * gradients.m_bias_gradients[i];
+    }
+    m_version = next_model_version();
+}
 
-            for (size_t i = 0; i < m_biases.size(); ++i) {
-                auto v = n_biases[i];
-                v *= batch_learn_rate;
-                m_biases[i] -= v;
-            }
+template <typename T>
+auto BasicModel<T>::mean_squared_error(std::span<const DataEntry> data) const
+    -> double
+{
+    constexpr size_t max_batch = 256;
+    auto inputs = m_layers.front();
+    auto outputs = m_layers.back();
+    auto batch_inputs = std::vector<T>(max_batch * inputs);
+    auto scratch = Scratch();
+
+    double square_error = 0;
+    for (size_t begin = 0; begin < data.size(); begin += max_batch) {
+        auto batch = std::min(max_batch, data.size() - begin);
+        for (size_t b = 0; b < batch; ++b) {
+            auto input = data[begin + b].input.span();
+            std::copy(input.begin(), input.end(), &batch_inputs[b * inputs]);
         }
-        double sqaure_error = 0;
-        for (const auto& [input, correct] : test_data) {
-            auto output = feed(input);
-            output -= correct;
-            sqaure_error += std::pow(output.sum(), 2);
+        auto results = feed_batch(
+            std::span(batch_inputs).first(batch * inputs), batch, scratch);
+        for (size_t b = 0; b < batch; ++b) {
+            const auto& correct = data[begin + b].correct;
+            for (size_t i = 0; i < outputs; ++i) {
+                auto error = results[b * outputs + i] - correct[i];
+                square_error += error * error;
+            }
         }
-        auto mse = sqaure_error / static_cast<double>(test_data.size());
-        std::println(
-            "epoch {}/{} done, loss mse: {:.3f}", epoch, opts.epochs, mse);
     }
+    return square_error / static_cast<double>(data.size() * outputs);
 }
 
-auto Model::backprop(const Mx1& input, const Mx1& correct)
-    -> std::tuple<std::vector<Mx2>, std::vector<Mx1>>
+template <typename T>
+void BasicModel<T>::backprop(std::span<const T> input,
+    std::span<const T> correct, Workspace& workspace,
+    std::span<T> input_delta) const
 {
-    auto [n_weights, n_biases] = zeroed_weights_biases();
-
-    // forward pass
-    auto activation = input;
-    auto activations = std::vector { input };
-    auto zs = std::vector<Mx1>();
-    for (size_t layer = 0; layer < m_layers.size() - 1; ++layer) {
-        auto z = m_weights[layer].dot(activation);
-        z += m_biases[layer];
-        zs.push_back(z);
-        z.apply(sigmoid);
-        activation = z;
-        activations.push_back(activation);
+    const auto& kernels = nn_kernels<T>();
+    auto layers = m_layers.size();
+    auto activation = [&](size_t layer) {
+        return std::span(workspace.m_activations)
+            .subspan(workspace.m_offsets[layer], m_layers[layer]);
+    };
+
+    // forward pass, the weighted inputs aren't kept, as the sigmoid's slope
+    // follows from its output
+    std::copy(input.begin(), input.end(), activation(0).begin());
+    for (size_t layer = 1; layer < layers; ++layer) {
+        auto layer_activation = activation(layer);
+        m_weights[layer - 1].dot_into(activation(layer - 1), layer_activation);
+        kernels.bias_sigmoid(layer_activation.data(),
+            m_biases[layer - 1].span().data(), layer_activation.size());
     }
 
     // backward pass
-    auto delta = activations[activations.size() - 1];
-    delta -= correct;
-    auto last_z = zs[zs.size() - 1];
-    last_z.apply(sigmoid_deriv);
-    delta *= last_z;
-
-    auto new_n_weights = Mx2(n_weights[n_weights.size() - 1].rows(),
-        n_weights[n_weights.size() - 1].cols());
-    new_n_weights += activations[activations.size() - 2];
-    new_n_weights *= delta;
-
-    n_weights[n_weights.size() - 1] = new_n_weights;
-    n_biases[n_biases.size() - 1] = delta;
-
-    for (size_t layer = 2; layer < m_layers.size(); ++layer) {
-        auto z = zs[zs.size() - layer];
-        auto sp = z;
-        sp.apply(sigmoid_deriv);
-        auto weights_T = m_weights[m_weights.size() - layer + 1];
-        weights_T.transpose();
-        delta = weights_T.dot(delta);
-        delta *= sp;
-
-        auto& last_n_weights = n_weights[m_weights.size() - layer];
-        auto v = Mx2(last_n_weights.rows(), last_n_weights.cols());
-        v += activations[activations.size() - layer + 1];
-        v.transpose();
-        v *= delta;
-
-        last_n_weights = v;
-        n_biases[n_biases.size() - layer] = delta;
-    }
+    auto half = workspace.m_deltas.size() / 2;
+    auto front = std::span(workspace.m_deltas).first(half);
+    auto back = std::span(workspace.m_deltas).subspan(half);
+    auto delta = front.first(m_layers.back());
+    auto output = activation(layers - 1);
+    std::copy(output.begin(), output.end(), delta.begin());
+    kernels.sub(delta.data(), correct.data(), delta.size());
+    kernels.sigmoid_backward(delta.data(), output.data(), delta.size());
+
+    for (size_t layer = layers - 1; layer > 0; --layer) {
+        // nabla_w[-l] = np.dot(delta, activations[-l-1].transpose())
+        workspace.m_weight_gradients[layer - 1].add_outer(
+            delta, activation(layer - 1));
+        kernels.add(workspace.m_bias_gradients[layer - 1].span().data(),
+            delta.data(), delta.size());
+        if (layer == 1) {
+            if (!input_delta.empty())
+                m_weights[0].dot_transposed_into(delta, input_delta);
+            break;
+        }
 
-    return { n_weights, n_biases };
+        // delta = np.dot(self.weights[-l+1].transpose(), delta) * sp
+        auto next_delta = back.first(m_layers[layer - 1]);
+        m_weights[layer - 1].dot_transposed_into(delta, next_delta);
+        kernels.sigmoid_backward(next_delta.data(),
+            activation(layer - 1).data(), next_delta.size());
+        delta = next_delta;
+        std::swap(front, back);
+    }
 }
 
-auto Model::zeroed_weights_biases()
-    -> std::tuple<std::vector<Mx2>, std::vector<Mx1>>
+template <typename T>
+void BasicModel<T>::Workspace::add(const Workspace& other)
 {
+    for (size_t i = 0; i < m_weight_gradients.size(); ++i) {
+        m_weight_gradients[i] += other.m_weight_gradients[i];
+        m_bias_gradients[i] += other.m_bias_gradients[i];
+    }
+}
 
-    // nabla_w = [np.zeros(w.shape) for w in self.weights]
-    auto n_weights = std::vector<Mx2>();
-    n_weights.reserve(m_weights.size());
-    for (auto& weights : m_weights)
-        n_weights.emplace_back(weights.rows(), weights.cols());
-
-    // nabla_b = [np.zeros(b.shape) for b in self.biases]
-    auto n_biases = std::vector<Mx1>();
-    n_biases.reserve(m_weights.size());
-    for (auto& biases : m_biases)
-        n_biases.emplace_back(biases.cols());
-    return { n_weights, n_biases };
+template <typename T>
+void BasicModel<T>::Workspace::fit(const BasicModel& model)
+{
+    const auto& layers = model.m_layers;
+    m_offsets.resize(layers.size() + 1);
+    m_offsets[0] = 0;
+    std::partial_sum(layers.begin(), layers.end(), m_offsets.begin() + 1);
+    m_activations.resize(m_offsets.back());
+    auto widest = *std::max_element(layers.begin(), layers.end());
+    m_deltas.resize(widest * 2);
+
+    auto fits = m_weight_gradients.size() == model.m_weights.size();
+    for (size_t i = 0; fits && i < model.m_weights.size(); ++i)
+        fits = m_weight_gradients[i].rows() == model.m_weights[i].rows()
+            && m_weight_gradients[i].cols() == model.m_weights[i].cols();
+    if (!fits) {
+        // nabla_w = [np.zeros(w.shape) for w in self.weights]
+        m_weight_gradients.clear();
+        for (const auto& weights : model.m_weights)
+            m_weight_gradients.emplace_back(weights.rows(), weights.cols());
+        // nabla_b = [np.zeros(b.shape) for b in self.biases]
+        m_bias_gradients.clear();
+        for (const auto& biases : model.m_biases)
+            m_bias_gradients.emplace_back(biases.cols());
+        return;
+    }
+    for (auto& weights : m_weight_gradients)
+        weights.apply([](T) { return T(0); });
+    for (auto& biases : m_bias_gradients)
+        biases.apply([](T) { return T(0); });
 }
+
+template class connect_four::BasicModel<double>;
+template class connect_four::BasicModel<float>;
+template class connect_four::ShuffledBatches<double>;
+template class connect_four::ShuffledBatches<float>;
+template void connect_four::BasicMx1<double>::print() const;
+template void connect_four::BasicMx1<float>::print() const;
+template void connect_four::BasicMx2<double>::print() const;
+template void connect_four::BasicMx2<float>::print() const;
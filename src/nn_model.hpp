@@ -1,10 +1,19 @@
 #ifndef NN_MODEL_HPP
 #define NN_MODEL_HPP
 
+#include "nn_expr.hpp"
+#include "nn_kernels.hpp"
+#include "nn_noise.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <format>
+#include <functional>
 #include <iostream>
 #include <numeric>
 #include <random>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -19,26 +28,35 @@ namespace connect_four {
         }                                                                      \
     }
 
-class Mx1 {
+template <typename T>
+class BasicMx1 {
 public:
-    Mx1(size_t cols)
+    BasicMx1(size_t cols)
         : m_cols(cols)
-        , m_data(cols, 0.0)
+        , m_data(cols, T(0))
     {
     }
 
-    Mx1(std::vector<double>&& data)
+    BasicMx1(std::vector<T>&& data)
         : m_cols(data.size())
         , m_data(std::move(data))
     {
     }
 
-    auto operator[](size_t col) const -> double
+    /// converts every element to `T`
+    template <typename U>
+    explicit BasicMx1(const BasicMx1<U>& other)
+        : m_cols(other.cols())
+        , m_data(other.span().begin(), other.span().end())
+    {
+    }
+
+    auto operator[](size_t col) const -> T
     {
         return m_data[col];
     }
 
-    auto operator[](size_t col) -> double&
+    auto operator[](size_t col) -> T&
     {
         return m_data[col];
     }
@@ -49,54 +67,72 @@ public:
             v = func(v);
     }
 
-    void operator+=(const Mx1& rhs)
+    /// evaluates `rhs` in one pass, see nn_expr.hpp
+    template <expr::Expression E>
+    auto operator=(const E& rhs) -> BasicMx1&
+    {
+        ASSERT_EQ(m_cols, rhs.size());
+        expr::assign(span(), rhs);
+        return *this;
+    }
+    template <expr::Expression E>
+    void operator+=(const E& rhs)
+    {
+        ASSERT_EQ(m_cols, rhs.size());
+        expr::add_to(span(), rhs, T(1));
+    }
+    template <expr::Expression E>
+    void operator-=(const E& rhs)
+    {
+        ASSERT_EQ(m_cols, rhs.size());
+        expr::add_to(span(), rhs, T(-1));
+    }
+
+    void operator+=(const BasicMx1& rhs)
     {
         ASSERT_EQ(m_cols, rhs.m_cols);
-        for (size_t i = 0; i < m_data.size(); ++i)
-            m_data[i] += rhs.m_data[i];
+        nn_kernels<T>().add(m_data.data(), rhs.m_data.data(), m_cols);
     }
-    void operator-=(const Mx1& rhs)
+    void operator-=(const BasicMx1& rhs)
     {
         ASSERT_EQ(m_cols, rhs.m_cols);
-        for (size_t i = 0; i < m_data.size(); ++i)
-            m_data[i] -= rhs.m_data[i];
+        nn_kernels<T>().sub(m_data.data(), rhs.m_data.data(), m_cols);
     }
-    void operator*=(const Mx1& rhs)
+    void operator*=(const BasicMx1& rhs)
     {
         ASSERT_EQ(m_cols, rhs.m_cols);
-        for (size_t i = 0; i < m_data.size(); ++i)
-            m_data[i] *= rhs.m_data[i];
+        nn_kernels<T>().mul(m_data.data(), rhs.m_data.data(), m_cols);
     }
 
-    void operator+=(double rhs)
+    void operator+=(T rhs)
     {
         for (auto& v : m_data)
             v += rhs;
     }
-    void operator-=(double rhs)
+    void operator-=(T rhs)
     {
         for (auto& v : m_data)
             v -= rhs;
     }
-    void operator*=(double rhs)
+    void operator*=(T rhs)
     {
-        for (auto& v : m_data)
-            v *= rhs;
+        nn_kernels<T>().scale(m_data.data(), rhs, m_data.size());
     }
 
-    auto dot(const Mx1& rhs) const -> double
+    auto dot(const BasicMx1& rhs) const -> T
     {
         ASSERT_EQ(m_cols, rhs.cols());
         double res = 0;
         for (size_t col = 0; col < m_cols; ++col) {
-            res += m_data[col] * rhs[col];
+            res += static_cast<double>(m_data[col]) * rhs[col];
         }
-        return res;
+        return static_cast<T>(res);
     }
 
-    auto sum() const -> double
+    auto sum() const -> T
     {
-        return std::accumulate(m_data.begin(), m_data.end(), 0.0);
+        return static_cast<T>(
+            std::accumulate(m_data.begin(), m_data.end(), 0.0));
     }
 
     void print() const;
@@ -106,26 +142,79 @@ public:
         return m_cols;
     }
 
+    auto span() const -> std::span<const T>
+    {
+        return m_data;
+    }
+
+    auto span() -> std::span<T>
+    {
+        return m_data;
+    }
+
 private:
     size_t m_cols;
-    std::vector<double> m_data;
+    std::vector<T> m_data;
+};
+
+/// Mx1 storing its values inline, for sizes known at compile time.
+template <size_t Cols, typename T = double>
+class FixedMx1 {
+public:
+    auto operator[](size_t col) const -> T
+    {
+        return m_data[col];
+    }
+
+    auto operator[](size_t col) -> T&
+    {
+        return m_data[col];
+    }
+
+    static constexpr auto cols() -> size_t
+    {
+        return Cols;
+    }
+
+    auto span() const -> std::span<const T>
+    {
+        return m_data;
+    }
+
+    auto span() -> std::span<T>
+    {
+        return m_data;
+    }
+
+private:
+    std::array<T, Cols> m_data {};
 };
 
-class Mx2 {
+template <typename T>
+class BasicMx2 {
 public:
-    Mx2(size_t rows, size_t cols)
+    BasicMx2(size_t rows, size_t cols)
         : m_rows(rows)
         , m_cols(cols)
-        , m_data(rows * cols, 0.0)
+        , m_data(rows * cols, T(0))
+    {
+    }
+
+    /// converts every element to `T`
+    template <typename U>
+    explicit BasicMx2(const BasicMx2<U>& other)
+        : m_rows(other.rows())
+        , m_cols(other.cols())
+        , m_data(other.data(), other.data() + m_rows * m_cols)
     {
     }
 
-    auto at(size_t row, size_t col) const -> double
+    auto at(size_t row, size_t col) const -> T
     {
         return m_data[row * m_cols + col];
     }
 
-    auto at(size_t row, size_t col) -> double&
+    auto at(size_t row, size_t col) -> T&
     {
         return m_data[row * m_cols + col];
     }
@@ -136,93 +225,130 @@ public:
             v = func(v);
     }
 
-    void operator+=(const Mx2& rhs)
+    /// evaluates `rhs` in one pass over the elements, see nn_expr.hpp
+    template <expr::Expression E>
+    auto operator=(const E& rhs) -> BasicMx2&
+    {
+        ASSERT_EQ(m_data.size(), rhs.size());
+        expr::assign(span(), rhs);
+        return *this;
+    }
+    template <expr::Expression E>
+    void operator+=(const E& rhs)
+    {
+        ASSERT_EQ(m_data.size(), rhs.size());
+        expr::add_to(span(), rhs, T(1));
+    }
+    template <expr::Expression E>
+    void operator-=(const E& rhs)
+    {
+        ASSERT_EQ(m_data.size(), rhs.size());
+        expr::add_to(span(), rhs, T(-1));
+    }
+
+    void operator+=(const BasicMx2& rhs)
     {
         ASSERT_EQ(m_rows, rhs.m_rows);
         ASSERT_EQ(m_cols, rhs.m_cols);
-        for (size_t i = 0; i < m_data.size(); ++i)
-            m_data[i] += rhs.m_data[i];
+        nn_kernels<T>().add(
+            m_data.data(), rhs.m_data.data(), m_data.size());
     }
-    void operator-=(const Mx2& rhs)
+    void operator-=(const BasicMx2& rhs)
     {
         ASSERT_EQ(m_rows, rhs.m_rows);
         ASSERT_EQ(m_cols, rhs.m_cols);
-        for (size_t i = 0; i < m_data.size(); ++i)
-            m_data[i] -= rhs.m_data[i];
+        nn_kernels<T>().sub(
+            m_data.data(), rhs.m_data.data(), m_data.size());
     }
-    void operator*=(const Mx2& rhs)
+    void operator*=(const BasicMx2& rhs)
     {
         ASSERT_EQ(m_rows, rhs.m_rows);
         ASSERT_EQ(m_cols, rhs.m_cols);
-        for (size_t i = 0; i < m_data.size(); ++i)
-            m_data[i] *= rhs.m_data[i];
+        nn_kernels<T>().mul(
+            m_data.data(), rhs.m_data.data(), m_data.size());
     }
 
-    void operator+=(const Mx1& rhs)
+    void operator+=(const BasicMx1<T>& rhs)
     {
         ASSERT_EQ(m_cols, rhs.cols());
-        for (size_t col = 0; col < m_cols; ++col) {
-            for (size_t row = 0; row < m_rows; ++row) {
-                m_data[row * m_cols + col] += rhs[col];
-            }
-        }
+        nn_kernels<T>().add_rows(
+            m_data.data(), rhs.span().data(), m_rows, m_cols);
     }
-    void operator-=(const Mx1& rhs)
+    void operator-=(const BasicMx1<T>& rhs)
     {
         ASSERT_EQ(m_cols, rhs.cols());
-        for (size_t col = 0; col < m_cols; ++col) {
-            for (size_t row = 0; row < m_rows; ++row) {
-                m_data[row * m_cols + col] -= rhs[col];
-            }
-        }
+        nn_kernels<T>().sub_rows(
+            m_data.data(), rhs.span().data(), m_rows, m_cols);
     }
-    void operator*=(const Mx1& rhs)
+    void operator*=(const BasicMx1<T>& rhs)
     {
         ASSERT_EQ(m_cols, rhs.cols());
-        for (size_t col = 0; col < m_cols; ++col) {
-            for (size_t row = 0; row < m_rows; ++row) {
-                m_data[row * m_cols + col] *= rhs[col];
-            }
-        }
+        nn_kernels<T>().mul_rows(
+            m_data.data(), rhs.span().data(), m_rows, m_cols);
     }
 
-    void operator+=(double rhs)
+    void operator+=(T rhs)
     {
         for (auto& v : m_data)
             v += rhs;
     }
-    void operator-=(double rhs)
+    void operator-=(T rhs)
     {
         for (auto& v : m_data)
             v -= rhs;
     }
-    void operator*=(double rhs)
+    void operator*=(T rhs)
     {
-        for (auto& v : m_data)
-            v *= rhs;
+        nn_kernels<T>().scale(m_data.data(), rhs, m_data.size());
     }
 
-    auto dot(const Mx1& rhs) const -> Mx1
+    auto dot(const BasicMx1<T>& rhs) const -> BasicMx1<T>
     {
-        ASSERT_EQ(m_cols, rhs.cols());
-        auto res = Mx1(m_rows);
-        for (size_t row = 0; row < m_rows; ++row) {
-            res[row] = 0;
-            for (size_t col = 0; col < m_cols; ++col) {
-                res[row] += at(row, col) * rhs[col];
-            }
-        }
+        auto res = BasicMx1<T>(m_rows);
+        dot_into(rhs.span(), res.span());
         return res;
     }
 
-    auto sum() const -> Mx1
+    /// like `dot`, but writes the result to `out` instead of allocating
+    void dot_into(std::span<const T> rhs, std::span<T> out) const
+    {
+        ASSERT_EQ(m_cols, rhs.size());
+        ASSERT_EQ(m_rows, out.size());
+        nn_kernels<T>().gemv(
+            m_data.data(), rhs.data(), out.data(), m_rows, m_cols);
+    }
+
+    /// like `dot_into`, but multiplies by the transpose of the matrix
+    /// without building it
+    void dot_transposed_into(
+        std::span<const T> rhs, std::span<T> out) const
+    {
+        ASSERT_EQ(m_rows, rhs.size());
+        ASSERT_EQ(m_cols, out.size());
+        nn_kernels<T>().gemv_t(
+            m_data.data(), rhs.data(), out.data(), m_rows, m_cols);
+    }
+
+    /// adds the outer product `col` · `row`ᵀ, i.e. `col[r] * row[c]` to
+    /// every element
+    void add_outer(std::span<const T> col, std::span<const T> row)
+    {
+        ASSERT_EQ(m_rows, col.size());
+        ASSERT_EQ(m_cols, row.size());
+        for (size_t r = 0; r < m_rows; ++r)
+            nn_kernels<T>().axpy(
+                &m_data[r * m_cols], col[r], row.data(), m_cols);
+    }
+
+    auto sum() const -> BasicMx1<T>
     {
-        auto sum = Mx1(m_cols);
+        auto sum = BasicMx1<T>(m_cols);
         for (size_t col = 0; col < m_cols; ++col) {
-            sum[col] = 0;
+            double col_sum = 0;
             for (size_t row = 0; row < m_rows; ++row) {
-                sum[col] += m_data[row * m_cols + col];
+                col_sum += m_data[row * m_cols + col];
             }
+            sum[col] = static_cast<T>(col_sum);
         }
         return sum;
     }
@@ -238,6 +364,21 @@ public:
 
     void print() const;
 
+    auto data() const -> const T*
+    {
+        return m_data.data();
+    }
+
+    /// the elements, row by row
+    auto span() const -> std::span<const T>
+    {
+        return m_data;
+    }
+    auto span() -> std::span<T>
+    {
+        return m_data;
+    }
+
     auto rows() const -> size_t
     {
         return m_rows;
@@ -250,48 +391,294 @@ public:
 private:
     size_t m_rows;
     size_t m_cols;
-    std::vector<double> m_data;
+    std::vector<T> m_data;
 };
 
+/// `matrix` · `vector` as an expression, so it can be fused with what
+/// follows, e.g. `out = sigmoid(product(w, x) + b)`
+template <typename T>
+auto product(const BasicMx2<T>& matrix, std::span<const T> vector)
+    -> expr::Product<T>
+{
+    ASSERT_EQ(matrix.cols(), vector.size());
+    return { matrix.data(), matrix.rows(), matrix.cols(), vector.data() };
+}
+template <typename T>
+auto product(const BasicMx2<T>& matrix, const BasicMx1<T>& vector)
+    -> expr::Product<T>
+{
+    return product(matrix, vector.span());
+}
+
+using Mx1 = BasicMx1<double>;
+using Mx2 = BasicMx2<double>;
+using Mx1f = BasicMx1<float>;
+using Mx2f = BasicMx2<float>;
+
 double randd(double min, double max);
 double randd_dec(void);
 double relu(double x);
 double relu_deriv(double x);
 double sigmoid(double x);
 double sigmoid_deriv(double x);
-
-class Model {
+float sigmoid(float x);
+float sigmoid_deriv(float x);
+
+/// The loop of mini-batch stochastic gradient descent over mini-batches
+/// from anywhere. `next_batch()` makes the next mini-batch current and
+/// returns its size, or 0 at the end of an epoch, after which it starts the
+/// next epoch. The threads split every mini-batch, each calling
+/// `sample(index in the mini-batch, thread)` for its share, then one of them
+/// calls `step(mini-batch size)` and `next_batch()`, and `end_epoch(epochs
+/// done)` after the last mini-batch of an epoch.
+void run_batches(size_t epochs, size_t threads,
+    const std::function<size_t()>& next_batch,
+    const std::function<void(size_t index, size_t thread)>& sample,
+    const std::function<void(size_t batch)>& step,
+    const std::function<void(size_t epoch)>& end_epoch);
+
+/// A version no model has had yet, see `BasicModel::version`.
+auto next_model_version() -> uint64_t;
+
+/// Picks the constructor of `BasicModel` that leaves every weight and bias
+/// 0, for models whose parameters are read right after.
+struct Zeroed {};
+constexpr auto zeroed = Zeroed {};
+
+/// A fully connected net of sigmoid layers with weights and activations of
+/// type `T`. Sums over whole data sets accumulate in double.
+template <typename T>
+class BasicModel {
 public:
-    Model(std::vector<size_t> layers);
+    using Vector = BasicMx1<T>;
+    using Matrix = BasicMx2<T>;
+
+    BasicModel(std::vector<size_t> layers);
+    /// draws the initial weights and biases from `rng`, as doubles, so
+    /// models of either precision start from the same weights
+    BasicModel(std::vector<size_t> layers, Rng& rng);
+    BasicModel(std::vector<size_t> layers, Zeroed);
+
+    /// converts every weight and bias to `T`
+    template <typename U>
+    explicit BasicModel(const BasicModel<U>& other)
+        : m_layers(other.m_layers)
+    {
+        for (const auto& weights : other.m_weights)
+            m_weights.emplace_back(weights);
+        for (const auto& biases : other.m_biases)
+            m_biases.emplace_back(biases);
+    }
+
+    /// Buffers `feed` works in, so it doesn't have to allocate.
+    class Scratch {
+    public:
+        /// grows the buffers to fit `batch` inputs of `model`, only
+        /// allocating if they are too small
+        void fit(const BasicModel& model, size_t batch = 1);
+
+    private:
+        friend class BasicModel;
+        std::vector<T> m_data;
+    };
 
-    auto feed(const Mx1& input) -> Mx1;
-    void mutate();
+    auto feed(const Vector& input) const -> Vector;
+    /// Like `feed(const Vector&)`, but doesn't allocate once `scratch` fits.
+    /// The returned outputs live in `scratch`.
+    auto feed(std::span<const T> input, Scratch& scratch) const
+        -> std::span<const T>;
+    /// Like `feed`, but from the product of the first weights and the
+    /// inputs, before the biases, e.g. kept up to date by an `Accumulator`.
+    auto feed_weighted(std::span<const T> weighted, Scratch& scratch) const
+        -> std::span<const T>;
+    /// Feeds `batch` inputs stored back to back in `inputs` through the net
+    /// at once, which reuses every weight for the whole batch. Returns the
+    /// outputs back to back, living in `scratch`.
+    auto feed_batch(std::span<const T> inputs, size_t batch,
+        Scratch& scratch) const -> std::span<const T>;
+    /// Adds noise to the parameters, layer by layer. The default changes
+    /// about as much as the rule used before, which moved 59% of the
+    /// parameters by 0.25 to 0.5.
+    void mutate(const MutationOptions& opts = { .rate = 0.6, .scale = 0.4 },
+        NoiseGenerator& noise = thread_noise());
+
+    /// neurons per layer, inputs first
+    auto layers() const -> const std::vector<size_t>&
+    {
+        return m_layers;
+    }
+    /// weights from layer `layer` to layer `layer + 1`
+    auto weights(size_t layer) const -> const Matrix&
+    {
+        return m_weights[layer];
+    }
+    auto biases(size_t layer) const -> const Vector&
+    {
+        return m_biases[layer];
+    }
+
+    /// Changes whenever the weights do. Copies share the version of the
+    /// model they copy, any other model has a different one.
+    auto version() const -> uint64_t
+    {
+        return m_version;
+    }
+
+    /// number of weights and biases
+    auto parameter_count() const -> size_t;
+    /// copies every weight and bias to `out`, layer by layer, with the
+    /// weights of a layer row by row before its biases
+    void write_parameters(std::span<T> out) const;
+    /// the reverse of `write_parameters`
+    void read_parameters(std::span<const T> in);
+
+    /// Buffers `train_sgd` needs per thread: the activations and deltas of
+    /// every layer for one sample, and the gradients accumulated over the
+    /// thread's share of a mini-batch.
+    class Workspace {
+    public:
+        /// sizes the buffers for `model`, only allocating if they don't
+        /// fit already, and zeroes the gradients
+        void fit(const BasicModel& model);
+        /// adds the gradients of `other`, fit to the same model
+        void add(const Workspace& other);
+
+    private:
+        friend class BasicModel;
+        /// where each layer starts in `m_activations`
+        std::vector<size_t> m_offsets;
+        std::vector<T> m_activations;
+        std::vector<T> m_deltas;
+        std::vector<Matrix> m_weight_gradients;
+        std::vector<Vector> m_bias_gradients;
+    };
 
     struct DataEntry {
-        Mx1 input;
-        Mx1 correct;
+        Vector input;
+        Vector correct;
     };
     using Data = std::vector<DataEntry>;
     struct TrainOpts {
         size_t epochs;
         size_t batch_size;
         double learn_rate;
+        /// threads splitting every mini-batch between them
+        size_t threads = 1;
+        /// called with the number of epochs done after each epoch, e.g. to
+        /// save a checkpoint, see `checkpoint_every`
+        std::function<void(size_t epoch)> on_epoch {};
     };
 
     /// mini-batch stochastic gradient descent
-    void train_sgd(Data train_data, const Data& test_data, TrainOpts opts);
+    void train_sgd(std::span<const DataEntry> train_data,
+        std::span<const DataEntry> test_data, TrainOpts opts);
+    /// mean squared error of the outputs over `data`
+    auto mean_squared_error(std::span<const DataEntry> data) const -> double;
+
+    /// Adds the gradients of the cost for one sample to `workspace`. If
+    /// `input_delta` isn't empty, it gets the gradient of the cost by the
+    /// inputs, for a layer feeding this model.
+    void backprop(std::span<const T> input, std::span<const T> correct,
+        Workspace& workspace, std::span<T> input_delta = {}) const;
+    /// moves the parameters against the gradients in `gradients`, times
+    /// `rate`
+    void descend(const Workspace& gradients, T rate);
 
 private:
-    auto backprop(const Mx1& input, const Mx1& correct)
-        -> std::tuple<std::vector<Mx2>, std::vector<Mx1>>;
-    auto zeroed_weights_biases()
-        -> std::tuple<std::vector<Mx2>, std::vector<Mx1>>;
+
+    template <typename>
+    friend class BasicModel;
 
     std::vector<size_t> m_layers;
-    std::vector<Mx2> m_weights;
-    std::vector<Mx1> m_biases;
+    std::vector<Matrix> m_weights;
+    std::vector<Vector> m_biases;
+    uint64_t m_version = next_model_version();
 };
 
+using Model = BasicModel<double>;
+using Modelf = BasicModel<float>;
+
+/// Mini-batches of data in memory, in a new random order every epoch, as
+/// `train_sgd` takes them. The data is shuffled through indices, so it is
+/// never copied. The orders are drawn from the `thread_rng()` of the
+/// thread constructing the batches, whichever thread calls `next`.
+template <typename T>
+class ShuffledBatches {
+public:
+    using DataEntry = typename BasicModel<T>::DataEntry;
+
+    /// `data` must not be empty and outlive the batches
+    ShuffledBatches(std::span<const DataEntry> data, size_t batch_size);
+
+    auto batch_size() const -> size_t
+    {
+        return m_batch_size;
+    }
+    /// Makes the next mini-batch current and returns its size, 0 at the
+    /// end of an epoch, as `run_batches` takes it.
+    auto next() -> size_t;
+    auto input(size_t index) const -> std::span<const T>
+    {
+        return m_data[m_order[m_begin + index]].input.span();
+    }
+    auto target(size_t index) const -> std::span<const T>
+    {
+        return m_data[m_order[m_begin + index]].correct.span();
+    }
+
+private:
+    std::span<const DataEntry> m_data;
+    size_t m_batch_size;
+    std::vector<size_t> m_order;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    Rng& m_rng;
+};
+
+struct SgdOptions {
+    size_t epochs;
+    double learn_rate;
+    /// threads splitting every mini-batch between them
+    size_t threads = 1;
+    /// called with the number of epochs done after each epoch
+    std::function<void(size_t epoch)> on_epoch {};
+};
+
+/// Mini-batch stochastic gradient descent on the mini-batches of
+/// `batches`, e.g. `ShuffledBatches` or a `BasicDatasetStream`, for any
+/// model with a `Workspace`, `backprop` and `descend`, like `BasicModel`
+/// and `BasicConvModel`.
+template <typename Model, typename Batches>
+void train_sgd(Model& model, Batches& batches, const SgdOptions& opts)
+{
+    using T = typename decltype(batches.input(0))::value_type;
+    auto threads = std::clamp<size_t>(opts.threads, 1, batches.batch_size());
+    auto workspaces = std::vector<typename Model::Workspace>(threads);
+    for (auto& workspace : workspaces)
+        workspace.fit(model);
+
+    auto sample = [&](size_t index, size_t thread) {
+        model.backprop(
+            batches.input(index), batches.target(index), workspaces[thread]);
+    };
+    // sums the per-thread gradients in a fixed order, so the result only
+    // depends on the thread count
+    auto step = [&](size_t batch) {
+        for (size_t t = 1; t < threads; ++t)
+            workspaces[0].add(workspaces[t]);
+        model.descend(workspaces[0],
+            static_cast<T>(opts.learn_rate / static_cast<double>(batch)));
+        for (auto& workspace : workspaces)
+            workspace.fit(model);
+    };
+    auto end_epoch = [&](size_t epoch) {
+        if (opts.on_epoch)
+            opts.on_epoch(epoch);
+    };
+    run_batches(opts.epochs, threads, [&] { return batches.next(); }, sample,
+        step, end_epoch);
+}
+
 }
 
 #endif
@@ -0,0 +1,444 @@
+#include "nn_noise.hpp"
+#include "nn_kernels.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <initializer_list>
+#include <span>
+
+using namespace connect_four;
+
+namespace {
+
+// Every instruction set defines `L`, the operations on one register of
+// 32 bit lanes, as `Bits` or as floats in `Reg`, and then includes the
+// generic kernels.
+
+namespace scalar {
+
+    struct L {
+        static constexpr size_t width = 1;
+        using Bits = uint32_t;
+        using Reg = float;
+
+        static inline auto load(const uint32_t* p) -> Bits
+        {
+            return *p;
+        }
+        static inline void store(uint32_t* p, Bits v)
+        {
+            *p = v;
+        }
+        static inline void store(float* p, Reg v)
+        {
+            *p = v;
+        }
+        static inline auto set1_bits(uint32_t v) -> Bits
+        {
+            return v;
+        }
+        static inline auto add(Bits a, Bits b) -> Bits
+        {
+            return a + b;
+        }
+        static inline auto sub(Bits a, Bits b) -> Bits
+        {
+            return a - b;
+        }
+        static inline auto bit_and(Bits a, Bits b) -> Bits
+        {
+            return a & b;
+        }
+        static inline auto bit_or(Bits a, Bits b) -> Bits
+        {
+            return a | b;
+        }
+        static inline auto bit_xor(Bits a, Bits b) -> Bits
+        {
+            return a ^ b;
+        }
+        template <int k>
+        static inline auto shl(Bits a) -> Bits
+        {
+            return a << k;
+        }
+        template <int k>
+        static inline auto shr(Bits a) -> Bits
+        {
+            return a >> k;
+        }
+        template <int k>
+        static inline auto rotl(Bits a) -> Bits
+        {
+            return std::rotl(a, k);
+        }
+
+        static inline auto as_float(Bits a) -> Reg
+        {
+            return std::bit_cast<float>(a);
+        }
+        static inline auto as_bits(Reg a) -> Bits
+        {
+            return std::bit_cast<uint32_t>(a);
+        }
+        /// the lanes as signed integers
+        static inline auto to_float(Bits a) -> Reg
+        {
+            return static_cast<float>(static_cast<int32_t>(a));
+        }
+        static inline auto set1(float v) -> Reg
+        {
+            return v;
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return a + b;
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return a - b;
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return a * b;
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return a / b;
+        }
+    };
+
+#include "nn_noise_impl.hpp"
+
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace avx2 {
+
+    struct L {
+        static constexpr size_t width = 8;
+        using Bits = __m256i;
+        using Reg = __m256;
+
+        static inline auto load(const uint32_t* p) -> Bits
+        {
+            return _mm256_load_si256(reinterpret_cast<const __m256i*>(p));
+        }
+        static inline void store(uint32_t* p, Bits v)
+        {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(p), v);
+        }
+        static inline void store(float* p, Reg v)
+        {
+            _mm256_store_ps(p, v);
+        }
+        static inline auto set1_bits(uint32_t v) -> Bits
+        {
+            return _mm256_set1_epi32(static_cast<int>(v));
+        }
+        static inline auto add(Bits a, Bits b) -> Bits
+        {
+            return _mm256_add_epi32(a, b);
+        }
+        static inline auto sub(Bits a, Bits b) -> Bits
+        {
+            return _mm256_sub_epi32(a, b);
+        }
+        static inline auto bit_and(Bits a, Bits b) -> Bits
+        {
+            return _mm256_and_si256(a, b);
+        }
+        static inline auto bit_or(Bits a, Bits b) -> Bits
+        {
+            return _mm256_or_si256(a, b);
+        }
+        static inline auto bit_xor(Bits a, Bits b) -> Bits
+        {
+            return _mm256_xor_si256(a, b);
+        }
+        template <int k>
+        static inline auto shl(Bits a) -> Bits
+        {
+            return _mm256_slli_epi32(a, k);
+        }
+        template <int k>
+        static inline auto shr(Bits a) -> Bits
+        {
+            return _mm256_srli_epi32(a, k);
+        }
+        template <int k>
+        static inline auto rotl(Bits a) -> Bits
+        {
+            return _mm256_or_si256(
+                _mm256_slli_epi32(a, k), _mm256_srli_epi32(a, 32 - k));
+        }
+
+        static inline auto as_float(Bits a) -> Reg
+        {
+            return _mm256_castsi256_ps(a);
+        }
+        static inline auto as_bits(Reg a) -> Bits
+        {
+            return _mm256_castps_si256(a);
+        }
+        static inline auto to_float(Bits a) -> Reg
+        {
+            return _mm256_cvtepi32_ps(a);
+        }
+        static inline auto set1(float v) -> Reg
+        {
+            return _mm256_set1_ps(v);
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return _mm256_add_ps(a, b);
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return _mm256_sub_ps(a, b);
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return _mm256_mul_ps(a, b);
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return _mm256_div_ps(a, b);
+        }
+    };
+
+#include "nn_noise_impl.hpp"
+
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,avx512f")
+// AVX-512 implies FMA, and fused multiply-adds would round differently than
+// the other instruction sets
+#pragma GCC optimize("fp-contract=off")
+
+namespace avx512 {
+
+    struct L {
+        static constexpr size_t width = 16;
+        using Bits = __m512i;
+        using Reg = __m512;
+
+        // the unmasked shifts, rotations and conversions trip
+        // -Wuninitialized on GCC 12
+        static constexpr __mmask16 all = 0xffff;
+
+        static inline auto load(const uint32_t* p) -> Bits
+        {
+            return _mm512_load_si512(p);
+        }
+        static inline void store(uint32_t* p, Bits v)
+        {
+            _mm512_store_si512(p, v);
+        }
+        static inline void store(float* p, Reg v)
+        {
+            _mm512_store_ps(p, v);
+        }
+        static inline auto set1_bits(uint32_t v) -> Bits
+        {
+            return _mm512_set1_epi32(static_cast<int>(v));
+        }
+        static inline auto add(Bits a, Bits b) -> Bits
+        {
+            return _mm512_add_epi32(a, b);
+        }
+        static inline auto sub(Bits a, Bits b) -> Bits
+        {
+            return _mm512_sub_epi32(a, b);
+        }
+        static inline auto bit_and(Bits a, Bits b) -> Bits
+        {
+            return _mm512_and_si512(a, b);
+        }
+        static inline auto bit_or(Bits a, Bits b) -> Bits
+        {
+            return _mm512_or_si512(a, b);
+        }
+        static inline auto bit_xor(Bits a, Bits b) -> Bits
+        {
+            return _mm512_xor_si512(a, b);
+        }
+        template <int k>
+        static inline auto shl(Bits a) -> Bits
+        {
+            return _mm512_maskz_slli_epi32(all, a, k);
+        }
+        template <int k>
+        static inline auto shr(Bits a) -> Bits
+        {
+            return _mm512_maskz_srli_epi32(all, a, k);
+        }
+        template <int k>
+        static inline auto rotl(Bits a) -> Bits
+        {
+            return _mm512_maskz_rol_epi32(all, a, k);
+        }
+
+        static inline auto as_float(Bits a) -> Reg
+        {
+            return _mm512_castsi512_ps(a);
+        }
+        static inline auto as_bits(Reg a) -> Bits
+        {
+            return _mm512_castps_si512(a);
+        }
+        static inline auto to_float(Bits a) -> Reg
+        {
+            return _mm512_maskz_cvtepi32_ps(all, a);
+        }
+        static inline auto set1(float v) -> Reg
+        {
+            return _mm512_set1_ps(v);
+        }
+        static inline auto add(Reg a, Reg b) -> Reg
+        {
+            return _mm512_add_ps(a, b);
+        }
+        static inline auto sub(Reg a, Reg b) -> Reg
+        {
+            return _mm512_sub_ps(a, b);
+        }
+        static inline auto mul(Reg a, Reg b) -> Reg
+        {
+            return _mm512_mul_ps(a, b);
+        }
+        static inline auto div(Reg a, Reg b) -> Reg
+        {
+            return _mm512_div_ps(a, b);
+        }
+    };
+
+#include "nn_noise_impl.hpp"
+
+}
+
+#pragma GCC pop_options
+
+auto supported_kernels(Isa isa) -> const NoiseKernels*
+{
+    switch (isa) {
+        case Isa::Scalar: {
+            static const auto kernels
+                = NoiseKernels { isa, scalar::bits, scalar::fill };
+            return &kernels;
+        }
+        case Isa::Avx2: {
+            if (!__builtin_cpu_supports("avx2"))
+                return nullptr;
+            static const auto kernels
+                = NoiseKernels { isa, avx2::bits, avx2::fill };
+            return &kernels;
+        }
+        case Isa::Avx512: {
+            if (!__builtin_cpu_supports("avx512f"))
+                return nullptr;
+            static const auto kernels
+                = NoiseKernels { isa, avx512::bits, avx512::fill };
+            return &kernels;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+auto connect_four::noise_kernels() -> const NoiseKernels&
+{
+    static const auto* best = [] {
+        for (auto isa : { Isa::Avx512, Isa::Avx2 }) {
+            if (const auto* kernels = supported_kernels(isa))
+                return kernels;
+        }
+        return supported_kernels(Isa::Scalar);
+    }();
+    return *best;
+}
+
+auto connect_four::noise_kernels_for(Isa isa) -> const NoiseKernels*
+{
+    return supported_kernels(isa);
+}
+
+NoiseGenerator::NoiseGenerator(Rng& rng)
+    : m_state()
+    , m_kernels(&noise_kernels())
+{
+    for (auto& word : m_state.words) {
+        for (auto& lane : word)
+            lane = static_cast<uint32_t>(rng.next() >> 32);
+    }
+    // xoshiro never leaves an all zero state
+    for (size_t lane = 0; lane < NoiseState::lanes; ++lane) {
+        if (std::all_of(m_state.words.begin(), m_state.words.end(),
+                [&](const auto& word) { return word[lane] == 0; }))
+            m_state.words[0][lane] = 1;
+    }
+}
+
+void NoiseGenerator::fill(Noise noise, std::span<float> out)
+{
+    m_kernels->fill(m_state, noise, out.data(), out.size());
+}
+
+template <typename T>
+void NoiseGenerator::mutate(std::span<T> values, const MutationOptions& opts)
+{
+    constexpr size_t chunk = 256;
+    alignas(64) float noise[chunk];
+    auto scale = static_cast<float>(opts.scale);
+
+    if (opts.rate >= 1) {
+        for (size_t begin = 0; begin < values.size(); begin += chunk) {
+            auto n = std::min(chunk, values.size() - begin);
+            m_kernels->fill(m_state, opts.noise, noise, n);
+            for (size_t i = 0; i < n; ++i)
+                values[begin + i] += static_cast<T>(scale * noise[i]);
+        }
+        return;
+    }
+
+    // rounded at random, so small layers still change at the given rate
+    auto expected = opts.rate * static_cast<double>(values.size());
+    auto count = static_cast<size_t>(expected);
+    uint32_t draw;
+    m_kernels->bits(m_state, &draw, 1);
+    if (static_cast<double>(draw) * 0x1.0p-32
+        < expected - static_cast<double>(count))
+        count += 1;
+
+    // an index can come up twice, which is as good as a larger change
+    alignas(64) uint32_t indices[chunk];
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        auto n = std::min(chunk, count - begin);
+        m_kernels->bits(m_state, indices, n);
+        m_kernels->fill(m_state, opts.noise, noise, n);
+        for (size_t i = 0; i < n; ++i) {
+            auto index = static_cast<uint64_t>(indices[i]) * values.size();
+            values[index >> 32] += static_cast<T>(scale * noise[i]);
+        }
+    }
+}
+
+template void NoiseGenerator::mutate<double>(
+    std::span<double> values, const MutationOptions& opts);
+template void NoiseGenerator::mutate<float>(
+    std::span<float> values, const MutationOptions& opts);
+
+auto connect_four::thread_noise() -> NoiseGenerator&
+{
+    thread_local auto generator = NoiseGenerator(thread_rng());
+    return generator;
+}
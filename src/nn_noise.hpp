@@ -0,0 +1,76 @@
+#ifndef NN_NOISE_HPP
+#define NN_NOISE_HPP
+
+#include "nn_kernels.hpp"
+#include "rng.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace connect_four {
+
+enum class Noise {
+    /// approximated by the sum of 4 uniform values
+    Gaussian,
+    Laplace,
+};
+
+/// How `mutate` changes the parameters of a net.
+struct MutationOptions {
+    /// share of the parameters of each layer that change. Below 1, only
+    /// that many randomly picked parameters are touched.
+    double rate = 0.05;
+    /// standard deviation of a change
+    double scale = 0.2;
+    Noise noise = Noise::Gaussian;
+};
+
+/// 16 xoshiro128+ generators side by side, one per SIMD lane. Every
+/// instruction set steps all of them, so they all draw the same values.
+struct NoiseState {
+    static constexpr size_t lanes = 16;
+    alignas(64) std::array<std::array<uint32_t, lanes>, 4> words;
+};
+
+/// Noise generation for one instruction set.
+struct NoiseKernels {
+    Isa isa;
+
+    /// `n` uniform random values
+    void (*bits)(NoiseState& state, uint32_t* out, size_t n);
+    /// `n` values of `noise`, with mean 0 and standard deviation 1
+    void (*fill)(NoiseState& state, Noise noise, float* out, size_t n);
+};
+
+/// Kernels for the best instruction set the CPU supports.
+auto noise_kernels() -> const NoiseKernels&;
+/// Kernels for `isa`, or nullptr if the CPU doesn't support it.
+auto noise_kernels_for(Isa isa) -> const NoiseKernels*;
+
+/// Draws mutation noise in bulk, many values per instruction.
+class NoiseGenerator {
+public:
+    /// seeds the generators from `rng`
+    explicit NoiseGenerator(Rng& rng);
+
+    void fill(Noise noise, std::span<float> out);
+
+    /// Adds noise to `opts.rate` of `values`. Below a rate of 1, the
+    /// touched values are picked at random, and no noise is drawn for the
+    /// others.
+    template <typename T>
+    void mutate(std::span<T> values, const MutationOptions& opts);
+
+private:
+    NoiseState m_state;
+    const NoiseKernels* m_kernels;
+};
+
+/// Generator of the calling thread, seeded from `thread_rng()` when first
+/// used.
+auto thread_noise() -> NoiseGenerator&;
+
+}
+
+#endif
@@ -0,0 +1,122 @@
+// Noise kernels, generic over the lane operations `L` of an instruction
+// set. Included into the instruction set namespaces of nn_noise.cpp, after
+// `L` is defined, so everything here is compiled for that instruction set.
+// Like nn_kernels_impl.hpp, this must not include anything itself.
+
+constexpr size_t registers = NoiseState::lanes / L::width;
+
+struct Generators {
+    L::Bits words[4][registers];
+};
+
+inline auto load(const NoiseState& state) -> Generators
+{
+    auto g = Generators {};
+    for (size_t w = 0; w < 4; ++w)
+        for (size_t r = 0; r < registers; ++r)
+            g.words[w][r] = L::load(&state.words[w][r * L::width]);
+    return g;
+}
+
+inline void store(NoiseState& state, const Generators& g)
+{
+    for (size_t w = 0; w < 4; ++w)
+        for (size_t r = 0; r < registers; ++r)
+            L::store(&state.words[w][r * L::width], g.words[w][r]);
+}
+
+/// the next value of the generators in register `r`, xoshiro128+
+inline auto next(Generators& g, size_t r) -> L::Bits
+{
+    auto& s = g.words;
+    auto result = L::add(s[0][r], s[3][r]);
+    auto t = L::shl<9>(s[1][r]);
+    s[2][r] = L::bit_xor(s[2][r], s[0][r]);
+    s[3][r] = L::bit_xor(s[3][r], s[1][r]);
+    s[1][r] = L::bit_xor(s[1][r], s[2][r]);
+    s[0][r] = L::bit_xor(s[0][r], s[3][r]);
+    s[2][r] = L::bit_xor(s[2][r], t);
+    s[3][r] = L::rotl<11>(s[3][r]);
+    return result;
+}
+
+/// uniform in [1, 2), from the upper 23 bits, as the lowest bits of
+/// xoshiro128+ are weak
+inline auto unit(L::Bits bits) -> L::Reg
+{
+    return L::as_float(L::bit_or(
+        L::shr<9>(bits), L::set1_bits(0x3f800000)));
+}
+
+/// natural log of `x`, with a relative error of about 1e-6
+inline auto fast_log(L::Reg x) -> L::Reg
+{
+    auto bits = L::as_bits(x);
+    auto exponent = L::to_float(
+        L::sub(L::shr<23>(bits), L::set1_bits(127)));
+    auto mantissa = L::as_float(L::bit_or(L::bit_and(bits,
+                                              L::set1_bits(0x007fffff)),
+        L::set1_bits(0x3f800000)));
+
+    // log(m) = 2 atanh(z) with z = (m - 1) / (m + 1) <= 1/3
+    auto one = L::set1(1.0f);
+    auto z = L::div(L::sub(mantissa, one), L::add(mantissa, one));
+    auto z2 = L::mul(z, z);
+    auto series = L::set1(2.0f / 9);
+    for (auto c : { 2.0f / 7, 2.0f / 5, 2.0f / 3, 2.0f })
+        series = L::add(L::mul(series, z2), L::set1(c));
+    return L::add(
+        L::mul(exponent, L::set1(0.693147181f)), L::mul(series, z));
+}
+
+inline void bits(NoiseState& state, uint32_t* out, size_t n)
+{
+    auto g = load(state);
+    alignas(64) uint32_t block[NoiseState::lanes];
+    for (size_t i = 0; i < n; i += NoiseState::lanes) {
+        for (size_t r = 0; r < registers; ++r)
+            L::store(&block[r * L::width], next(g, r));
+        for (size_t j = 0; j < NoiseState::lanes && i + j < n; ++j)
+            out[i + j] = block[j];
+    }
+    store(state, g);
+}
+
+inline auto gaussian(Generators& g, size_t r) -> L::Reg
+{
+    // 4 uniform values in [1, 2) sum to a mean of 6 and a variance of 1/3
+    auto a = unit(next(g, r));
+    auto b = unit(next(g, r));
+    auto c = unit(next(g, r));
+    auto d = unit(next(g, r));
+    auto sum = L::add(L::add(a, b), L::add(c, d));
+    return L::mul(L::sub(sum, L::set1(6.0f)), L::set1(1.73205081f));
+}
+
+inline auto laplace(Generators& g, size_t r) -> L::Reg
+{
+    auto bits = next(g, r);
+    // in (0, 1], so the log is finite
+    auto uniform = L::sub(L::set1(2.0f), unit(bits));
+    // -log of a uniform value is exponential, scaled to a variance of 1
+    auto magnitude = L::mul(fast_log(uniform), L::set1(-0.707106781f));
+    auto sign = L::shl<23>(
+        L::bit_and(bits, L::set1_bits(0x00000100)));
+    return L::as_float(L::bit_or(L::as_bits(magnitude), sign));
+}
+
+inline void fill(NoiseState& state, Noise noise, float* out, size_t n)
+{
+    auto g = load(state);
+    alignas(64) float block[NoiseState::lanes];
+    for (size_t i = 0; i < n; i += NoiseState::lanes) {
+        for (size_t r = 0; r < registers; ++r) {
+            auto values
+                = noise == Noise::Gaussian ? gaussian(g, r) : laplace(g, r);
+            L::store(&block[r * L::width], values);
+        }
+        for (size_t j = 0; j < NoiseState::lanes && i + j < n; ++j)
+            out[i + j] = block[j];
+    }
+    store(state, g);
+}
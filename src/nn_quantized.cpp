@@ -0,0 +1,300 @@
+#include "nn_quantized.hpp"
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+constexpr size_t stride_alignment = 64;
+constexpr int max_activation = 127;
+constexpr int max_weight = 127;
+
+namespace scalar {
+
+    void gemv(const int8_t* m, const uint8_t* v, int32_t* out, size_t rows,
+        size_t stride)
+    {
+        for (size_t row = 0; row < rows; ++row) {
+            int32_t sum = 0;
+            for (size_t col = 0; col < stride; ++col)
+                sum += m[row * stride + col] * v[col];
+            out[row] = sum;
+        }
+    }
+
+}
+
+// Both SIMD versions work on four rows at a time with 256 bit registers,
+// so the four horizontal sums can share one reduction. They only differ in
+// how bytes are multiplied and summed, which `Dot` does.
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace avx2 {
+
+    /// the sums of each of `a`, `b`, `c` and `d`
+    inline auto hsum4(__m256i a, __m256i b, __m256i c, __m256i d) -> __m128i
+    {
+        auto ab = _mm256_hadd_epi32(a, b);
+        auto cd = _mm256_hadd_epi32(c, d);
+        auto abcd = _mm256_hadd_epi32(ab, cd);
+        return _mm_add_epi32(_mm256_castsi256_si128(abcd),
+            _mm256_extracti128_si256(abcd, 1));
+    }
+
+    inline auto load(const void* p) -> __m256i
+    {
+        return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+    }
+
+    inline auto hsum(__m256i a) -> int32_t
+    {
+        auto v = _mm_add_epi32(
+            _mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0b01001110));
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0b10110001));
+        return _mm_cvtsi128_si32(v);
+    }
+
+    template <typename Dot>
+    inline void gemv_rows(const int8_t* m, const uint8_t* v, int32_t* out,
+        size_t rows, size_t stride)
+    {
+        size_t row = 0;
+        for (; row + 4 <= rows; row += 4) {
+            const int8_t* r0 = m + row * stride;
+            const int8_t* r1 = r0 + stride;
+            const int8_t* r2 = r1 + stride;
+            const int8_t* r3 = r2 + stride;
+            auto a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256(),
+                 a2 = _mm256_setzero_si256(), a3 = _mm256_setzero_si256();
+            for (size_t col = 0; col < stride; col += 32) {
+                auto x = load(v + col);
+                a0 = Dot::add(a0, x, load(r0 + col));
+                a1 = Dot::add(a1, x, load(r1 + col));
+                a2 = Dot::add(a2, x, load(r2 + col));
+                a3 = Dot::add(a3, x, load(r3 + col));
+            }
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(out + row), hsum4(a0, a1, a2, a3));
+        }
+        for (; row < rows; ++row) {
+            const int8_t* r = m + row * stride;
+            auto a = _mm256_setzero_si256();
+            for (size_t col = 0; col < stride; col += 32)
+                a = Dot::add(a, load(v + col), load(r + col));
+            out[row] = hsum(a);
+        }
+    }
+
+    struct MaddubsDot {
+        /// acc + the dot products of every 4 unsigned `x` and signed `w`
+        static inline auto add(__m256i acc, __m256i x, __m256i w) -> __m256i
+        {
+            // adjacent pairs are summed to int16, which 7 bit activations
+            // keep from saturating
+            auto pairs = _mm256_maddubs_epi16(x, w);
+            return _mm256_add_epi32(
+                acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+        }
+    };
+
+    void gemv(const int8_t* m, const uint8_t* v, int32_t* out, size_t rows,
+        size_t stride)
+    {
+        gemv_rows<MaddubsDot>(m, v, out, rows, stride);
+    }
+
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,avx512f,avx512vl,avx512vnni")
+
+namespace avx512 {
+
+    struct VnniDot {
+        static inline auto add(__m256i acc, __m256i x, __m256i w) -> __m256i
+        {
+            return _mm256_dpbusd_epi32(acc, x, w);
+        }
+    };
+
+    void gemv(const int8_t* m, const uint8_t* v, int32_t* out, size_t rows,
+        size_t stride)
+    {
+        // 256 bit registers, as the rows are only one or two 64 byte
+        // vectors long and the reduction would dominate
+        avx2::gemv_rows<VnniDot>(m, v, out, rows, stride);
+    }
+
+}
+
+#pragma GCC pop_options
+
+auto supported_kernels(Isa isa) -> const QuantizedKernels*
+{
+    switch (isa) {
+        case Isa::Scalar: {
+            static const auto kernels = QuantizedKernels { isa, scalar::gemv };
+            return &kernels;
+        }
+        case Isa::Avx2: {
+            if (!__builtin_cpu_supports("avx2"))
+                return nullptr;
+            static const auto kernels = QuantizedKernels { isa, avx2::gemv };
+            return &kernels;
+        }
+        case Isa::Avx512: {
+            if (!__builtin_cpu_supports("avx512vl")
+                || !__builtin_cpu_supports("avx512vnni"))
+                return nullptr;
+            static const auto kernels = QuantizedKernels { isa, avx512::gemv };
+            return &kernels;
+        }
+    }
+    return nullptr;
+}
+
+auto quantize_activation(float value, float inverse_scale) -> uint8_t
+{
+    auto steps = value * inverse_scale + 0.5f;
+    return static_cast<uint8_t>(
+        std::clamp(steps, 0.0f, static_cast<float>(max_activation)));
+}
+
+}
+
+auto connect_four::quantized_kernels() -> const QuantizedKernels&
+{
+    static const auto* best = [] {
+        for (auto isa : { Isa::Avx512, Isa::Avx2 }) {
+            if (const auto* kernels = supported_kernels(isa))
+                return kernels;
+        }
+        return supported_kernels(Isa::Scalar);
+    }();
+    return *best;
+}
+
+auto connect_four::quantized_kernels_for(Isa isa) -> const QuantizedKernels*
+{
+    return supported_kernels(isa);
+}
+
+QuantizedModel::QuantizedModel(
+    const Model& model, std::span<const double> calibration, size_t count)
+    : m_layers()
+    , m_kernels(&quantized_kernels())
+{
+    const auto& sizes = model.layers();
+    ASSERT_EQ(calibration.size(), count * sizes.front());
+
+    // calibration: the largest input activation of every layer
+    auto max_inputs = std::vector<double>(sizes.size() - 1, 0.0);
+    auto current = std::vector<double>();
+    auto next = std::vector<double>();
+    for (size_t i = 0; i < count; ++i) {
+        auto input = calibration.subspan(i * sizes.front(), sizes.front());
+        current.assign(input.begin(), input.end());
+        for (size_t layer = 0; layer < max_inputs.size(); ++layer) {
+            max_inputs[layer] = std::max(max_inputs[layer],
+                *std::max_element(current.begin(), current.end()));
+            next.resize(sizes[layer + 1]);
+            model.weights(layer).dot_into(current, next);
+            for (size_t row = 0; row < next.size(); ++row)
+                next[row] = sigmoid(next[row] + model.biases(layer)[row]);
+            std::swap(current, next);
+        }
+    }
+
+    for (size_t i = 0; i < max_inputs.size(); ++i) {
+        const auto& weights = model.weights(i);
+        auto layer = Layer {};
+        layer.rows = weights.rows();
+        layer.cols = weights.cols();
+        layer.stride = (layer.cols + stride_alignment - 1) / stride_alignment
+            * stride_alignment;
+        layer.weights.resize(layer.rows * layer.stride, 0);
+        // sigmoid activations and the board inputs never exceed 1
+        auto max_input = max_inputs[i] > 0 ? max_inputs[i] : 1.0;
+        layer.input_scale = static_cast<float>(max_input / max_activation);
+        layer.inverse_input_scale = 1 / layer.input_scale;
+
+        for (size_t row = 0; row < layer.rows; ++row) {
+            double max_abs = 0;
+            for (size_t col = 0; col < layer.cols; ++col)
+                max_abs = std::max(max_abs, std::abs(weights.at(row, col)));
+            auto scale = max_abs > 0 ? max_abs / max_weight : 1.0;
+            for (size_t col = 0; col < layer.cols; ++col) {
+                auto steps = std::lround(weights.at(row, col) / scale);
+                layer.weights[row * layer.stride + col]
+                    = static_cast<int8_t>(steps);
+            }
+            layer.scales.push_back(
+                static_cast<float>(scale * layer.input_scale));
+            layer.biases.push_back(static_cast<float>(model.biases(i)[row]));
+        }
+        m_layers.push_back(std::move(layer));
+    }
+}
+
+void QuantizedModel::Scratch::fit(const QuantizedModel& model)
+{
+    size_t widest_stride = 0;
+    size_t widest_rows = 0;
+    for (const auto& layer : model.m_layers) {
+        widest_stride = std::max(widest_stride, layer.stride);
+        widest_rows = std::max(widest_rows, layer.rows);
+    }
+    // padding past a layer's inputs only meets zero weights, so stale
+    // activations there don't matter
+    if (m_activations.size() < std::max(widest_stride, widest_rows))
+        m_activations.resize(std::max(widest_stride, widest_rows));
+    if (m_sums.size() < widest_rows)
+        m_sums.resize(widest_rows);
+    // every layer's float outputs pass through here before being quantized
+    if (m_outputs.size() < widest_rows)
+        m_outputs.resize(widest_rows);
+}
+
+auto QuantizedModel::feed(std::span<const double> input, Scratch& scratch) const
+    -> std::span<const float>
+{
+    ASSERT_EQ(input.size(), inputs());
+    scratch.fit(*this);
+    const auto& sigmoid_kernels = nn_kernels<float>();
+
+    for (size_t col = 0; col < input.size(); ++col)
+        scratch.m_activations[col]
+            = quantize_activation(static_cast<float>(input[col]),
+                m_layers.front().inverse_input_scale);
+
+    for (size_t i = 0; i < m_layers.size(); ++i) {
+        const auto& layer = m_layers[i];
+        m_kernels->gemv(layer.weights.data(), scratch.m_activations.data(),
+            scratch.m_sums.data(), layer.rows, layer.stride);
+
+        auto* values = scratch.m_outputs.data();
+        for (size_t row = 0; row < layer.rows; ++row)
+            values[row]
+                = static_cast<float>(scratch.m_sums[row]) * layer.scales[row];
+        sigmoid_kernels.bias_sigmoid(values, layer.biases.data(), layer.rows);
+
+        if (i + 1 == m_layers.size())
+            break;
+        for (size_t row = 0; row < layer.rows; ++row)
+            scratch.m_activations[row] = quantize_activation(
+                values[row], m_layers[i + 1].inverse_input_scale);
+    }
+    return std::span(scratch.m_outputs).first(outputs());
+}
@@ -0,0 +1,89 @@
+#ifndef NN_QUANTIZED_HPP
+#define NN_QUANTIZED_HPP
+
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace connect_four {
+
+/// Integer matrix-vector product for one instruction set.
+struct QuantizedKernels {
+    Isa isa;
+
+    /// out = m * v, with `m` holding `rows` rows of `stride` weights and
+    /// `v` `stride` activations. `stride` is a multiple of 64 and the
+    /// activations are at most 127, so no instruction set saturates.
+    void (*gemv)(const int8_t* m, const uint8_t* v, int32_t* out, size_t rows,
+        size_t stride);
+};
+
+/// Kernels for the best instruction set the CPU supports. AVX-512 means
+/// AVX-512 VNNI here, AVX2 uses `maddubs` instead.
+auto quantized_kernels() -> const QuantizedKernels&;
+/// Kernels for `isa`, or nullptr if the CPU doesn't support it.
+auto quantized_kernels_for(Isa isa) -> const QuantizedKernels*;
+
+/// A trained `Model` with int8 weights, for fast move selection.
+///
+/// Every row of weights gets its own scale. The activations feeding each
+/// layer are quantized to 0..127, with a scale calibrated from the largest
+/// activation the calibration inputs produce. Biases and the sigmoid stay
+/// float.
+class QuantizedModel {
+public:
+    /// `calibration` holds `count` inputs of `model` back to back, which
+    /// should resemble the positions the model will see
+    QuantizedModel(
+        const Model& model, std::span<const double> calibration, size_t count);
+
+    /// Buffers `feed` works in, so it doesn't have to allocate.
+    class Scratch {
+    public:
+        void fit(const QuantizedModel& model);
+
+    private:
+        friend class QuantizedModel;
+        std::vector<uint8_t> m_activations;
+        std::vector<int32_t> m_sums;
+        std::vector<float> m_outputs;
+    };
+
+    /// The returned outputs live in `scratch`.
+    auto feed(std::span<const double> input, Scratch& scratch) const
+        -> std::span<const float>;
+
+    auto inputs() const -> size_t
+    {
+        return m_layers.front().cols;
+    }
+    auto outputs() const -> size_t
+    {
+        return m_layers.back().rows;
+    }
+
+private:
+    struct Layer {
+        size_t rows;
+        size_t cols;
+        /// `cols` rounded up to 64, the rest of each row is zeros
+        size_t stride;
+        std::vector<int8_t> weights;
+        /// per row, the weight scale times `input_scale`
+        std::vector<float> scales;
+        std::vector<float> biases;
+        /// value of one step of the quantized inputs of this layer
+        float input_scale;
+        float inverse_input_scale;
+    };
+
+    std::vector<Layer> m_layers;
+    const QuantizedKernels* m_kernels;
+};
+
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef NN_STATIC_HPP
+#define NN_STATIC_HPP
+
+#include "nn_kernels.hpp"
+#include "nn_model.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace connect_four {
+
+/// out = the sum of `in[col]` times row `col` of `weights`, for `cols` rows
+/// of `width` weights. Cloned per instruction set and picked when the
+/// program loads, as headers can't use the kernels' dispatch.
+template <size_t cols, size_t width, typename T>
+__attribute__((target_clones("default", "avx2", "arch=x86-64-v4"))) void
+fixed_product(const T* weights, const T* in, T* out)
+{
+    auto sums = std::array<T, width> {};
+    for (size_t col = 0; col < cols; ++col) {
+        auto value = in[col];
+        const auto* row = &weights[col * width];
+        for (size_t i = 0; i < width; ++i)
+            sums[i] += row[i] * value;
+    }
+    std::copy(sums.begin(), sums.end(), out);
+}
+
+/// A `BasicModel` with its layer sizes fixed at compile time, e.g.
+/// `StaticModel<42, 42, 18, 7>`, for inference only.
+///
+/// The parameters live inline. The weights of a layer are stored
+/// transposed, one row of outputs per input, and every row is padded to a
+/// whole cache line. Feeding a layer then is a fixed number of multiply-adds
+/// over contiguous outputs, which the compiler unrolls and vectorises, with
+/// no horizontal sums like a row by row product needs.
+template <typename T, size_t... Layers>
+class BasicStaticModel {
+    static_assert(sizeof...(Layers) >= 2);
+
+public:
+    static constexpr auto layers = std::array { Layers... };
+    static constexpr size_t inputs = layers.front();
+    static constexpr size_t outputs = layers.back();
+
+    /// every weight and bias 0
+    BasicStaticModel() = default;
+
+    /// copies the weights and biases of `model`, which must have the same
+    /// layers
+    explicit BasicStaticModel(const BasicModel<T>& model)
+    {
+        ASSERT_EQ(model.layers().size(), layers.size());
+        for (size_t layer = 0; layer + 1 < layers.size(); ++layer) {
+            ASSERT_EQ(model.layers()[layer], layers[layer]);
+            auto rows = layers[layer + 1];
+            auto cols = layers[layer];
+            auto weights = model.weights(layer).span();
+            auto biases = model.biases(layer).span();
+            for (size_t row = 0; row < rows; ++row) {
+                for (size_t col = 0; col < cols; ++col)
+                    m_parameters[weights_offset(layer) + col * stride(layer)
+                        + row]
+                        = weights[row * cols + col];
+                m_parameters[biases_offset(layer) + row] = biases[row];
+            }
+        }
+    }
+
+    /// a dynamic model with the same weights and biases
+    auto to_model() const -> BasicModel<T>
+    {
+        auto model = BasicModel<T>(
+            std::vector<size_t>(layers.begin(), layers.end()), zeroed);
+        auto parameters = std::vector<T>(model.parameter_count());
+        auto out = parameters.begin();
+        for (size_t layer = 0; layer + 1 < layers.size(); ++layer) {
+            auto rows = layers[layer + 1];
+            auto cols = layers[layer];
+            for (size_t row = 0; row < rows; ++row)
+                for (size_t col = 0; col < cols; ++col)
+                    *out++ = m_parameters[weights_offset(layer)
+                        + col * stride(layer) + row];
+            out = std::copy_n(&m_parameters[biases_offset(layer)], rows, out);
+        }
+        model.read_parameters(parameters);
+        return model;
+    }
+
+    auto feed(std::span<const T, inputs> input) const
+        -> std::array<T, outputs>
+    {
+        alignas(64) std::array<T, max_stride> front {};
+        alignas(64) std::array<T, max_stride> back {};
+        std::copy(input.begin(), input.end(), front.begin());
+        feed_layers(front.data(), back.data(),
+            std::make_index_sequence<layers.size() - 1>());
+
+        // after an odd number of weight layers, the outputs are in `back`
+        const auto& last = layers.size() % 2 == 0 ? back : front;
+        auto result = std::array<T, outputs>();
+        std::copy_n(last.begin(), outputs, result.begin());
+        return result;
+    }
+
+private:
+    static constexpr size_t lanes = 64 / sizeof(T);
+
+    /// outputs of `layer` rounded up to whole cache lines
+    static constexpr auto stride(size_t layer) -> size_t
+    {
+        return (layers[layer + 1] + lanes - 1) / lanes * lanes;
+    }
+
+    static constexpr auto weights_offset(size_t layer) -> size_t
+    {
+        size_t offset = 0;
+        for (size_t i = 0; i < layer; ++i)
+            offset += (layers[i] + 1) * stride(i);
+        return offset;
+    }
+
+    static constexpr auto biases_offset(size_t layer) -> size_t
+    {
+        return weights_offset(layer) + layers[layer] * stride(layer);
+    }
+
+    static constexpr size_t parameter_count
+        = weights_offset(layers.size() - 1);
+    static constexpr size_t max_stride
+        = *std::max_element(layers.begin(), layers.end()) + lanes;
+
+    template <size_t layer>
+    void feed_layer(const T* in, T* out) const
+    {
+        fixed_product<layers[layer], stride(layer)>(
+            &m_parameters[weights_offset(layer)], in, out);
+        nn_kernels<T>().bias_sigmoid(
+            out, &m_parameters[biases_offset(layer)], layers[layer + 1]);
+    }
+
+    template <size_t... layer>
+    void feed_layers(T* front, T* back, std::index_sequence<layer...>) const
+    {
+        // even layers read `front`, odd ones `back`
+        (feed_layer<layer>(layer % 2 == 0 ? front : back,
+             layer % 2 == 0 ? back : front),
+            ...);
+    }
+
+    alignas(64) std::array<T, parameter_count> m_parameters {};
+};
+
+template <size_t... Layers>
+using StaticModel = BasicStaticModel<double, Layers...>;
+template <size_t... Layers>
+using StaticModelf = BasicStaticModel<float, Layers...>;
+
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace connect_four {
+
+/// Calls `func(thread_index, item)` for every item in [0, items) on up to
+/// `threads` threads. Items are handed out one at a time, so uneven items
+/// don't leave threads idle.
+void parallel_for(size_t items, size_t threads, auto func)
+{
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(items, 1));
+    auto next_item = std::atomic<size_t>(0);
+
+    auto work = [&](size_t thread_index) {
+        while (true) {
+            auto item = next_item.fetch_add(1, std::memory_order_relaxed);
+            if (item >= items)
+                return;
+            func(thread_index, item);
+        }
+    };
+
+    auto workers = std::vector<std::jthread>();
+    workers.reserve(threads - 1);
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(work, i);
+    work(0);
+}
+
+}
+
+#endif
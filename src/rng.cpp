@@ -0,0 +1,85 @@
+#include "rng.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+using namespace connect_four;
+
+namespace {
+
+auto splitmix64(uint64_t& state) -> uint64_t
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+constexpr uint64_t default_seed = 0x5eed'c4c4'5eed'c4c4;
+
+std::atomic<size_t> next_default_stream = 0;
+
+thread_local Rng current_thread_rng = rng_stream(default_seed,
+    next_default_stream.fetch_add(1, std::memory_order_relaxed));
+
+}
+
+Rng::Rng(uint64_t seed)
+{
+    for (auto& word : m_state)
+        word = splitmix64(seed);
+}
+
+void Rng::fill(std::span<uint64_t> out)
+{
+    for (auto& v : out)
+        v = next();
+}
+
+void Rng::fill_uniform(std::span<double> out, double min, double max)
+{
+    auto scale = (max - min) * 0x1.0p-53;
+    for (auto& v : out)
+        v = min + static_cast<double>(next() >> 11) * scale;
+}
+
+void Rng::jump()
+{
+    constexpr auto jump_poly = std::array<uint64_t, 4> {
+        0x180ec6d33cfd0aba,
+        0xd5a61266f0c9392c,
+        0xa9582618e03fc9aa,
+        0x39abdc4529b1661c,
+    };
+
+    auto state = std::array<uint64_t, 4> {};
+    for (auto word : jump_poly) {
+        for (int bit = 0; bit < 64; ++bit) {
+            if (word & uint64_t { 1 } << bit) {
+                for (size_t i = 0; i < state.size(); ++i)
+                    state[i] ^= m_state[i];
+            }
+            next();
+        }
+    }
+    m_state = state;
+}
+
+auto connect_four::rng_stream(uint64_t master_seed, size_t index) -> Rng
+{
+    auto rng = Rng(master_seed);
+    for (size_t i = 0; i < index; ++i)
+        rng.jump();
+    return rng;
+}
+
+auto connect_four::thread_rng() -> Rng&
+{
+    return current_thread_rng;
+}
+
+void connect_four::seed_thread_rng(uint64_t master_seed, size_t stream)
+{
+    current_thread_rng = rng_stream(master_seed, stream);
+}
@@ -0,0 +1,105 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace connect_four {
+
+/// xoshiro256** pseudo random number generator
+///
+/// Satisfies UniformRandomBitGenerator, so it can be used with the standard
+/// distributions and algorithms.
+class Rng {
+public:
+    using result_type = uint64_t;
+
+    /// expands `seed` into the generator state through splitmix64
+    explicit Rng(uint64_t seed);
+
+    static constexpr auto min() -> result_type
+    {
+        return 0;
+    }
+
+    static constexpr auto max() -> result_type
+    {
+        return UINT64_MAX;
+    }
+
+    auto operator()() -> result_type
+    {
+        return next();
+    }
+
+    inline auto next() -> uint64_t
+    {
+        auto result = rotl(m_state[1] * 5, 7) * 9;
+        auto t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return result;
+    }
+
+    /// uniform in [0, bound), `bound` must not be 0
+    inline auto below(uint64_t bound) -> uint64_t
+    {
+        // Lemire's nearly divisionless method
+        auto product = static_cast<__uint128_t>(next()) * bound;
+        auto low = static_cast<uint64_t>(product);
+        if (low < bound) {
+            auto threshold = -bound % bound;
+            while (low < threshold) {
+                product = static_cast<__uint128_t>(next()) * bound;
+                low = static_cast<uint64_t>(product);
+            }
+        }
+        return static_cast<uint64_t>(product >> 64);
+    }
+
+    /// uniform in [0, 1)
+    inline auto next_double() -> double
+    {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+    /// uniform in [min, max)
+    inline auto uniform(double min, double max) -> double
+    {
+        return min + next_double() * (max - min);
+    }
+
+    void fill(std::span<uint64_t> out);
+    void fill_uniform(std::span<double> out, double min, double max);
+
+    /// advances the generator as if `next()` was called 2^128 times
+    void jump();
+
+private:
+    static inline auto rotl(uint64_t x, int k) -> uint64_t
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    std::array<uint64_t, 4> m_state;
+};
+
+/// Stream `index` of `master_seed`. Streams are 2^128 values apart, so
+/// generators of different streams never overlap.
+auto rng_stream(uint64_t master_seed, size_t index) -> Rng;
+
+/// Generator of the calling thread. Threads that haven't called
+/// `seed_thread_rng` use a stream of a fixed default seed.
+auto thread_rng() -> Rng&;
+/// Makes the calling thread use stream `stream` of `master_seed`.
+void seed_thread_rng(uint64_t master_seed, size_t stream);
+
+}
+
+#endif
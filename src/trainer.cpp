@@ -0,0 +1,325 @@
+#include "trainer.hpp"
+#include "board.hpp"
+#include "deci_tree_ai.hpp"
+#include "deci_tree_file.hpp"
+#include "game_record.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace connect_four;
+
+namespace {
+
+struct Checkpoint {
+    std::filesystem::path path;
+    Color color;
+    std::vector<DeciTreeEntry> entries;
+};
+
+/// Writes checkpoints on a background thread, so training never waits on
+/// I/O, only on copying the tables.
+class CheckpointWriter {
+public:
+    CheckpointWriter()
+        : m_thread([this](std::stop_token stop) { run(stop); })
+    {
+    }
+
+    void submit(Checkpoint checkpoint)
+    {
+        {
+            auto lock = std::unique_lock(m_mutex);
+            // a newer checkpoint makes a pending one for the same file moot
+            auto pending = std::find_if(m_queue.begin(), m_queue.end(),
+                [&](const auto& c) { return c.path == checkpoint.path; });
+            if (pending != m_queue.end())
+                *pending = std::move(checkpoint);
+            else
+                m_queue.push_back(std::move(checkpoint));
+        }
+        m_cond.notify_one();
+    }
+
+    /// writes the remaining checkpoints and stops the writer thread
+    auto finish() -> bool
+    {
+        m_thread.request_stop();
+        m_thread.join();
+        return !m_failed;
+    }
+
+private:
+    void run(std::stop_token stop)
+    {
+        while (true) {
+            auto lock = std::unique_lock(m_mutex);
+            m_cond.wait(lock, stop, [&] { return !m_queue.empty(); });
+            if (m_queue.empty())
+                return;
+            auto checkpoint = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            if (!save_deci_tree_entries(
+                    checkpoint.path, checkpoint.color, checkpoint.entries))
+                m_failed = true;
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_cond;
+    std::deque<Checkpoint> m_queue;
+    std::atomic<bool> m_failed = false;
+    std::jthread m_thread;
+};
+
+struct ShardStats {
+    std::atomic<size_t> games = 0;
+    std::atomic<size_t> red_wins = 0;
+    std::atomic<size_t> blue_wins = 0;
+    /// entries of the thread's own tables, which overlap with the other
+    /// threads' until they are merged
+    std::atomic<size_t> red_entries = 0;
+    std::atomic<size_t> blue_entries = 0;
+};
+
+auto model_path(const std::filesystem::path& output, Color color)
+    -> std::filesystem::path
+{
+    auto path = output;
+    path += color == Color::Red ? ".red" : ".blue";
+    return path;
+}
+
+auto shard_path(const std::filesystem::path& output, Color color, size_t shard)
+    -> std::filesystem::path
+{
+    auto path = model_path(output, color);
+    path += std::format(".{}", shard);
+    return path;
+}
+
+auto play_training_game(DeciTreeAi& red, DeciTreeAi& blue, GameRecord& record)
+    -> GameState
+{
+    auto board = Board();
+    red.new_game();
+    blue.new_game();
+
+    auto* current = &red;
+    auto* other = &blue;
+    while (true) {
+        auto col = current->next_move(board);
+        board.insert(col, current->tile());
+        record.push(col);
+
+        auto state = board.game_state();
+        if (state == color_win_state(current->color())) {
+            current->report_win();
+            other->report_loss();
+            record.result = state;
+            return state;
+        }
+        if (state == GameState::Draw) {
+            current->report_draw();
+            other->report_draw();
+            record.result = state;
+            return state;
+        }
+
+        std::swap(current, other);
+    }
+}
+
+void train_shard(const TrainOptions& opts, size_t shard, size_t games,
+    ShardStats& stats, CheckpointWriter& checkpoints, GameRecordFile* records)
+{
+    seed_thread_rng(opts.seed, shard);
+
+    auto record_writer = std::optional<GameRecordWriter>();
+    if (records)
+        record_writer.emplace(*records);
+
+    auto red = DeciTreeAi(Tile::Red);
+    auto blue = DeciTreeAi(Tile::Blue);
+
+    auto checkpoint = [&] {
+        for (auto* bot : { &red, &blue }) {
+            checkpoints.submit({
+                .path = shard_path(opts.output, bot->color(), shard),
+                .color = bot->color(),
+                .entries = bot->snapshot(),
+            });
+        }
+    };
+
+    for (size_t i = 1; i <= games; ++i) {
+        auto record = GameRecord { .tag = static_cast<uint16_t>(shard) };
+        auto state = play_training_game(red, blue, record);
+        if (record_writer)
+            record_writer->append(record);
+
+        switch (state) {
+            case GameState::RedWon:
+                stats.red_wins.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case GameState::BlueWon:
+                stats.blue_wins.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case GameState::Draw:
+            case GameState::Ongoing:
+                break;
+        }
+        stats.games.fetch_add(1, std::memory_order_relaxed);
+        stats.red_entries.store(red.model_entries(), std::memory_order_relaxed);
+        stats.blue_entries.store(
+            blue.model_entries(), std::memory_order_relaxed);
+
+        if (opts.checkpoint_interval != 0 && i % opts.checkpoint_interval == 0
+            && i != games)
+            checkpoint();
+    }
+
+    checkpoint();
+}
+
+struct Totals {
+    size_t games = 0;
+    size_t red_wins = 0;
+    size_t blue_wins = 0;
+    size_t red_entries = 0;
+    size_t blue_entries = 0;
+};
+
+auto sum_stats(const std::vector<ShardStats>& shards) -> Totals
+{
+    auto totals = Totals {};
+    for (const auto& shard : shards) {
+        totals.games += shard.games.load(std::memory_order_relaxed);
+        totals.red_wins += shard.red_wins.load(std::memory_order_relaxed);
+        totals.blue_wins += shard.blue_wins.load(std::memory_order_relaxed);
+        totals.red_entries += shard.red_entries.load(std::memory_order_relaxed);
+        totals.blue_entries
+            += shard.blue_entries.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+void print_report(const Totals& totals, double games_per_sec)
+{
+    auto percent = [&](size_t count) {
+        return totals.games == 0 ? 0.0
+                                 : static_cast<double>(count)
+                / static_cast<double>(totals.games) * 100;
+    };
+    auto draws = totals.games - totals.red_wins - totals.blue_wins;
+    // the entries are summed over the threads, the merged tables are
+    // smaller by the positions several threads learned
+    std::println("{:12} games {:10.0f} games/s  entries {:11} / {:11}  "
+                 "red {:5.1f}%  blue {:5.1f}%  draw {:5.1f}%",
+        totals.games, games_per_sec, totals.red_entries, totals.blue_entries,
+        percent(totals.red_wins), percent(totals.blue_wins), percent(draws));
+}
+
+}
+
+auto connect_four::run_training(const TrainOptions& opts) -> bool
+{
+    if (opts.agent != AgentType::DeciTree) {
+        std::cerr << "only decision tree agents can be trained\n";
+        return false;
+    }
+
+    auto threads = std::max<size_t>(opts.threads, 1);
+    std::println("training for {} games on {} threads, seed {}",
+        opts.iterations, threads, opts.seed);
+
+    auto records = std::optional<GameRecordFile>();
+    if (!opts.record.empty()) {
+        records.emplace(opts.record);
+        if (!records->ok())
+            return false;
+    }
+
+    auto checkpoints = CheckpointWriter();
+    auto shards = std::vector<ShardStats>(threads);
+    auto finished = std::atomic<size_t>(0);
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+
+    {
+        auto workers = std::vector<std::jthread>();
+        for (size_t shard = 0; shard < threads; ++shard) {
+            auto games = opts.iterations / threads
+                + (shard < opts.iterations % threads ? 1 : 0);
+            workers.emplace_back([&, shard, games] {
+                train_shard(opts, shard, games, shards[shard], checkpoints,
+                    records ? &*records : nullptr);
+                finished.fetch_add(1, std::memory_order_release);
+            });
+        }
+
+        auto last_report = start;
+        size_t last_games = 0;
+        while (finished.load(std::memory_order_acquire) < threads) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            auto now = Clock::now();
+            if (now - last_report < opts.report_interval)
+                continue;
+            auto totals = sum_stats(shards);
+            auto elapsed = std::chrono::duration<double>(now - last_report);
+            print_report(totals,
+                static_cast<double>(totals.games - last_games)
+                    / elapsed.count());
+            last_report = now;
+            last_games = totals.games;
+        }
+    }
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    auto totals = sum_stats(shards);
+    print_report(totals, static_cast<double>(totals.games) / elapsed.count());
+
+    if (records && !records->ok())
+        return false;
+    if (!checkpoints.finish()) {
+        std::cerr << "could not write checkpoints\n";
+        return false;
+    }
+
+    for (auto color : { Color::Red, Color::Blue }) {
+        auto inputs = std::vector<std::filesystem::path>();
+        for (size_t shard = 0; shard < threads; ++shard)
+            inputs.push_back(shard_path(opts.output, color, shard));
+
+        auto output = model_path(opts.output, color);
+        if (!merge_deci_tree_files(inputs, output, MergeMode::Sum))
+            return false;
+        for (const auto& input : inputs)
+            std::filesystem::remove(input);
+        auto merged = DeciTreeFileReader(output);
+        if (!merged.ok())
+            return false;
+        std::println(
+            "wrote {} with {} entries", output.string(), merged.entries());
+    }
+
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef TRAINER_HPP
+#define TRAINER_HPP
+
+#include "agent.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace connect_four {
+
+struct TrainOptions {
+    /// only decision tree agents can be trained for now
+    AgentType agent = AgentType::DeciTree;
+    size_t iterations = 1'000'000;
+    size_t threads = 1;
+    uint64_t seed = 0;
+    /// models are written to `<output>.red` and `<output>.blue`
+    std::filesystem::path output;
+    /// games per thread between checkpoints, 0 disables checkpoints
+    size_t checkpoint_interval = 100'000;
+    std::chrono::seconds report_interval { 10 };
+    /// if set, every game is appended to this game record file
+    std::filesystem::path record {};
+};
+
+/// Trains agents by self-play without any user interaction.
+///
+/// Every thread trains its own pair of agents on its share of the games,
+/// seeded with its own stream of `seed`. Checkpoints are written per thread
+/// to `<output>.<color>.<thread>` in the background, and the final models
+/// are the merged per-thread models.
+auto run_training(const TrainOptions& opts) -> bool;
+
+}
+
+#endif